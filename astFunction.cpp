@@ -1,93 +1,237 @@
 #include "spatialsim/astFunction.h"
 #include "spatialsim/mystruct.h"
 #include "spatialsim/searchFunction.h"
+#include "spatialsim/calcPDE.h"
 #include "sbml/SBMLTypes.h"
 #include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 
 using namespace std;
 LIBSBML_CPP_NAMESPACE_USE
 
-void parseAST(ASTNode *ast, reversePolishInfo *rpInfo, vector<variableInfo*> &varInfoList, int index_max)
+//operand kinds used while compiling, relocated to register numbers afterwards
+#define BC_KIND_SHIFT 30
+#define BC_KIND_CONST 0u
+#define BC_KIND_PARAM 1u
+#define BC_KIND_VAR 2u
+#define BC_KIND_TEMP 3u
+#define BC_INDEX_MASK ((1u << BC_KIND_SHIFT) - 1)
+
+static unsigned int makeOperand(unsigned int kind, unsigned int index)
+{
+	return (kind << BC_KIND_SHIFT) | index;
+}
+
+static bool isConstOperand(unsigned int operand, bytecodeInfo *bc, double value)
+{
+	if ((operand >> BC_KIND_SHIFT) != BC_KIND_CONST) return false;
+	return bc->constPool[operand & BC_INDEX_MASK] == value;
+}
+
+static unsigned int addConstOperand(bytecodeInfo *bc, double value)
+{
+	for (unsigned int i = 0; i < bc->constPool.size(); i++) {
+		if (memcmp(&(bc->constPool[i]), &value, sizeof(double)) == 0) return makeOperand(BC_KIND_CONST, i);
+	}
+	bc->constPool.push_back(value);
+	return makeOperand(BC_KIND_CONST, static_cast<unsigned int>(bc->constPool.size() - 1));
+}
+
+static unsigned int pushBytecode(bytecodeInfo *bc, int op, unsigned int a, unsigned int b, unsigned int depth, unsigned int &numOfTemps)
+{
+	bytecode bcode;
+	bcode.op = op;
+	bcode.dst = makeOperand(BC_KIND_TEMP, depth);
+	bcode.src1 = a;
+	bcode.src2 = b;
+	bc->code.push_back(bcode);
+	if (depth + 1 > numOfTemps) numOfTemps = depth + 1;
+	return bcode.dst;
+}
+
+//an operand kept by an identity fold must stay valid while the next sibling is compiled into T[depth + 1],
+//so a deeper temporary is moved to T[depth] (x * 1 is exact)
+static unsigned int keepOperand(bytecodeInfo *bc, unsigned int operand, unsigned int depth, unsigned int &numOfTemps)
+{
+	if ((operand >> BC_KIND_SHIFT) != BC_KIND_TEMP || (operand & BC_INDEX_MASK) == depth) return operand;
+	return pushBytecode(bc, BC_TIMES, operand, addConstOperand(bc, 1.0), depth, numOfTemps);
+}
+
+static unsigned int emitBytecode(bytecodeInfo *bc, int op, unsigned int a, unsigned int b, unsigned int depth, unsigned int &numOfTemps)
+{
+	bool isConstA = ((a >> BC_KIND_SHIFT) == BC_KIND_CONST);
+	bool isConstB = ((b >> BC_KIND_SHIFT) == BC_KIND_CONST);
+	//constant folding (unary operations are emitted with b == a)
+	if (isConstA && isConstB) {
+		return addConstOperand(bc, calcBytecodeOp(op, bc->constPool[a & BC_INDEX_MASK], bc->constPool[b & BC_INDEX_MASK]));
+	}
+	//dead branches of piecewise become "0 * expression" after rearrangeAST
+	switch (op) {
+	case BC_PLUS:
+		if (isConstOperand(a, bc, 0.0)) return keepOperand(bc, b, depth, numOfTemps);
+		if (isConstOperand(b, bc, 0.0)) return keepOperand(bc, a, depth, numOfTemps);
+		break;
+	case BC_MINUS:
+		if (isConstOperand(b, bc, 0.0)) return keepOperand(bc, a, depth, numOfTemps);
+		break;
+	case BC_TIMES:
+		if (isConstOperand(a, bc, 0.0) || isConstOperand(b, bc, 0.0)) return addConstOperand(bc, 0.0);
+		if (isConstOperand(a, bc, 1.0)) return keepOperand(bc, b, depth, numOfTemps);
+		if (isConstOperand(b, bc, 1.0)) return keepOperand(bc, a, depth, numOfTemps);
+		break;
+	case BC_DIVIDE:
+		if (isConstOperand(b, bc, 1.0)) return keepOperand(bc, a, depth, numOfTemps);
+		break;
+	default:
+		break;
+	}
+	return pushBytecode(bc, op, a, b, depth, numOfTemps);
+}
+
+static int getBytecodeOp(ASTNode *ast)
+{
+	switch (ast->getType()) {
+	case AST_PLUS: return BC_PLUS;
+	case AST_MINUS: return BC_MINUS;
+	case AST_TIMES: return BC_TIMES;
+	case AST_DIVIDE: return BC_DIVIDE;
+	case AST_POWER:
+	case AST_FUNCTION_POWER: return BC_POWER;
+	case AST_FUNCTION_ROOT: return (ast->getNumChildren() == 1) ? BC_SQRT : BC_ROOT;
+	case AST_FUNCTION_ABS: return BC_ABS;
+	case AST_FUNCTION_EXP: return BC_EXP;
+	case AST_FUNCTION_LN: return BC_LN;
+	case AST_FUNCTION_LOG: return (ast->getNumChildren() == 1) ? BC_LOG10 : BC_LOG;
+	case AST_FUNCTION_CEILING: return BC_CEILING;
+	case AST_FUNCTION_FLOOR: return BC_FLOOR;
+	case AST_FUNCTION_FACTORIAL: return BC_FACTORIAL;
+	case AST_FUNCTION_SIN: return BC_SIN;
+	case AST_FUNCTION_COS: return BC_COS;
+	case AST_FUNCTION_TAN: return BC_TAN;
+	case AST_FUNCTION_SEC: return BC_SEC;
+	case AST_FUNCTION_CSC: return BC_CSC;
+	case AST_FUNCTION_COT: return BC_COT;
+	case AST_FUNCTION_SINH: return BC_SINH;
+	case AST_FUNCTION_COSH: return BC_COSH;
+	case AST_FUNCTION_TANH: return BC_TANH;
+	case AST_FUNCTION_SECH: return BC_SECH;
+	case AST_FUNCTION_CSCH: return BC_CSCH;
+	case AST_FUNCTION_COTH: return BC_COTH;
+	case AST_FUNCTION_ARCSIN: return BC_ARCSIN;
+	case AST_FUNCTION_ARCCOS: return BC_ARCCOS;
+	case AST_FUNCTION_ARCTAN: return BC_ARCTAN;
+	case AST_FUNCTION_ARCSEC: return BC_ARCSEC;
+	case AST_FUNCTION_ARCCSC: return BC_ARCCSC;
+	case AST_FUNCTION_ARCCOT: return BC_ARCCOT;
+	case AST_FUNCTION_ARCSINH: return BC_ARCSINH;
+	case AST_FUNCTION_ARCCOSH: return BC_ARCCOSH;
+	case AST_FUNCTION_ARCTANH: return BC_ARCTANH;
+	case AST_FUNCTION_ARCSECH: return BC_ARCSECH;
+	case AST_FUNCTION_ARCCSCH: return BC_ARCCSCH;
+	case AST_FUNCTION_ARCCOTH: return BC_ARCCOTH;
+	case AST_LOGICAL_AND: return BC_AND;
+	case AST_LOGICAL_OR: return BC_OR;
+	case AST_LOGICAL_XOR: return BC_XOR;
+	case AST_LOGICAL_NOT: return BC_NOT;
+	case AST_RELATIONAL_EQ: return BC_EQ;
+	case AST_RELATIONAL_GEQ: return BC_GEQ;
+	case AST_RELATIONAL_GT: return BC_GT;
+	case AST_RELATIONAL_LEQ: return BC_LEQ;
+	case AST_RELATIONAL_LT: return BC_LT;
+	case AST_RELATIONAL_NEQ: return BC_NEQ;
+	default:
+		return -1;
+	}
+}
+
+static unsigned int compileASTNode(ASTNode *ast, bytecodeInfo *bc, vector<variableInfo*> &varInfoList, bool useDelta, unsigned int depth, unsigned int &numOfTemps)
 {
-	static int index = 0;
 	unsigned int i;
-	for (i = 0; i < ast->getNumChildren(); i++) {
-		parseAST(ast->getChild(i), rpInfo, varInfoList, index_max);
-	}
-	if (ast->isFunction() || ast->isOperator() || ast->isRelational() || ast->isLogical()) {
-		//ast is function, operator, relational or logical
-		rpInfo->varList[index] = 0;
-		rpInfo->constList[index] = 0;
-		rpInfo->opfuncList[index] = ast->getType();
-		if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
+	if (ast->isInteger()) {//ast is integer
+		return addConstOperand(bc, static_cast<double>(ast->getInteger()));
 	} else if (ast->isReal()) {//ast is real number
-		rpInfo->varList[index] = 0;
-		rpInfo->constList[index] = new double(ast->getReal());
-		rpInfo->opfuncList[index] = 0;
-		if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-	} else if (ast->isInteger()) {//ast is integer
-		rpInfo->varList[index] = 0;
-		rpInfo->constList[index] = new double(ast->getInteger());
-		rpInfo->opfuncList[index] = 0;
-		if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
+		return addConstOperand(bc, ast->getReal());
 	} else if (ast->isConstant()) {//ast is constant
-		ASTNodeType_t type = ast->getType();
-		if (type == AST_CONSTANT_E) {
-			rpInfo->varList[index] = 0;
-			rpInfo->constList[index] = new double(M_E);
-			rpInfo->opfuncList[index] = 0;
-			if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-		} else if (type == AST_CONSTANT_PI) {
-			rpInfo->varList[index] = 0;
-			rpInfo->constList[index] = new double(M_PI);
-			rpInfo->opfuncList[index] = 0;
-			if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-		}  else if (type == AST_CONSTANT_FALSE) {
-			rpInfo->varList[index] = 0;
-			rpInfo->constList[index] = new double(0.0);
-			rpInfo->opfuncList[index] = 0;
-			if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-		}  else if (type == AST_CONSTANT_TRUE) {
-			rpInfo->varList[index] = 0;
-			rpInfo->constList[index] = new double(1.0);
-			rpInfo->opfuncList[index] = 0;
-			if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-		}
-	}
-	else if (ast->isName()) {
-		ASTNodeType_t type = ast->getType();
-		if (type == AST_NAME) {
-			variableInfo *info = searchInfoById(varInfoList, ast->getName());
-			if (info != 0) {
-				if (info->isUniform) {
-					rpInfo->varList[index] = 0;
-					rpInfo->constList[index] = info->value;
-					rpInfo->opfuncList[index] = 0;
-					if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-				} else {
-					rpInfo->varList[index] = info->value;
-					rpInfo->constList[index] = 0;
-					rpInfo->opfuncList[index] = 0;
-					if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = info->delta;
-				}
+		switch (ast->getType()) {
+		case AST_CONSTANT_E: return addConstOperand(bc, M_E);
+		case AST_CONSTANT_PI: return addConstOperand(bc, M_PI);
+		case AST_CONSTANT_TRUE: return addConstOperand(bc, 1.0);
+		default: return addConstOperand(bc, 0.0);
+		}
+	} else if (ast->isName()) {
+		variableInfo *info = 0;
+		if (ast->getType() == AST_NAME_AVOGADRO) {
+			return addConstOperand(bc, 6.0221367e+23);
+		} else if (ast->getType() == AST_NAME_TIME) {
+			info = searchInfoById(varInfoList, "t");
+		} else {
+			info = searchInfoById(varInfoList, ast->getName());
+		}
+		if (info == 0 || info->value == 0) {
+			cerr << "error: symbol \"" << ast->getName() << "\" has no value" << endl;
+			exit(1);
+		}
+		if (info->isUniform) {//uniform values (parameters, time) are read once per evaluation
+			for (i = 0; i < bc->paramList.size(); i++) {
+				if (bc->paramList[i] == info->value) return makeOperand(BC_KIND_PARAM, i);
 			}
-		} else if (type == AST_NAME_AVOGADRO) {
-			rpInfo->varList[index] = 0;
-			rpInfo->constList[index] = new double(6.0221367e+23);
-			rpInfo->opfuncList[index] = 0;
-			if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
-		} else if (type == AST_NAME_TIME) {
-			variableInfo *info = searchInfoById(varInfoList, "t");
-			if (info != 0) {
-				rpInfo->varList[index] = 0;
-				rpInfo->constList[index] = info->value;
-				rpInfo->opfuncList[index] = 0;
-				if (rpInfo->deltaList != 0) rpInfo->deltaList[index] = 0;
+			bc->paramList.push_back(info->value);
+			return makeOperand(BC_KIND_PARAM, static_cast<unsigned int>(bc->paramList.size() - 1));
+		} else {//value of each point
+			for (i = 0; i < bc->varList.size(); i++) {
+				if (bc->varList[i] == info->value) return makeOperand(BC_KIND_VAR, i);
 			}
+			bc->varList.push_back(info->value);
+			bc->deltaList.push_back((useDelta) ? info->delta : 0);
+			bc->varInfoList.push_back(info);
+			return makeOperand(BC_KIND_VAR, static_cast<unsigned int>(bc->varList.size() - 1));
 		}
 	}
-	index++;
-	if (index == index_max) index = 0;
+	//ast is function, operator, relational or logical
+	int op = getBytecodeOp(ast);
+	if (op < 0 || ast->getNumChildren() == 0) {
+		char *formula = SBML_formulaToString(ast);
+		cerr << "error: \"" << formula << "\" is not supported" << endl;
+		free(formula);
+		exit(1);
+	}
+	unsigned int acc = compileASTNode(ast->getChild(0), bc, varInfoList, useDelta, depth, numOfTemps);
+	if (ast->getNumChildren() == 1) {
+		return emitBytecode(bc, op, acc, acc, depth, numOfTemps);
+	}
+	//n-ary plus, times and logicals are folded from the left
+	for (i = 1; i < ast->getNumChildren(); i++) {
+		unsigned int rhs = compileASTNode(ast->getChild(i), bc, varInfoList, useDelta, depth + 1, numOfTemps);
+		acc = emitBytecode(bc, op, acc, rhs, depth, numOfTemps);
+	}
+	return acc;
+}
+
+bytecodeInfo* compileAST(ASTNode *ast, vector<variableInfo*> &varInfoList, bool useDelta)
+{
+	unsigned int i, numOfTemps = 0;
+	bytecodeInfo *bc = new bytecodeInfo;
+	unsigned int result = compileASTNode(ast, bc, varInfoList, useDelta, 0, numOfTemps);
+	//relocate operands to [constPool | paramList | varList | temporaries]
+	unsigned int base[4];
+	base[BC_KIND_CONST] = 0;
+	base[BC_KIND_PARAM] = static_cast<unsigned int>(bc->constPool.size());
+	base[BC_KIND_VAR] = base[BC_KIND_PARAM] + static_cast<unsigned int>(bc->paramList.size());
+	base[BC_KIND_TEMP] = base[BC_KIND_VAR] + static_cast<unsigned int>(bc->varList.size());
+	for (i = 0; i < bc->code.size(); i++) {
+		bc->code[i].dst = base[bc->code[i].dst >> BC_KIND_SHIFT] + (bc->code[i].dst & BC_INDEX_MASK);
+		bc->code[i].src1 = base[bc->code[i].src1 >> BC_KIND_SHIFT] + (bc->code[i].src1 & BC_INDEX_MASK);
+		bc->code[i].src2 = base[bc->code[i].src2 >> BC_KIND_SHIFT] + (bc->code[i].src2 & BC_INDEX_MASK);
+	}
+	bc->result = base[result >> BC_KIND_SHIFT] + (result & BC_INDEX_MASK);
+	bc->paramBase = base[BC_KIND_PARAM];
+	bc->varBase = base[BC_KIND_VAR];
+	bc->numOfRegisters = max(base[BC_KIND_TEMP] + numOfTemps, 1u);
+	bc->nativeFunc = 0;
+	return bc;
 }
 
 void countAST(ASTNode *ast, unsigned int &numOfASTNodes)
@@ -211,3 +355,180 @@ void parseDependence(const ASTNode *ast, vector<variableInfo*> &dependence, vect
 		}
 	}
 }
+
+static bool isNumberNode(const ASTNode *ast, double value)
+{
+	if (ast->isInteger()) return static_cast<double>(ast->getInteger()) == value;
+	if (ast->isReal()) return ast->getReal() == value;
+	return false;
+}
+
+static ASTNode* newRealNode(double value)
+{
+	ASTNode *ast = new ASTNode(AST_REAL);
+	ast->setValue(value);
+	return ast;
+}
+
+//the operands are owned by the new node, zeros and ones are folded so that derivatives stay small
+static ASTNode* newASTNode(ASTNodeType_t type, ASTNode *a, ASTNode *b = 0)
+{
+	if (b != 0) {
+		bool isZeroA = isNumberNode(a, 0.0), isZeroB = isNumberNode(b, 0.0);
+		if ((type == AST_PLUS && isZeroB) || (type == AST_MINUS && isZeroB) || (type == AST_TIMES && isNumberNode(b, 1.0))
+		    || (type == AST_DIVIDE && isNumberNode(b, 1.0))) {
+			delete b;
+			return a;
+		}
+		if ((type == AST_PLUS && isZeroA) || (type == AST_TIMES && isNumberNode(a, 1.0))) {
+			delete a;
+			return b;
+		}
+		if ((type == AST_TIMES && (isZeroA || isZeroB)) || (type == AST_DIVIDE && isZeroA)) {
+			delete a;
+			delete b;
+			return newRealNode(0.0);
+		}
+	}
+	ASTNode *ast = new ASTNode(type);
+	ast->addChild(a);
+	if (b != 0) ast->addChild(b);
+	return ast;
+}
+
+static ASTNode* copyAST(const ASTNode *ast)
+{
+	return ast->deepCopy();
+}
+
+//a * a, a is owned by the new node
+static ASTNode* newSquareNode(ASTNode *a)
+{
+	return newASTNode(AST_TIMES, a, copyAST(a));
+}
+
+//d ast / d id, the caller deletes the returned tree
+//relational and logical nodes (and piecewise conditions after rearrangeAST) are piecewise constant, so their derivative is 0
+ASTNode* differentiateAST(const ASTNode *ast, const char *id)
+{
+	unsigned int i, j;
+	if (ast->isName()) {
+		bool isId = (ast->getType() == AST_NAME && strcmp(ast->getName(), id) == 0);
+		return newRealNode(isId ? 1.0 : 0.0);
+	}
+	if (ast->isInteger() || ast->isReal() || ast->isConstant() || ast->getNumChildren() == 0) return newRealNode(0.0);
+	const ASTNode *u = ast->getChild(0);
+	const ASTNode *v = (ast->getNumChildren() > 1) ? ast->getChild(1) : 0;
+	ASTNode *result = 0;
+	if (ast->getType() == AST_FUNCTION_ROOT || ast->getType() == AST_FUNCTION_LOG) {
+		//sqrt(u) = u^0.5, root(u, v) = v^(1 / u), log10(u) = ln(u) / ln(10) and log(u, v) = ln(v) / ln(u)
+		ASTNode *equivalent = 0;
+		if (ast->getType() == AST_FUNCTION_ROOT) {
+			equivalent = (v == 0) ? newASTNode(AST_POWER, copyAST(u), newRealNode(0.5))
+			                      : newASTNode(AST_POWER, copyAST(v), newASTNode(AST_DIVIDE, newRealNode(1.0), copyAST(u)));
+		} else {
+			equivalent = (v == 0) ? newASTNode(AST_DIVIDE, newASTNode(AST_FUNCTION_LN, copyAST(u)), newRealNode(M_LN10))
+			                      : newASTNode(AST_DIVIDE, newASTNode(AST_FUNCTION_LN, copyAST(v)), newASTNode(AST_FUNCTION_LN, copyAST(u)));
+		}
+		result = differentiateAST(equivalent, id);
+		delete equivalent;
+		return result;
+	}
+	ASTNode *du = differentiateAST(u, id);
+	switch (ast->getType()) {
+	case AST_PLUS:
+		result = du;
+		for (i = 1; i < ast->getNumChildren(); i++) result = newASTNode(AST_PLUS, result, differentiateAST(ast->getChild(i), id));
+		return result;
+	case AST_MINUS:
+		if (v == 0) return newASTNode(AST_TIMES, newRealNode(-1.0), du);
+		return newASTNode(AST_MINUS, du, differentiateAST(v, id));
+	case AST_TIMES:
+		//product rule over all the factors
+		result = newRealNode(0.0);
+		for (i = 0; i < ast->getNumChildren(); i++) {
+			ASTNode *term = (i == 0) ? du : differentiateAST(ast->getChild(i), id);
+			for (j = 0; j < ast->getNumChildren(); j++) {
+				if (j != i) term = newASTNode(AST_TIMES, term, copyAST(ast->getChild(j)));
+			}
+			result = newASTNode(AST_PLUS, result, term);
+		}
+		return result;
+	case AST_DIVIDE:
+		//du / v - u * dv / (v * v)
+		return newASTNode(AST_MINUS, newASTNode(AST_DIVIDE, du, copyAST(v)),
+		                  newASTNode(AST_DIVIDE, newASTNode(AST_TIMES, copyAST(u), differentiateAST(v, id)), newSquareNode(copyAST(v))));
+	case AST_POWER:
+	case AST_FUNCTION_POWER: {
+		ASTNode *dv = differentiateAST(v, id);
+		if (isNumberNode(dv, 0.0)) {
+			//v * u^(v - 1) * du
+			delete dv;
+			return newASTNode(AST_TIMES, newASTNode(AST_TIMES, copyAST(v), newASTNode(AST_POWER, copyAST(u), newASTNode(AST_MINUS, copyAST(v), newRealNode(1.0)))), du);
+		}
+		//u^v * (dv * ln(u) + v * du / u)
+		return newASTNode(AST_TIMES, copyAST(ast),
+		                  newASTNode(AST_PLUS, newASTNode(AST_TIMES, dv, newASTNode(AST_FUNCTION_LN, copyAST(u))),
+		                             newASTNode(AST_DIVIDE, newASTNode(AST_TIMES, copyAST(v), du), copyAST(u))));
+	}
+	case AST_FUNCTION_ABS:
+		//sign(u) * du
+		return newASTNode(AST_TIMES, newASTNode(AST_MINUS, newASTNode(AST_RELATIONAL_GT, copyAST(u), newRealNode(0.0)),
+		                                        newASTNode(AST_RELATIONAL_LT, copyAST(u), newRealNode(0.0))), du);
+	case AST_FUNCTION_EXP:
+		return newASTNode(AST_TIMES, copyAST(ast), du);
+	case AST_FUNCTION_LN:
+		return newASTNode(AST_DIVIDE, du, copyAST(u));
+	case AST_FUNCTION_SIN:
+		return newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_COS, copyAST(u)), du);
+	case AST_FUNCTION_COS:
+		return newASTNode(AST_TIMES, newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_FUNCTION_SIN, copyAST(u))), du);
+	case AST_FUNCTION_TAN:
+		return newASTNode(AST_DIVIDE, du, newSquareNode(newASTNode(AST_FUNCTION_COS, copyAST(u))));
+	case AST_FUNCTION_SEC:
+		return newASTNode(AST_TIMES, newASTNode(AST_TIMES, copyAST(ast), newASTNode(AST_FUNCTION_TAN, copyAST(u))), du);
+	case AST_FUNCTION_CSC:
+		return newASTNode(AST_TIMES, newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_TIMES, copyAST(ast), newASTNode(AST_FUNCTION_COT, copyAST(u)))), du);
+	case AST_FUNCTION_COT:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newSquareNode(newASTNode(AST_FUNCTION_SIN, copyAST(u)))));
+	case AST_FUNCTION_SINH:
+		return newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_COSH, copyAST(u)), du);
+	case AST_FUNCTION_COSH:
+		return newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_SINH, copyAST(u)), du);
+	case AST_FUNCTION_TANH:
+		return newASTNode(AST_DIVIDE, du, newSquareNode(newASTNode(AST_FUNCTION_COSH, copyAST(u))));
+	case AST_FUNCTION_SECH:
+		return newASTNode(AST_TIMES, newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_TIMES, copyAST(ast), newASTNode(AST_FUNCTION_TANH, copyAST(u)))), du);
+	case AST_FUNCTION_CSCH:
+		return newASTNode(AST_TIMES, newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_TIMES, copyAST(ast), newASTNode(AST_FUNCTION_COTH, copyAST(u)))), du);
+	case AST_FUNCTION_COTH:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newSquareNode(newASTNode(AST_FUNCTION_SINH, copyAST(u)))));
+	case AST_FUNCTION_ARCSIN:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_POWER, newASTNode(AST_MINUS, newRealNode(1.0), newSquareNode(copyAST(u))), newRealNode(0.5)));
+	case AST_FUNCTION_ARCCOS:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newASTNode(AST_POWER, newASTNode(AST_MINUS, newRealNode(1.0), newSquareNode(copyAST(u))), newRealNode(0.5))));
+	case AST_FUNCTION_ARCTAN:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_PLUS, newRealNode(1.0), newSquareNode(copyAST(u))));
+	case AST_FUNCTION_ARCCOT:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newASTNode(AST_PLUS, newRealNode(1.0), newSquareNode(copyAST(u)))));
+	case AST_FUNCTION_ARCSEC:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_ABS, copyAST(u)), newASTNode(AST_POWER, newASTNode(AST_MINUS, newSquareNode(copyAST(u)), newRealNode(1.0)), newRealNode(0.5))));
+	case AST_FUNCTION_ARCCSC:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_ABS, copyAST(u)), newASTNode(AST_POWER, newASTNode(AST_MINUS, newSquareNode(copyAST(u)), newRealNode(1.0)), newRealNode(0.5)))));
+	case AST_FUNCTION_ARCSINH:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_POWER, newASTNode(AST_PLUS, newSquareNode(copyAST(u)), newRealNode(1.0)), newRealNode(0.5)));
+	case AST_FUNCTION_ARCCOSH:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_POWER, newASTNode(AST_MINUS, newSquareNode(copyAST(u)), newRealNode(1.0)), newRealNode(0.5)));
+	case AST_FUNCTION_ARCTANH:
+	case AST_FUNCTION_ARCCOTH:
+		return newASTNode(AST_DIVIDE, du, newASTNode(AST_MINUS, newRealNode(1.0), newSquareNode(copyAST(u))));
+	case AST_FUNCTION_ARCSECH:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newASTNode(AST_TIMES, copyAST(u), newASTNode(AST_POWER, newASTNode(AST_MINUS, newRealNode(1.0), newSquareNode(copyAST(u))), newRealNode(0.5)))));
+	case AST_FUNCTION_ARCCSCH:
+		return newASTNode(AST_TIMES, newRealNode(-1.0), newASTNode(AST_DIVIDE, du, newASTNode(AST_TIMES, newASTNode(AST_FUNCTION_ABS, copyAST(u)), newASTNode(AST_POWER, newASTNode(AST_PLUS, newRealNode(1.0), newSquareNode(copyAST(u))), newRealNode(0.5)))));
+	default:
+		//ceiling, floor, factorial, relational and logical
+		delete du;
+		return newRealNode(0.0);
+	}
+}
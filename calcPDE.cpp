@@ -7,401 +7,417 @@
 #include "sbml/packages/spatial/extension/SpatialExtension.h"
 #include <vector>
 #include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <limits>
 
-#define stackMax 50
+#define INITIAL_PARALLEL 4096//smaller lists are not worth a parallel region
+#define LANE_POW_INT 16//integer exponents up to this are multiplied out
 
 using namespace std;
 LIBSBML_CPP_NAMESPACE_USE
 
-void reversePolishInitial(vector<unsigned int> &indexList, reversePolishInfo *rpInfo, double *value, unsigned int numOfASTNodes, int Xindex, int Yindex, int Zindex, bool isAllArea)
+double calcBytecodeOp(int op, double a, double b)
 {
-  unsigned int it_end = 0;
-	int st_index = 0;
-	unsigned int index = 0;
-	double rpStack[stackMax] = {0};
-	if (!isAllArea) it_end = static_cast<unsigned int>(indexList.size());
-	else it_end = Xindex * Yindex * Zindex;
-	for (unsigned int j = 0; j < it_end; j++) {
-		if (!isAllArea) index = indexList[j];
-		else index = j;
-		st_index = 0;
-		for (unsigned int i = 0; i < numOfASTNodes; i++) {
-			if (rpInfo->varList[i] != 0) {//set variable into the stack
-				rpStack[st_index] = rpInfo->varList[i][index];
-				st_index++;
-			} else if (rpInfo->constList[i] != 0) {//set const into the stack
-				rpStack[st_index] = *(rpInfo->constList[i]);
-				st_index++;
-			} else {//operation
-				st_index--;
-				switch (rpInfo->opfuncList[i]) {
-				case AST_PLUS:
-					rpStack[st_index - 1] += rpStack[st_index];
-					break;
-				case AST_MINUS:
-					rpStack[st_index - 1] -= rpStack[st_index];
-					break;
-				case AST_TIMES:
-					rpStack[st_index - 1] *= rpStack[st_index];
-					break;
-				case AST_DIVIDE:
-					rpStack[st_index - 1] /= rpStack[st_index];
-					break;
-				case AST_POWER:
-				case AST_FUNCTION_POWER:
-					rpStack[st_index - 1] = pow(rpStack[st_index - 1], rpStack[st_index]);
-					break;
-				case AST_FUNCTION_ABS:
-					rpStack[st_index] = fabs(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCOS:
-					rpStack[st_index] = acos(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCOSH:
-					rpStack[st_index] = acosh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCSC:
-					rpStack[st_index] = asin(1.0 / rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCSCH:
-					break;
-				case AST_FUNCTION_ARCSEC:
-					break;
-				case AST_FUNCTION_ARCSECH:
-					break;
-				case AST_FUNCTION_ARCSIN:
-					rpStack[st_index] = asin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCSINH:
-					break;
-				case AST_FUNCTION_ARCTAN:
-					rpStack[st_index] = atan(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCTANH:
-					break;
-				case AST_FUNCTION_CEILING:
-					break;
-				case AST_FUNCTION_COS:
-					rpStack[st_index] = cos(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_COSH:
-					rpStack[st_index] = cosh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_COT:
-					break;
-				case AST_FUNCTION_COTH:
-					break;
-				case AST_FUNCTION_CSC:
-					rpStack[st_index] = 1.0 / sin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_CSCH:
-					break;
-				case AST_FUNCTION_DELAY:
-					break;
-				case AST_FUNCTION_EXP:
-					rpStack[st_index] = exp(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_FACTORIAL:
-					break;
-				case AST_FUNCTION_FLOOR:
-					break;
-				case AST_FUNCTION_LN:
-					rpStack[st_index] = log(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_LOG:
-					rpStack[st_index - 1] = log(rpStack[st_index]) / log(rpStack[st_index - 1]);
-					break;
-				case AST_FUNCTION_PIECEWISE:
-					break;
-				case AST_FUNCTION_ROOT:
-					rpStack[st_index] = sqrt(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_SEC:
-					break;
-				case AST_FUNCTION_SECH:
-					break;
-				case AST_FUNCTION_SIN:
-					rpStack[st_index] = sin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_SINH:
-					rpStack[st_index] = sinh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_TAN:
-					rpStack[st_index] = tan(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_TANH:
-					rpStack[st_index] = tanh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_LAMBDA:
-					break;
-				case AST_LOGICAL_AND:
-					rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index]) == 1) ? 1.0 : 0.0;
-					break;
-				case AST_LOGICAL_NOT:
-					rpStack[st_index] = (static_cast<int>(rpStack[st_index]) == 0) ? 1.0 : 0.0;
-					st_index++;
-					break;
-				case AST_LOGICAL_OR:
-					rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 || static_cast<int>(rpStack[st_index]) == 1) ? 1.0 : 0.0;
-					break;
-				case AST_LOGICAL_XOR:
-					rpStack[st_index - 1] = ((static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index]) == 0)
-					                         || (static_cast<int>(rpStack[st_index - 1]) == 0 && static_cast<int>(rpStack[st_index]) == 1)) ? 1.0 : 0.0;
-					break;
-				case AST_RATIONAL:
-					break;
-				case AST_RELATIONAL_EQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] == rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_GEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] >= rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_GT:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] > rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_LEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] <= rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_LT:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] < rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_NEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] != rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				default:
-					break;
+	switch (op) {
+	case BC_PLUS:
+		return a + b;
+	case BC_MINUS:
+		return a - b;
+	case BC_TIMES:
+		return a * b;
+	case BC_DIVIDE:
+		return a / b;
+	case BC_POWER:
+		return pow(a, b);
+	case BC_ROOT://root(degree, x)
+		return (a == 2.0) ? sqrt(b) : pow(b, 1.0 / a);
+	case BC_SQRT:
+		return sqrt(a);
+	case BC_ABS:
+		return fabs(a);
+	case BC_EXP:
+		return exp(a);
+	case BC_LN:
+		return log(a);
+	case BC_LOG10:
+		return log10(a);
+	case BC_LOG://log(base, x)
+		return log(b) / log(a);
+	case BC_CEILING:
+		return ceil(a);
+	case BC_FLOOR:
+		return floor(a);
+	case BC_FACTORIAL:
+		return tgamma(a + 1.0);
+	case BC_SIN:
+		return sin(a);
+	case BC_COS:
+		return cos(a);
+	case BC_TAN:
+		return tan(a);
+	case BC_SEC:
+		return 1.0 / cos(a);
+	case BC_CSC:
+		return 1.0 / sin(a);
+	case BC_COT:
+		return 1.0 / tan(a);
+	case BC_SINH:
+		return sinh(a);
+	case BC_COSH:
+		return cosh(a);
+	case BC_TANH:
+		return tanh(a);
+	case BC_SECH:
+		return 1.0 / cosh(a);
+	case BC_CSCH:
+		return 1.0 / sinh(a);
+	case BC_COTH:
+		return 1.0 / tanh(a);
+	case BC_ARCSIN:
+		return asin(a);
+	case BC_ARCCOS:
+		return acos(a);
+	case BC_ARCTAN:
+		return atan(a);
+	case BC_ARCSEC:
+		return acos(1.0 / a);
+	case BC_ARCCSC:
+		return asin(1.0 / a);
+	case BC_ARCCOT:
+		return atan(1.0 / a);
+	case BC_ARCSINH:
+		return asinh(a);
+	case BC_ARCCOSH:
+		return acosh(a);
+	case BC_ARCTANH:
+		return atanh(a);
+	case BC_ARCSECH:
+		return acosh(1.0 / a);
+	case BC_ARCCSCH:
+		return asinh(1.0 / a);
+	case BC_ARCCOTH:
+		return atanh(1.0 / a);
+	case BC_AND:
+		return (static_cast<int>(a) == 1 && static_cast<int>(b) == 1) ? 1.0 : 0.0;
+	case BC_OR:
+		return (static_cast<int>(a) == 1 || static_cast<int>(b) == 1) ? 1.0 : 0.0;
+	case BC_XOR:
+		return ((static_cast<int>(a) == 1 && static_cast<int>(b) == 0) || (static_cast<int>(a) == 0 && static_cast<int>(b) == 1)) ? 1.0 : 0.0;
+	case BC_NOT:
+		return (static_cast<int>(a) == 0) ? 1.0 : 0.0;
+	case BC_EQ:
+		return (a == b) ? 1.0 : 0.0;
+	case BC_GEQ:
+		return (a >= b) ? 1.0 : 0.0;
+	case BC_GT:
+		return (a > b) ? 1.0 : 0.0;
+	case BC_LEQ:
+		return (a <= b) ? 1.0 : 0.0;
+	case BC_LT:
+		return (a < b) ? 1.0 : 0.0;
+	case BC_NEQ:
+		return (a != b) ? 1.0 : 0.0;
+	default:
+		return 0.0;
+	}
+}
+
+//copy constants and uniform values into the head of the register file
+void loadBytecodeRegisters(bytecodeInfo *bc, vector<double> &reg)
+{
+	unsigned int i;
+	reg.resize(bc->numOfRegisters);
+	for (i = 0; i < bc->constPool.size(); i++) reg[i] = bc->constPool[i];
+	for (i = 0; i < bc->paramList.size(); i++) reg[bc->paramBase + i] = *(bc->paramList[i]);
+}
+
+double executeBytecode(const bytecodeInfo *bc, double *reg)
+{
+	if (bc->nativeFunc != 0) {
+		bc->nativeFunc(reg, 1);
+		return reg[bc->result];
+	}
+	const bytecode *code = (bc->code.empty()) ? 0 : &(bc->code[0]);
+	unsigned int numOfCodes = static_cast<unsigned int>(bc->code.size());
+	for (unsigned int i = 0; i < numOfCodes; i++) {
+		const bytecode &c = code[i];
+		double a = reg[c.src1], b = reg[c.src2];
+		switch (c.op) {
+		case BC_PLUS:
+			reg[c.dst] = a + b;
+			break;
+		case BC_MINUS:
+			reg[c.dst] = a - b;
+			break;
+		case BC_TIMES:
+			reg[c.dst] = a * b;
+			break;
+		case BC_DIVIDE:
+			reg[c.dst] = a / b;
+			break;
+		default:
+			reg[c.dst] = calcBytecodeOp(c.op, a, b);
+			break;
+		}
+	}
+	return reg[bc->result];
+}
+
+//stage m > 0 is evaluated at value + stageDt * delta[m - 1], where stageDt is the stage abscissa times the step size
+static inline double rkValue(const double *value, const double *d, int index, unsigned int m, double stageDt, int numOfVolIndexes)
+{
+	if (m == 0 || d == 0) return value[index];
+	return value[index] + stageDt * d[(m - 1) * numOfVolIndexes + index];
+}
+
+/*
+   exp, log and pow written with arithmetic and selects only, so that the
+   lane loops below are vectorized (libm calls are not)
+   results below DBL_MIN of exp are flushed to zero
+ */
+static inline double laneExp(double x)
+{
+	const double roundMagic = 6755399441055744.0;//1.5 * 2^52
+	const double ln2Hi = 6.93147180369123816490e-01, ln2Lo = 1.90821492927058770002e-10;
+	double xc = (x > 709.782712893384) ? 709.782712893384 : ((x < -708.0) ? -708.0 : x);
+	//xc = n * ln2 + r, |r| <= ln2 / 2
+	double t = xc * M_LOG2E + roundMagic;
+	double n = t - roundMagic;
+	double r = xc - n * ln2Hi - n * ln2Lo;
+	double p = 1.0 / 6227020800.0;
+	p = p * r + 1.0 / 479001600.0;
+	p = p * r + 1.0 / 39916800.0;
+	p = p * r + 1.0 / 3628800.0;
+	p = p * r + 1.0 / 362880.0;
+	p = p * r + 1.0 / 40320.0;
+	p = p * r + 1.0 / 5040.0;
+	p = p * r + 1.0 / 720.0;
+	p = p * r + 1.0 / 120.0;
+	p = p * r + 1.0 / 24.0;
+	p = p * r + 1.0 / 6.0;
+	p = p * r + 0.5;
+	p = p * r + 1.0;
+	p = p * r + 1.0;
+	//2^(n - 1) from the integer held in the low bits of t
+	long long bits, magicBits;
+	memcpy(&bits, &t, sizeof(double));
+	memcpy(&magicBits, &roundMagic, sizeof(double));
+	bits = (bits - magicBits + 1022) << 52;
+	double scale;
+	memcpy(&scale, &bits, sizeof(double));
+	double y = p * scale * 2.0;
+	y = (x > 709.782712893384) ? HUGE_VAL : y;
+	y = (x < -708.0) ? 0.0 : y;
+	return (x != x) ? x : y;
+}
+
+static inline double laneLog(double x)
+{
+	const double ln2Hi = 6.93147180369123816490e-01, ln2Lo = 1.90821492927058770002e-10;
+	const double two52 = 4503599627370496.0;
+	//subnormals are scaled into the normal range first
+	bool isSubnormal = (x < DBL_MIN);
+	double xs = isSubnormal ? x * 18014398509481984.0 : x;//2^54
+	unsigned long long bits, expBits;
+	memcpy(&bits, &xs, sizeof(double));
+	//x = 2^e * m, 1 <= m < 2
+	expBits = (bits >> 52) | 0x4330000000000000ULL;
+	double e;
+	memcpy(&e, &expBits, sizeof(double));
+	e = e - two52 - 1023.0 - (isSubnormal ? 54.0 : 0.0);
+	bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+	double m;
+	memcpy(&m, &bits, sizeof(double));
+	//sqrt(2) / 2 <= m < sqrt(2)
+	e = (m > M_SQRT2) ? e + 1.0 : e;
+	m = (m > M_SQRT2) ? m * 0.5 : m;
+	//log(m) = 2 * atanh(s), s = (m - 1) / (m + 1)
+	double f = m - 1.0;
+	double s = f / (2.0 + f);
+	double z = s * s;
+	double p = 1.0 / 23.0;
+	p = p * z + 1.0 / 21.0;
+	p = p * z + 1.0 / 19.0;
+	p = p * z + 1.0 / 17.0;
+	p = p * z + 1.0 / 15.0;
+	p = p * z + 1.0 / 13.0;
+	p = p * z + 1.0 / 11.0;
+	p = p * z + 1.0 / 9.0;
+	p = p * z + 1.0 / 7.0;
+	p = p * z + 1.0 / 5.0;
+	p = p * z + 1.0 / 3.0;
+	double y = e * ln2Hi + (f - s * (f - 2.0 * z * p) + e * ln2Lo);
+	y = (x == HUGE_VAL) ? x : y;
+	y = (x == 0.0) ? -HUGE_VAL : y;
+	y = (x < 0.0) ? numeric_limits<double>::quiet_NaN() : y;
+	return (x != x) ? x : y;
+}
+
+//x^n by repeated squaring, exact when the products are representable (3^2, 10^3) and within
+//about log2(|n|) ulp otherwise, so x^2 and hill coefficients agree with pow on the scalar path
+static inline double laneIntPower(double x, int n)
+{
+	double y = 1.0, p = x;
+	for (int k = (n < 0) ? -n : n; k > 0; k >>= 1) {
+		if (k & 1) y *= p;
+		p *= p;
+	}
+	return (n < 0) ? 1.0 / y : y;
+}
+
+//register r of lane l is reg[r * BC_LANES + l]
+void loadBytecodeLanes(bytecodeInfo *bc, vector<double> &reg)
+{
+	unsigned int i, l;
+	reg.resize(bc->numOfRegisters * BC_LANES);
+	for (i = 0; i < bc->constPool.size(); i++) {
+		for (l = 0; l < BC_LANES; l++) reg[i * BC_LANES + l] = bc->constPool[i];
+	}
+	for (i = 0; i < bc->paramList.size(); i++) {
+		for (l = 0; l < BC_LANES; l++) reg[(bc->paramBase + i) * BC_LANES + l] = *(bc->paramList[i]);
+	}
+}
+
+void executeBytecodeLanes(const bytecodeInfo *bc, double *reg)
+{
+	int l;
+	unsigned int numOfCodes = static_cast<unsigned int>(bc->code.size());
+	for (unsigned int i = 0; i < numOfCodes; i++) {
+		const bytecode &c = bc->code[i];
+		double *dst = reg + c.dst * BC_LANES;
+		const double *a = reg + c.src1 * BC_LANES, *b = reg + c.src2 * BC_LANES;
+		switch (c.op) {
+		case BC_PLUS:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = a[l] + b[l];
+			break;
+		case BC_MINUS:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = a[l] - b[l];
+			break;
+		case BC_TIMES:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = a[l] * b[l];
+			break;
+		case BC_DIVIDE:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = a[l] / b[l];
+			break;
+		case BC_EXP:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = laneExp(a[l]);
+			break;
+		case BC_LN:
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = laneLog(a[l]);
+			break;
+		case BC_POWER: {
+			//exp(b * log(a)) for a positive finite base, within 2 * (1 + |b * log(a)|) ulp of pow
+			//(19 ulp for a in [1e-3, 1e3] and |b| <= 4, ~500 ulp when a^b is near 1e+-300).
+			//small integer exponents are multiplied out and the other lanes use libm
+			double base[BC_LANES], exponent[BC_LANES];
+			for (l = 0; l < BC_LANES; l++) {
+				base[l] = a[l];
+				exponent[l] = b[l];
+			}
+#pragma omp simd
+			for (l = 0; l < BC_LANES; l++) dst[l] = laneExp(exponent[l] * laneLog(base[l]));
+			for (l = 0; l < BC_LANES; l++) {
+				if (fabs(exponent[l]) <= LANE_POW_INT && exponent[l] == floor(exponent[l])) {
+					dst[l] = laneIntPower(base[l], static_cast<int>(exponent[l]));
+					//1 / x^n overflowed or underflowed in the middle
+					if (exponent[l] < 0.0 && (dst[l] == 0.0 || fabs(dst[l]) == HUGE_VAL) && base[l] != 0.0) dst[l] = pow(base[l], exponent[l]);
+				} else if (!(base[l] > 0.0 && base[l] < HUGE_VAL && fabs(exponent[l]) < HUGE_VAL)) {
+					dst[l] = pow(base[l], exponent[l]);
 				}
 			}
+			break;
+		}
+		default:
+			for (l = 0; l < BC_LANES; l++) dst[l] = calcBytecodeOp(c.op, a[l], b[l]);
+			break;
 		}
-		value[index] = rpStack[--st_index];
 	}
 }
 
-void reversePolishRK(reactionInfo *rInfo, GeometryInfo *geoInfo, int Xindex, int Yindex, int Zindex, double dt, unsigned int m, unsigned int numOfReactants, bool isReaction)
+//scalar evaluation like the assignment rules, the lanes approximate exp, log and pow,
+//which could move points on the surface of an analytic volume. setNativeKernels runs after
+//the geometry and the initial values are set, so this is always the bytecode interpreter
+void reversePolishInitial(vector<unsigned int> &indexList, bytecodeInfo *bc, double *value, int Xindex, int Yindex, int Zindex, bool isAllArea)
 {
-	int i, j;
-	int st_index = 0, index = 0, numOfVolIndexes = Xindex * Yindex * Zindex;
-	double rpStack[stackMax] = {0};
-	double rk[4] = {0, 0.5, 0.5, 1.0};
-	double **variable = rInfo->rpInfo->varList;
-	double **constant = rInfo->rpInfo->constList;
-	double **d = rInfo->rpInfo->deltaList;
-	int *operation = rInfo->rpInfo->opfuncList;
-	int numOfASTNodes = rInfo->rpInfo->listNum;
-	for (j = 0; j < (int)geoInfo->domainIndex.size(); j++) {
-		index = geoInfo->domainIndex[j];
-		st_index = 0;
-		for (i = 0; i < numOfASTNodes; i++) {
-			if (variable[i] != 0) {//set variable into the stack
-				if (d != 0 && d[i] != 0) {
-					if (m == 0) rpStack[st_index] = variable[i][index];
-					else rpStack[st_index] = variable[i][index] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + index];
-				} else {
-					rpStack[st_index] = variable[i][index];
-				}
-				st_index++;
-			} else if (constant[i] != 0) {//set const into the stack
-				rpStack[st_index] = *(constant[i]);
-				st_index++;
-			} else {//operation
-				st_index--;
-				switch (operation[i]) {
-				case AST_PLUS:
-					rpStack[st_index - 1] += rpStack[st_index];
-					break;
-				case AST_MINUS:
-					rpStack[st_index - 1] -= rpStack[st_index];
-					break;
-				case AST_TIMES:
-					rpStack[st_index - 1] *= rpStack[st_index];
-					break;
-				case AST_DIVIDE:
-					rpStack[st_index - 1] /= rpStack[st_index];
-					break;
-				case AST_POWER:
-				case AST_FUNCTION_POWER:
-					rpStack[st_index - 1] = pow(rpStack[st_index - 1], rpStack[st_index]);
-					break;
-				case AST_FUNCTION_ABS:
-					rpStack[st_index] = fabs(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCOS:
-					rpStack[st_index] = acos(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCOSH:
-					rpStack[st_index] = acosh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCSC:
-					rpStack[st_index] = asin(1.0 / rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCCSCH:
-					break;
-				case AST_FUNCTION_ARCSEC:
-					break;
-				case AST_FUNCTION_ARCSECH:
-					break;
-				case AST_FUNCTION_ARCSIN:
-					rpStack[st_index] = asin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCSINH:
-					break;
-				case AST_FUNCTION_ARCTAN:
-					rpStack[st_index] = atan(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_ARCTANH:
-					break;
-				case AST_FUNCTION_CEILING:
-					break;
-				case AST_FUNCTION_COS:
-					rpStack[st_index] = cos(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_COSH:
-					rpStack[st_index] = cosh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_COT:
-					break;
-				case AST_FUNCTION_COTH:
-					break;
-				case AST_FUNCTION_CSC:
-					rpStack[st_index] = 1.0 / sin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_CSCH:
-					break;
-				case AST_FUNCTION_DELAY:
-					break;
-				case AST_FUNCTION_EXP:
-					rpStack[st_index] = exp(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_FACTORIAL:
-					break;
-				case AST_FUNCTION_FLOOR:
-					break;
-				case AST_FUNCTION_LN:
-					rpStack[st_index] = log(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_LOG:
-					rpStack[st_index - 1] = log(rpStack[st_index]) / log(rpStack[st_index - 1]);
-					break;
-				case AST_FUNCTION_PIECEWISE:
-					break;
-				case AST_FUNCTION_ROOT:
-					rpStack[st_index] = sqrt(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_SEC:
-					break;
-				case AST_FUNCTION_SECH:
-					break;
-				case AST_FUNCTION_SIN:
-					rpStack[st_index] = sin(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_SINH:
-					rpStack[st_index] = sinh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_TAN:
-					rpStack[st_index] = tan(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_FUNCTION_TANH:
-					rpStack[st_index] = tanh(rpStack[st_index]);
-					st_index++;
-					break;
-				case AST_LAMBDA:
-					break;
-				case AST_LOGICAL_AND:
-					rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index] == 1)) ? 1.0 : 0.0;
-					break;
-				case AST_LOGICAL_NOT:
-					rpStack[st_index] = (static_cast<int>(rpStack[st_index]) == 0) ? 1.0 : 0.0;
-					st_index++;
-					break;
-				case AST_LOGICAL_OR:
-					rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 || static_cast<int>(rpStack[st_index] == 1)) ? 1.0 : 0.0;
-					break;
-				case AST_LOGICAL_XOR:
-					rpStack[st_index - 1] = ((static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index] == 0))
-					                         || (static_cast<int>(rpStack[st_index - 1]) == 0 && static_cast<int>(rpStack[st_index] == 1))) ? 1.0 : 0.0;
-					break;
-				case AST_RATIONAL:
-					break;
-				case AST_RELATIONAL_EQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] == rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_GEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] >= rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_GT:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] > rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_LEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] <= rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_LT:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] < rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				case AST_RELATIONAL_NEQ:
-					rpStack[st_index - 1] = (rpStack[st_index - 1] != rpStack[st_index]) ? 1.0 : 0.0;
-					break;
-				default:
-					break;
-				}
-				//rp(rpStack, st_index, operation[i]);
+	int it_end = 0;
+	unsigned int numOfVars = static_cast<unsigned int>(bc->varList.size());
+	if (!isAllArea) it_end = static_cast<int>(indexList.size());
+	else it_end = Xindex * Yindex * Zindex;
+	//each point only writes value[index], so the points are split into static chunks with a register file per thread
+#pragma omp parallel if (it_end > INITIAL_PARALLEL)
+	{
+		unsigned int index = 0, v;
+		vector<double> reg;
+		loadBytecodeRegisters(bc, reg);
+#pragma omp for schedule(static)
+		for (int j = 0; j < it_end; j++) {
+			if (!isAllArea) index = indexList[j];
+			else index = j;
+			for (v = 0; v < numOfVars; v++) {
+				reg[bc->varBase + v] = bc->varList[v][index];
 			}
+			value[index] = executeBytecode(bc, &reg[0]);
 		}
-		st_index--;
-		if (isReaction) {//Reaction
-			for (unsigned int k = 0; k < numOfReactants; k++) {//reactants
-				if (rInfo->isVariable[k]) rInfo->spRefList[k]->delta[m * numOfVolIndexes + index] -= rInfo->srStoichiometry[k] * rpStack[st_index];
+	}
+}
+
+void reversePolishRK(reactionInfo *rInfo, GeometryInfo *geoInfo, int Xindex, int Yindex, int Zindex, double stageDt, unsigned int m, unsigned int numOfReactants, bool isReaction)
+{
+	int j, l, numOfLanes, numOfVolIndexes = Xindex * Yindex * Zindex;
+	int numOfDomainIndexes = static_cast<int>(geoInfo->domainIndex.size());
+	int laneIndex[BC_LANES];
+	unsigned int v, k;
+	bytecodeInfo *bc = rInfo->bcInfo;
+	unsigned int numOfVars = static_cast<unsigned int>(bc->varList.size());
+	double *result = 0;
+	vector<double> reg;
+	loadBytecodeLanes(bc, reg);
+	//points of domainIndex are evaluated BC_LANES at a time
+	for (j = 0; j < numOfDomainIndexes; j += BC_LANES) {
+		numOfLanes = min(BC_LANES, numOfDomainIndexes - j);
+		for (l = 0; l < BC_LANES; l++) {//unused lanes repeat the last point
+			laneIndex[l] = geoInfo->domainIndex[j + min(l, numOfLanes - 1)];
+		}
+		for (v = 0; v < numOfVars; v++) {
+			double *laneReg = &reg[(bc->varBase + v) * BC_LANES];
+			for (l = 0; l < BC_LANES; l++) {
+				laneReg[l] = rkValue(bc->varList[v], bc->deltaList[v], laneIndex[l], m, stageDt, numOfVolIndexes);
 			}
-			for (unsigned int k = numOfReactants; k < rInfo->spRefList.size(); k++) {//products
-				if (rInfo->isVariable[k]) rInfo->spRefList[k]->delta[m * numOfVolIndexes + index] += rInfo->srStoichiometry[k] * rpStack[st_index];
+		}
+		if (bc->nativeFunc != 0) bc->nativeFunc(&reg[0], BC_LANES);
+		else executeBytecodeLanes(bc, &reg[0]);
+		result = &reg[bc->result * BC_LANES];
+		for (l = 0; l < numOfLanes; l++) {
+			int index = laneIndex[l];
+			if (isReaction) {//Reaction
+				for (k = 0; k < numOfReactants; k++) {//reactants
+					if (rInfo->isVariable[k]) rInfo->spRefList[k]->delta[m * numOfVolIndexes + index] -= rInfo->srStoichiometry[k] * result[l];
+				}
+				for (k = numOfReactants; k < rInfo->spRefList.size(); k++) {//products
+					if (rInfo->isVariable[k]) rInfo->spRefList[k]->delta[m * numOfVolIndexes + index] += rInfo->srStoichiometry[k] * result[l];
+				}
+			} else if (rInfo->isVariable[0]) {//RateRule
+				rInfo->spRefList[0]->delta[m * numOfVolIndexes + index] += rInfo->srStoichiometry[0] * result[l];
 			}
-		} else if (rInfo->isVariable[0]) {//RateRule
-			rInfo->spRefList[0]->delta[m * numOfVolIndexes + index] += rInfo->srStoichiometry[0] * rpStack[st_index];
 		}
 	}
 }
 
-void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, double dt)
+void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, double stageDt)
 {
-	int X = 0, Y = 0, Z = 0, index = 0;
-	unsigned int j;
-	int Xplus2 = 0, Xminus2 = 0, Yplus2 = 0, Yminus2 = 0, Zplus2 = 0, Zminus2 = 0;
 	int numOfVolIndexes = Xindex * Yindex * Zindex;
-	int dcIndex = 0;
+	int numOfDomainIndexes = static_cast<int>(sInfo->geoi->domainIndex.size());
 	double* val = sInfo->value;
 	double* d = sInfo->delta;
-	double rk[4] = {0, 0.5, 0.5, 1.0};
 	GeometryInfo *geoInfo = sInfo->geoi;
+	int strideY = Xindex, strideZ = Xindex * Yindex;
 	//flux
 	//2d
 	//J = -D * dval / deltaX
@@ -410,17 +426,18 @@ void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double del
 	//x direction: d = (-J * deltaY * deltaZ) / (deltaY * deltaZ * deltaX) = -J / deltaX
 
 	// double Dx = deltaX, Dy = deltaY, Dz = deltaZ;
-	for (j = 0; j < geoInfo->domainIndex.size(); j++) {
-		index = geoInfo->domainIndex[j];
-		Z = index / (Xindex * Yindex);
-		Y = (index - Z * Xindex * Yindex) / Xindex;
-		X = index - Z * Xindex * Yindex - Y * Xindex;
-		Xplus2 = Z * Yindex * Xindex + Y * Xindex + (X + 2);
-		Xminus2 = Z * Yindex * Xindex + Y * Xindex + (X - 2);
-		Yplus2 = Z * Yindex * Xindex + (Y + 2) * Xindex + X;
-		Yminus2 = Z * Yindex * Xindex + (Y - 2) * Xindex + X;
-		Zplus2 = (Z + 2) * Yindex * Xindex + Y * Xindex + X;
-		Zminus2 = (Z - 2) * Yindex * Xindex + Y * Xindex + X;
+	//each point only writes its own delta[m * numOfVolIndexes + index], so domainIndex is split into static chunks among the threads
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfDomainIndexes; j++) {
+		int index = geoInfo->domainIndex[j];
+		//the neighbors beyond the boundary (bType) are never read
+		int Xplus2 = index + 2;
+		int Xminus2 = index - 2;
+		int Yplus2 = index + 2 * strideY;
+		int Yminus2 = index - 2 * strideY;
+		int Zplus2 = index + 2 * strideZ;
+		int Zminus2 = index - 2 * strideZ;
+		int dcIndex = 0;
 		if (sInfo->geoi->isDomain[index] == 1) {
 			if (m == 0) {
 				if (sInfo->diffCInfo[0] != 0) {//x-diffusion
@@ -456,14 +473,14 @@ void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double del
 					if (sInfo->geoi->bType[index].isBofXp == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[0]->value[dcIndex] *
-						           ((val[Xplus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Xplus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaX, 2);
+						           ((val[Xplus2] + stageDt * d[(m - 1) * numOfVolIndexes + Xplus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaX, 2);
 					}
 					if (sInfo->geoi->bType[index].isBofXm == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[0]->value[dcIndex] *
-						           ((val[Xminus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Xminus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaX, 2);
+						           ((val[Xminus2] + stageDt * d[(m - 1) * numOfVolIndexes + Xminus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaX, 2);
 					}
 				}
 				if (sInfo->diffCInfo[1] != 0) {//y-diffusion
@@ -471,14 +488,14 @@ void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double del
 					if (sInfo->geoi->bType[index].isBofYp == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[1]->value[dcIndex] *
-						           ((val[Yplus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Yplus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaY, 2);
+						           ((val[Yplus2] + stageDt * d[(m - 1) * numOfVolIndexes + Yplus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaY, 2);
 					}
 					if (sInfo->geoi->bType[index].isBofYm == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[1]->value[dcIndex] *
-						           ((val[Yminus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Yminus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaY, 2);
+						           ((val[Yminus2] + stageDt * d[(m - 1) * numOfVolIndexes + Yminus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaY, 2);
 					}
 				}
 				if (sInfo->diffCInfo[2] != 0) {//z-diffusion
@@ -486,14 +503,14 @@ void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double del
 					if (sInfo->geoi->bType[index].isBofZp == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[2]->value[dcIndex] *
-						           ((val[Zplus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Zplus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaZ, 2);
+						           ((val[Zplus2] + stageDt * d[(m - 1) * numOfVolIndexes + Zplus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaZ, 2);
 					}
 					if (sInfo->geoi->bType[index].isBofZm == false) {
 						sInfo->delta[m * numOfVolIndexes + index]
 						        += sInfo->diffCInfo[2]->value[dcIndex] *
-						           ((val[Zminus2] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + Zminus2])
-						            - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaZ, 2);
+						           ((val[Zminus2] + stageDt * d[(m - 1) * numOfVolIndexes + Zminus2])
+						            - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) / pow(deltaZ, 2);
 					}
 				}
 			}
@@ -512,6 +529,8 @@ void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, d
 	int Xplus2 = 0, Xminus2 = 0, Yplus2 = 0, Yminus2 = 0, Zplus2 = 0, Zminus2 = 0;
 	int Xplus3 = 0, Xminus3 = 0, Yplus3 = 0, Yminus3 = 0, Zplus3 = 0, Zminus3 = 0;
 	unsigned int i;
+	int strideY = Xindex, strideZ = Xindex * Yindex;
+	unsigned short mask = 0;
 	double *val = sInfo->value;
 	double *val_delta =  new double[Xindex * Yindex * Zindex];
 	fill_n(val_delta, Xindex * Yindex * Zindex, 0);
@@ -521,30 +540,28 @@ void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, d
 			index = sInfo->geoi->domainIndex[i];
 			g_in = 0.0;
 			g_out = 0.0;
-			Z = index / (Xindex * Yindex);
-			Y = (index - Z * Xindex * Yindex) / Xindex;
-			X = index - Z * Xindex * Yindex - Y * Xindex;
-			Xplus1 = Z * Xindex * Yindex + Y * Xindex + (X + 1);
-			Xplus2 = Z * Xindex * Yindex + Y * Xindex + (X + 2);
-			Xplus3 = Z * Xindex * Yindex + Y * Xindex + (X + 3);
-			Xminus1 = Z * Xindex * Yindex + Y * Xindex + (X - 1);
-			Xminus2 = Z * Xindex * Yindex + Y * Xindex + (X - 2);
-			Xminus3 = Z * Xindex * Yindex + Y * Xindex + (X - 3);
+			mask = sInfo->geoi->stencilMask[i];
+			Xplus1 = index + 1;
+			Xplus2 = index + 2;
+			Xplus3 = index + 3;
+			Xminus1 = index - 1;
+			Xminus2 = index - 2;
+			Xminus3 = index - 3;
 			type = sInfo->geoi->bType[index];
 			//x-direction
-			if (!(X + 4 < Xindex && sInfo->geoi->isDomain[Z * Xindex * Yindex + Y * Xindex + (X + 4)] == 1)) {
-				if (X + 2 < Xindex && sInfo->geoi->isDomain[Xplus2] == 1) Xplus3 = Xplus2;
+			if (!(mask & STENCIL_XP4)) {
+				if (mask & STENCIL_XP2) Xplus3 = Xplus2;
 				else Xplus3 = index;
 			}
-			if (!(X - 4 >= 0 && sInfo->geoi->isDomain[Z * Xindex * Yindex + Y * Xindex + (X - 4)] == 1)) {
-				if (X - 2 >= 0 && sInfo->geoi->isDomain[Xminus2] == 1) Xminus3 = Xminus2;
+			if (!(mask & STENCIL_XM4)) {
+				if (mask & STENCIL_XM2) Xminus3 = Xminus2;
 				else Xminus3 = index;
 			}
-			if (!(X + 2 < Xindex && sInfo->geoi->isDomain[Xplus2] == 1)) {
+			if (!(mask & STENCIL_XP2)) {
 				Xplus1 = index;
 				Xplus2 = index;
 			}
-			if (!(X - 2 >= 0 && sInfo->geoi->isDomain[Xminus2] == 1)) {
+			if (!(mask & STENCIL_XM2)) {
 				Xminus1 = index;
 				Xminus2 = index;
 			}
@@ -617,30 +634,28 @@ void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, d
 				index = sInfo->geoi->domainIndex[i];
 				g_in = 0.0;
 				g_out = 0.0;
-				Z = index / (Xindex * Yindex);
-				Y = (index - Z * Xindex * Yindex) / Xindex;
-				X = index - Z * Xindex * Yindex - Y * Xindex;
-				Yplus1 = Z * Xindex * Yindex + (Y + 1) * Xindex + X;
-				Yplus2 = Z * Xindex * Yindex + (Y + 2) * Xindex + X;
-				Yplus3 = Z * Xindex * Yindex + (Y + 3) * Xindex + X;
-				Yminus1 = Z * Xindex * Yindex + (Y - 1) * Xindex + X;
-				Yminus2 = Z * Xindex * Yindex + (Y - 2) * Xindex + X;
-				Yminus3 = Z * Xindex * Yindex + (Y - 3) * Xindex + X;
+				mask = sInfo->geoi->stencilMask[i];
+				Yplus1 = index + strideY;
+				Yplus2 = index + 2 * strideY;
+				Yplus3 = index + 3 * strideY;
+				Yminus1 = index - strideY;
+				Yminus2 = index - 2 * strideY;
+				Yminus3 = index - 3 * strideY;
 				type = sInfo->geoi->bType[index];
-				if (!(Y + 4 < Yindex && sInfo->geoi->isDomain[Z * Xindex * Yindex + (Y + 4) * Xindex + X] == 1)) {
-					if (Y + 2 < Yindex && sInfo->geoi->isDomain[Yplus2] == 1) Yplus3 = Yplus2;
+				if (!(mask & STENCIL_YP4)) {
+					if (mask & STENCIL_YP2) Yplus3 = Yplus2;
 					else Yplus3 = index;
 				}
-				if (!(Y - 4 >= 0 && sInfo->geoi->isDomain[Z * Xindex * Yindex + (Y - 4) * Xindex + X] == 1)) {
-					if (Y - 2 >= 0 && sInfo->geoi->isDomain[Yminus2] == 1) Yminus3 = Yminus2;
+				if (!(mask & STENCIL_YM4)) {
+					if (mask & STENCIL_YM2) Yminus3 = Yminus2;
 					else Yminus3 = index;
 				}
 
-				if (!(Y + 2 < Yindex && sInfo->geoi->isDomain[Yplus2] == 1)) {
+				if (!(mask & STENCIL_YP2)) {
 					Yplus1 = index;
 					Yplus2 = index;
 				}
-				if (!(Y - 2 >= 0 && sInfo->geoi->isDomain[Yminus2] == 1)) {
+				if (!(mask & STENCIL_YM2)) {
 					Yminus1 = index;
 					Yminus2 = index;
 				}
@@ -713,30 +728,28 @@ void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, d
 					index = sInfo->geoi->domainIndex[i];
 					g_in = 0.0;
 					g_out = 0.0;
-					Z = index / (Xindex * Yindex);
-					Y = (index - Z * Xindex * Yindex) / Xindex;
-					X = index - Z * Xindex * Yindex - Y * Xindex;
-					Zplus1 = (Z + 1) * Xindex * Yindex + Y * Xindex + X;
-					Zplus2 = (Z + 2) * Xindex * Yindex + Y * Xindex + X;
-					Zplus3 = (Z + 3)* Xindex * Yindex + Y * Xindex + X;
-					Zminus1 = (Z - 1) * Xindex * Yindex + Y * Xindex + X;
-					Zminus2 = (Z - 2) * Xindex * Yindex + Y * Xindex + X;
-					Zminus3 = (Z - 3) * Xindex * Yindex + Y * Xindex + X;
+					mask = sInfo->geoi->stencilMask[i];
+					Zplus1 = index + strideZ;
+					Zplus2 = index + 2 * strideZ;
+					Zplus3 = index + 3 * strideZ;
+					Zminus1 = index - strideZ;
+					Zminus2 = index - 2 * strideZ;
+					Zminus3 = index - 3 * strideZ;
 					type = sInfo->geoi->bType[index];
-					if (!(Z + 4 < Zindex && sInfo->geoi->isDomain[(Z + 4) * Xindex * Yindex + Y * Xindex + X] == 1)) {
-						if (Z + 2 < Zindex && sInfo->geoi->isDomain[Zplus2] == 1) Zplus3 = Zplus2;
+					if (!(mask & STENCIL_ZP4)) {
+						if (mask & STENCIL_ZP2) Zplus3 = Zplus2;
 						else Zplus3 = index;
 					}
-					if (!(Z - 4 >= 0 && sInfo->geoi->isDomain[(Z - 4) * Xindex * Yindex + Y * Xindex + X] == 1)) {
-						if (Z - 2 >= 0 && sInfo->geoi->isDomain[Zminus2] == 1) Zminus3 = Zminus2;
+					if (!(mask & STENCIL_ZM4)) {
+						if (mask & STENCIL_ZM2) Zminus3 = Zminus2;
 						else Zminus3 = index;
 					}
 
-					if (!(Z + 2 < Zindex && sInfo->geoi->isDomain[Zplus2] == 1)) {
+					if (!(mask & STENCIL_ZP2)) {
 						Zplus1 = index;
 						Zplus2 = index;
 					}
-					if (!(Z - 2 >= 0 && sInfo->geoi->isDomain[Zminus2] == 1)) {
+					if (!(mask & STENCIL_ZM2)) {
 						Zminus1 = index;
 						Zminus2 = index;
 					}
@@ -807,420 +820,205 @@ void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, d
 	delete[] val_delta;
 }
 
-void calcBoundary(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, unsigned int dimension)
+void calcBoundary(variableInfo *sInfo, const BoundaryKind_t *bcKind, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, unsigned int dimension)
 {
 	int Xp = 0, Xm = 0, Yp = 0, Ym = 0, Zp = 0, Zm = 0, X = 0, Y = 0, Z = 0;
 	int divIndexXp = 0, divIndexXm = 0, divIndexYp = 0,divIndexYm = 0, divIndexZp = 0, divIndexZm = 0;
 	int numOfVolIndexes = Xindex * Yindex * Zindex;
 	//      int Xdiv = (Xindex + 1) / 2, Ydiv = (Yindex + 1) / 2, Zdiv = (Zindex + 1) / 2;
-	BoundaryCondition *maxSideBC = 0, *minSideBC = 0;
 	//boundary flux
 	//2d
 	//x direction: d = (-J * deltaY) / (deltaY * (deltaX / 2.0)) = -2.0 * J / deltaX
 	//3d
 	//x direction: d = (-J * deltaY * deltaZ) / (deltaY * deltaZ * (deltaX / 2.0)) = -2.0 * J / deltaX
 	if (dimension >= 1) {
-		maxSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Xmax]->para->getPlugin("spatial"))->getBoundaryCondition();
-		minSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Xmin]->para->getPlugin("spatial"))->getBoundaryCondition();
 		//Xp, Xm
 		for (Z = 0; Z < Zindex; Z += 2) {
 			for (Y = 0; Y < Yindex; Y += 2) {
 				Xp = Z * Yindex * Xindex + Y * Xindex + (Xindex - 1);
 				Xm = Z * Yindex * Xindex + Y * Xindex;
-				if (!sInfo->boundaryInfo[Xmax]->isUniform) divIndexXp = Xp;
-				if (!sInfo->boundaryInfo[Xmin]->isUniform) divIndexXm = Xm;
+				if (bcKind[Xmax] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Xmax]->isUniform) divIndexXp = Xp;
+				if (bcKind[Xmin] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Xmin]->isUniform) divIndexXm = Xm;
 				if (sInfo->geoi->isDomain[Xp] == 1) {//Xp
-					if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Xp] += 2.0 * (-sInfo->boundaryInfo[Xmax]->value[divIndexXp]) / deltaX;
-					else if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Xp] = sInfo->boundaryInfo[Xmax]->value[divIndexXp];
+					if (bcKind[Xmax] == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Xp] += 2.0 * (-sInfo->boundaryInfo[Xmax]->value[divIndexXp]) / deltaX;
+					else if (bcKind[Xmax] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Xp] = sInfo->boundaryInfo[Xmax]->value[divIndexXp];
 				}
 				if (sInfo->geoi->isDomain[Xm] == 1) {//Xm
-					if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Xm] += -2.0 * (-sInfo->boundaryInfo[Xmin]->value[divIndexXm]) / deltaX;
-					else if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Xm] = sInfo->boundaryInfo[Xmin]->value[divIndexXm];
+					if (bcKind[Xmin] == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Xm] += -2.0 * (-sInfo->boundaryInfo[Xmin]->value[divIndexXm]) / deltaX;
+					else if (bcKind[Xmin] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Xm] = sInfo->boundaryInfo[Xmin]->value[divIndexXm];
 				}
 			}
 		}
 	}
 	//Yp, Ym
 	if (dimension >= 2) {
-		maxSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Ymax]->para->getPlugin("spatial"))->getBoundaryCondition();
-		minSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Ymin]->para->getPlugin("spatial"))->getBoundaryCondition();
 		for (Z = 0; Z < Zindex; Z += 2) {
 			for (X = 0; X < Xindex; X += 2) {
 				Yp = Z * Yindex * Xindex + (Yindex - 1) * Xindex + X;
 				Ym = Z * Yindex * Xindex + X;
-				if (!sInfo->boundaryInfo[Ymax]->isUniform) divIndexYp = Yp;
-				if (!sInfo->boundaryInfo[Ymin]->isUniform) divIndexYm = Ym;
+				if (bcKind[Ymax] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Ymax]->isUniform) divIndexYp = Yp;
+				if (bcKind[Ymin] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Ymin]->isUniform) divIndexYm = Ym;
 				if (sInfo->geoi->isDomain[Yp] == 1) {//Yp
-					if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN)     sInfo->delta[m * numOfVolIndexes + Yp] += 2.0 * (-sInfo->boundaryInfo[Ymax]->value[divIndexYp]) / deltaY;
-					else if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Yp] = sInfo->boundaryInfo[Ymax]->value[divIndexYp];
+					if (bcKind[Ymax] == SPATIAL_BOUNDARYKIND_NEUMANN)     sInfo->delta[m * numOfVolIndexes + Yp] += 2.0 * (-sInfo->boundaryInfo[Ymax]->value[divIndexYp]) / deltaY;
+					else if (bcKind[Ymax] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Yp] = sInfo->boundaryInfo[Ymax]->value[divIndexYp];
 				}
 				if (sInfo->geoi->isDomain[Ym] == 1) {//Ym
-					if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Ym] += -2.0 * (-sInfo->boundaryInfo[Ymin]->value[divIndexYm]) / deltaY;
-					else if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Ym] = sInfo->boundaryInfo[Ymin]->value[divIndexYm];
+					if (bcKind[Ymin] == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Ym] += -2.0 * (-sInfo->boundaryInfo[Ymin]->value[divIndexYm]) / deltaY;
+					else if (bcKind[Ymin] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Ym] = sInfo->boundaryInfo[Ymin]->value[divIndexYm];
 				}
 			}
 		}
 	}
 	//Zp, Zm
 	if (dimension >= 3) {
-		maxSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Zmax]->para->getPlugin("spatial"))->getBoundaryCondition();
-		minSideBC = static_cast<SpatialParameterPlugin*>(sInfo->boundaryInfo[Zmin]->para->getPlugin("spatial"))->getBoundaryCondition();
 		for (Y = 0; Y < Yindex; Y += 2) {
 			for (X = 0; X < Xindex; X += 2) {
 				Zp = (Zindex - 1) * Yindex * Xindex + Y * Xindex + X;
 				Zm = Y * Xindex + X;
-				if (!sInfo->boundaryInfo[Zmax]->isUniform) divIndexZp = Zp;
-				if (!sInfo->boundaryInfo[Zmin]->isUniform) divIndexZm = Zm;
+				if (bcKind[Zmax] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Zmax]->isUniform) divIndexZp = Zp;
+				if (bcKind[Zmin] != SPATIAL_BOUNDARYKIND_INVALID && !sInfo->boundaryInfo[Zmin]->isUniform) divIndexZm = Zm;
 				if (sInfo->geoi->isDomain[Zp] == 1) {//Zp
-					if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Zp] += 2.0 * (-sInfo->boundaryInfo[Zmax]->value[divIndexZp]) / deltaZ;
-					else if (maxSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Zp] = sInfo->boundaryInfo[Zmax]->value[divIndexZp];
+					if (bcKind[Zmax] == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Zp] += 2.0 * (-sInfo->boundaryInfo[Zmax]->value[divIndexZp]) / deltaZ;
+					else if (bcKind[Zmax] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Zp] = sInfo->boundaryInfo[Zmax]->value[divIndexZp];
 				}
 				if (sInfo->geoi->isDomain[Zm] == 1) {//Zm
-					if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Zm] += -2.0 * (-sInfo->boundaryInfo[Zmin]->value[divIndexZm]) / deltaZ;
-					else if (minSideBC->getType() == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Zm] = sInfo->boundaryInfo[Zmin]->value[divIndexZm];
+					if (bcKind[Zmin] == SPATIAL_BOUNDARYKIND_NEUMANN) sInfo->delta[m * numOfVolIndexes + Zm] += -2.0 * (-sInfo->boundaryInfo[Zmin]->value[divIndexZm]) / deltaZ;
+					else if (bcKind[Zmin] == SPATIAL_BOUNDARYKIND_DIRICHLET) sInfo->value[Zm] = sInfo->boundaryInfo[Zmin]->value[divIndexZm];
 				}
 			}
 		}
 	}
 }
 
-void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVector *nuVec, int Xindex, int Yindex, int Zindex, double dt, unsigned int m, double deltaX, double deltaY, double deltaZ, unsigned int dimension, unsigned int numOfReactants)
+void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVector *nuVec, int Xindex, int Yindex, int Zindex, double stageDt, unsigned int m, double deltaX, double deltaY, double deltaZ, unsigned int dimension, unsigned int numOfReactants)
 {
-	int X, Y, Z, i, k;
+	int k;
   unsigned int j;
-	int st_index = 0, index = 0, numOfVolIndexes = Xindex * Yindex * Zindex;
+	int index = 0, numOfVolIndexes = Xindex * Yindex * Zindex;
+	int strideY = Xindex, strideZ = Xindex * Yindex;
 	int Xplus1 = 0, Xminus1 = 0, Yplus1 = 0, Yminus1 = 0, Zplus1 = 0, Zminus1 = 0;
 	int Xplus3 = 0, Xminus3 = 0, Yplus3 = 0, Yminus3 = 0, Zplus3 = 0, Zminus3 = 0;
-	double rpStack[stackMax] = {0};
-	double rk[4] = {0, 0.5, 0.5, 1.0};
-	double **variable = rInfo->rpInfo->varList;
-	double **constant = rInfo->rpInfo->constList;
-	double **d = rInfo->rpInfo->deltaList;
-	int *operation = rInfo->rpInfo->opfuncList;
-	int numOfASTNodes = rInfo->rpInfo->listNum;
+	unsigned int v;
+	bytecodeInfo *bc = rInfo->bcInfo;
+	unsigned int numOfVars = static_cast<unsigned int>(bc->varList.size());
+	double result = 0;
+	vector<double> reg;
+	double *value = 0, *d = 0;
 	variableInfo *symbolInfo = 0;
+	loadBytecodeRegisters(bc, reg);
 	for (k = 0; k < (int)geoInfo->domainIndex.size(); k++) {
 		index = geoInfo->domainIndex[k];
-		Z = index / (Xindex * Yindex);
-		Y = (index - Z * Xindex * Yindex) / Xindex;
-		X = index - Z * Xindex * Yindex - Y * Xindex;
-		if ((dimension == 3 && (X * Y * Z == 0 || X == Xindex - 1 || Y == Yindex - 1 || Z == Zindex - 1))
-		    || (dimension == 2 && (X * Y == 0 || X == Xindex - 1 || Y == Yindex - 1))) {
-			continue;
-		}
-		st_index = 0;
-		Xplus3 = Z * Yindex * Xindex + Y * Xindex + (X + 3);
-		Xminus3 = Z * Yindex * Xindex + Y * Xindex + (X - 3);
-		Yplus3 = Z * Yindex * Xindex + (Y + 3) * Xindex + X;
-		Yminus3 = Z * Yindex * Xindex + (Y - 3) * Xindex + X;
-		Zplus3 = (Z + 3) * Yindex * Xindex + Y * Xindex + X;
-		Zminus3 = (Z - 3) * Yindex * Xindex + Y * Xindex + X;
-		Xplus1 = Z * Yindex * Xindex + Y * Xindex + (X + 1);
-		Xminus1 = Z * Yindex * Xindex + Y * Xindex + (X - 1);
-		Yplus1 = Z * Yindex * Xindex + (Y + 1) * Xindex + X;
-		Yminus1 = Z * Yindex * Xindex + (Y - 1) * Xindex + X;
-		Zplus1 = (Z + 1) * Yindex * Xindex + Y * Xindex + X;
-		Zminus1 = (Z - 1) * Yindex * Xindex + Y * Xindex + X;
+		//points on the outermost layer of the grid are skipped
+		if (!(geoInfo->stencilMask[k] & STENCIL_INTERIOR)) continue;
+		Xplus3 = index + 3;
+		Xminus3 = index - 3;
+		Yplus3 = index + 3 * strideY;
+		Yminus3 = index - 3 * strideY;
+		Zplus3 = index + 3 * strideZ;
+		Zminus3 = index - 3 * strideZ;
+		Xplus1 = index + 1;
+		Xminus1 = index - 1;
+		Yplus1 = index + strideY;
+		Yminus1 = index - strideY;
+		Zplus1 = index + strideZ;
+		Zminus1 = index - strideZ;
 		if (geoInfo->isDomain[index] == 1) {//not pseudo membrane // 基本的にこの条件分岐はいらない？
-			for (i = 0; i < numOfASTNodes; i++) {
-				if (variable[i] != 0) {//set variable into the stack
-					if (d != 0 && d[i] != 0) {
-						for (j = 0; j < rInfo->spRefList.size(); j++) {
-							//search compartment of equation's symbol
-							if (variable[i] == rInfo->spRefList[j]->value) {
-								symbolInfo = rInfo->spRefList[j];
-								break;
-							}
-						}
-						/*
-						   a volume symbol's value at membrane is calculated with linear approximation
-						   value = value(boundary) + (value(boundary) - value(boundary_next)) / 2
-						   = 1.5 * value(boundary) - 0.5 * value(boundary_next)
-						 */
-						if (symbolInfo->geoi->isVol) {//symbol is in volume
-							//x transport
-							if (static_cast<int>(symbolInfo->geoi->isDomain[Xplus1]) == 1) {//right of membrane
-								if (Xplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Xplus3] == 1) {
-									if (m == 0) rpStack[st_index] = 1.5 * variable[i][Xplus1] - 0.5 * variable[i][Xplus3];
-									else {
-										rpStack[st_index] = 1.5 * (variable[i][Xplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xplus1])
-										                    - 0.5 * (variable[i][Xplus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xplus3]);
-									}
-								} else {
-									if (m == 0) rpStack[st_index] = variable[i][Xplus1];
-									else rpStack[st_index] = variable[i][Xplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xplus1];
-								}
-							} else if (symbolInfo->geoi->isDomain[Xminus1] == 1) {//left of membrane
-								if (Xminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Xminus3] == 1) {
-									if (m == 0) rpStack[st_index] = 1.5 * variable[i][Xminus1] - 0.5 * variable[i][Xminus3];
-									else {
-										rpStack[st_index] = 1.5 * (variable[i][Xminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xminus1])
-										                    - 0.5 * (variable[i][Xminus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xminus3]);
-									}
-								} else {
-									if (m == 0) rpStack[st_index] = variable[i][Xminus1];
-									else rpStack[st_index] = variable[i][Xminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Xminus1];
-								}
-							}
-							//y transport
-							if (static_cast<int>(symbolInfo->geoi->isDomain[Yplus1]) == 1) {//upper of membrane
-								if (Yplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Yplus3] == 1) {
-									if (m == 0) rpStack[st_index] = 1.5 * variable[i][Yplus1] - 0.5 * variable[i][Yplus3];
-									else {
-										rpStack[st_index] = 1.5 * (variable[i][Yplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yplus1])
-										                    - 0.5 * (variable[i][Yplus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yplus3]);
-									}
-								} else {
-									if (m == 0) rpStack[st_index] = variable[i][Yplus1];
-									else rpStack[st_index] = variable[i][Yplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yplus1];
-								}
-							} else if (static_cast<int>(symbolInfo->geoi->isDomain[Yminus1]) == 1) {//downer of membrane
-								if (Yminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Yminus3] == 1) {
-									if (m == 0) {
-										rpStack[st_index] = 1.5 * variable[i][Yminus1] - 0.5 * variable[i][Yminus3];
-									} else {
-										rpStack[st_index] = 1.5 * (variable[i][Yminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yminus1])
-										                    - 0.5 * (variable[i][Yminus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yminus3]);
-									}
-								} else {
-									if (m == 0) rpStack[st_index] = variable[i][Yminus1];
-									else rpStack[st_index] = variable[i][Yminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Yminus1];
-								}
-							}
-							//z transport
-							if (dimension == 3) {
-								if (static_cast<int>(symbolInfo->geoi->isDomain[Zplus1]) == 1) {//higher of membrane
-									if (Zplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Zplus3] == 1) {
-										if (m == 0) rpStack[st_index] = 1.5 * variable[i][Zplus1] - 0.5 * variable[i][Zplus3];
-										else {
-											rpStack[st_index] = 1.5 * (variable[i][Zplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zplus1])
-											                    - 0.5 * (variable[i][Zplus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zplus3]);
-										}
-									} else {
-										if (m == 0) rpStack[st_index] = variable[i][Zplus1];
-										else rpStack[st_index] = variable[i][Zplus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zplus1];
-									}
-								} else if (static_cast<int>(symbolInfo->geoi->isDomain[Zminus1]) == 1) {//lowner of membrane
-									if (Zminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Zminus3] == 1) {
-										if (m == 0) rpStack[st_index] = 1.5 * variable[i][Zminus1] - 0.5 * variable[i][Zminus3];
-										else {
-											rpStack[st_index] = 1.5 * (variable[i][Zminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zminus1])
-											                    - 0.5 * (variable[i][Zminus3] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zminus3]);
-										}
-									} else {
-										if (m == 0) rpStack[st_index] = variable[i][Zminus1];
-										else rpStack[st_index] = variable[i][Zminus1] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + Zminus1];
-									}
-								}
-							}
-						} else {//symbol is in membrane
-							if (m == 0) rpStack[st_index] = variable[i][index];
-							else rpStack[st_index] = variable[i][index] + rk[m] * dt * d[i][(m - 1) * numOfVolIndexes + index];
-						}
+			for (v = 0; v < numOfVars; v++) {
+				value = bc->varList[v];
+				d = bc->deltaList[v];
+				symbolInfo = bc->varInfoList[v];
+				reg[bc->varBase + v] = rkValue(value, d, index, m, stageDt, numOfVolIndexes);
+				if (d == 0 || symbolInfo->geoi == 0 || !symbolInfo->geoi->isVol) continue;
+				/*
+				   a volume symbol's value at membrane is calculated with linear approximation
+				   value = value(boundary) + (value(boundary) - value(boundary_next)) / 2
+				   = 1.5 * value(boundary) - 0.5 * value(boundary_next)
+				 */
+				//x transport
+				if (static_cast<int>(symbolInfo->geoi->isDomain[Xplus1]) == 1) {//right of membrane
+					if (Xplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Xplus3] == 1) {
+						reg[bc->varBase + v] = 1.5 * rkValue(value, d, Xplus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Xplus3, m, stageDt, numOfVolIndexes);
+					} else {
+						reg[bc->varBase + v] = rkValue(value, d, Xplus1, m, stageDt, numOfVolIndexes);
+					}
+				} else if (symbolInfo->geoi->isDomain[Xminus1] == 1) {//left of membrane
+					if (Xminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Xminus3] == 1) {
+						reg[bc->varBase + v] = 1.5 * rkValue(value, d, Xminus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Xminus3, m, stageDt, numOfVolIndexes);
+					} else {
+						reg[bc->varBase + v] = rkValue(value, d, Xminus1, m, stageDt, numOfVolIndexes);
+					}
+				}
+				//y transport
+				if (static_cast<int>(symbolInfo->geoi->isDomain[Yplus1]) == 1) {//upper of membrane
+					if (Yplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Yplus3] == 1) {
+						reg[bc->varBase + v] = 1.5 * rkValue(value, d, Yplus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Yplus3, m, stageDt, numOfVolIndexes);
+					} else {
+						reg[bc->varBase + v] = rkValue(value, d, Yplus1, m, stageDt, numOfVolIndexes);
+					}
+				} else if (static_cast<int>(symbolInfo->geoi->isDomain[Yminus1]) == 1) {//downer of membrane
+					if (Yminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Yminus3] == 1) {
+						reg[bc->varBase + v] = 1.5 * rkValue(value, d, Yminus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Yminus3, m, stageDt, numOfVolIndexes);
 					} else {
-						rpStack[st_index] = variable[i][index];
+						reg[bc->varBase + v] = rkValue(value, d, Yminus1, m, stageDt, numOfVolIndexes);
 					}
-					st_index++;
-				} else if (constant[i] != 0) {//set const into the stack
-					rpStack[st_index] = *(constant[i]);
-					st_index++;
-				} else {//operation
-					st_index--;
-					switch (operation[i]) {
-					case AST_PLUS:
-						rpStack[st_index - 1] += rpStack[st_index];
-						break;
-					case AST_MINUS:
-						rpStack[st_index - 1] -= rpStack[st_index];
-						break;
-					case AST_TIMES:
-						rpStack[st_index - 1] *= rpStack[st_index];
-						break;
-					case AST_DIVIDE:
-						rpStack[st_index - 1] /= rpStack[st_index];
-						break;
-					case AST_POWER:
-					case AST_FUNCTION_POWER:
-						rpStack[st_index - 1] = pow(rpStack[st_index - 1], rpStack[st_index]);
-						break;
-					case AST_FUNCTION_ABS:
-						rpStack[st_index] = fabs(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCCOS:
-						rpStack[st_index] = acos(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCCOSH:
-						rpStack[st_index] = acosh(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCCSC:
-						rpStack[st_index] = asin(1.0 / rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCCSCH:
-						break;
-					case AST_FUNCTION_ARCSEC:
-						break;
-					case AST_FUNCTION_ARCSECH:
-						break;
-					case AST_FUNCTION_ARCSIN:
-						rpStack[st_index] = asin(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCSINH:
-						break;
-					case AST_FUNCTION_ARCTAN:
-						rpStack[st_index] = atan(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_ARCTANH:
-						break;
-					case AST_FUNCTION_CEILING:
-						break;
-					case AST_FUNCTION_COS:
-						rpStack[st_index] = cos(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_COSH:
-						rpStack[st_index] = cosh(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_COT:
-						break;
-					case AST_FUNCTION_COTH:
-						break;
-					case AST_FUNCTION_CSC:
-						rpStack[st_index] = 1.0 / sin(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_CSCH:
-						break;
-					case AST_FUNCTION_DELAY:
-						break;
-					case AST_FUNCTION_EXP:
-						rpStack[st_index] = exp(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_FACTORIAL:
-						break;
-					case AST_FUNCTION_FLOOR:
-						break;
-					case AST_FUNCTION_LN:
-						rpStack[st_index] = log(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_LOG:
-						rpStack[st_index - 1] = log(rpStack[st_index]) / log(rpStack[st_index - 1]);
-						break;
-					case AST_FUNCTION_PIECEWISE:
-						break;
-					case AST_FUNCTION_ROOT:
-						rpStack[st_index] = sqrt(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_SEC:
-						break;
-					case AST_FUNCTION_SECH:
-						break;
-					case AST_FUNCTION_SIN:
-						rpStack[st_index] = sin(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_SINH:
-						rpStack[st_index] = sinh(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_TAN:
-						rpStack[st_index] = tan(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_FUNCTION_TANH:
-						rpStack[st_index] = tanh(rpStack[st_index]);
-						st_index++;
-						break;
-					case AST_LAMBDA:
-						break;
-					case AST_LOGICAL_AND:
-						rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index] == 1)) ? 1.0 : 0.0;
-						break;
-					case AST_LOGICAL_NOT:
-						rpStack[st_index] = (static_cast<int>(rpStack[st_index]) == 0) ? 1.0 : 0.0;
-						st_index++;
-						break;
-					case AST_LOGICAL_OR:
-						rpStack[st_index - 1] = (static_cast<int>(rpStack[st_index - 1]) == 1 || static_cast<int>(rpStack[st_index] == 1)) ? 1.0 : 0.0;
-						break;
-					case AST_LOGICAL_XOR:
-						rpStack[st_index - 1] = ((static_cast<int>(rpStack[st_index - 1]) == 1 && static_cast<int>(rpStack[st_index] == 0))
-						                         || (static_cast<int>(rpStack[st_index - 1]) == 0 && static_cast<int>(rpStack[st_index] == 1))) ? 1.0 : 0.0;
-						break;
-					case AST_RATIONAL:
-						break;
-					case AST_RELATIONAL_EQ:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] == rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					case AST_RELATIONAL_GEQ:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] >= rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					case AST_RELATIONAL_GT:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] > rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					case AST_RELATIONAL_LEQ:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] <= rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					case AST_RELATIONAL_LT:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] < rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					case AST_RELATIONAL_NEQ:
-						rpStack[st_index - 1] = (rpStack[st_index - 1] != rpStack[st_index]) ? 1.0 : 0.0;
-						break;
-					default:
-						break;
+				}
+				//z transport
+				if (dimension == 3) {
+					if (static_cast<int>(symbolInfo->geoi->isDomain[Zplus1]) == 1) {//higher of membrane
+						if (Zplus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Zplus3] == 1) {
+							reg[bc->varBase + v] = 1.5 * rkValue(value, d, Zplus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Zplus3, m, stageDt, numOfVolIndexes);
+						} else {
+							reg[bc->varBase + v] = rkValue(value, d, Zplus1, m, stageDt, numOfVolIndexes);
+						}
+					} else if (static_cast<int>(symbolInfo->geoi->isDomain[Zminus1]) == 1) {//lowner of membrane
+						if (Zminus3 < numOfVolIndexes && symbolInfo->geoi->isDomain[Zminus3] == 1) {
+							reg[bc->varBase + v] = 1.5 * rkValue(value, d, Zminus1, m, stageDt, numOfVolIndexes) - 0.5 * rkValue(value, d, Zminus3, m, stageDt, numOfVolIndexes);
+						} else {
+							reg[bc->varBase + v] = rkValue(value, d, Zminus1, m, stageDt, numOfVolIndexes);
+						}
 					}
 				}
 			}
+			result = executeBytecode(bc, &reg[0]);
 			//area = dx * dy
 			//du / dt = -(Jx * dy) / area = -Jx / dx, du / dt = -Jy / dy
-			st_index--;
 			for (j = 0; j < numOfReactants; j++) {//reactants
 				if (rInfo->isVariable[j]) {
 					if (geoInfo->bType[index].isBofXp || geoInfo->bType[index].isBofXm) {//x transport or x binding
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Xplus1] == 1) {//right of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xplus1] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaX;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xplus1] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / deltaX;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Xminus1] == 1) {//left of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xminus1] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaX;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xminus1] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / deltaX;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaX / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / (deltaX / 2.0);
 						}
 					} else if (geoInfo->bType[index].isBofYp || geoInfo->bType[index].isBofYm) {//y transport or y binding
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Yplus1] == 1) {//upper of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yplus1] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaY;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yplus1] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / deltaY;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Yminus1] == 1) {//downer of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yminus1] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaY;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yminus1] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / deltaY;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaY / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / (deltaY / 2.0);
 						}
 					} else if (dimension == 3 && (geoInfo->bType[index].isBofZp || geoInfo->bType[index].isBofZm)) {//z transport
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Zplus1] == 1) {//higher of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zplus1] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaZ;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zplus1] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / deltaZ;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Zminus1] == 1) {//lower of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zminus1] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaZ;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zminus1] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / deltaZ;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaZ / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] -= fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / (deltaZ / 2.0);
 						}
 					}
 				}
@@ -1230,38 +1028,38 @@ void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVect
 					if (geoInfo->bType[index].isBofXp || geoInfo->bType[index].isBofXm) {//x transport or x binding
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Xplus1] == 1) {//right of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xplus1] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaX;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xplus1] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / deltaX;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Xminus1] == 1) {//left of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xminus1] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaX;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Xminus1] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / deltaX;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaX / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].nx) * rInfo->srStoichiometry[j] * result / (deltaX / 2.0);
 						}
 					} else if (geoInfo->bType[index].isBofYp || geoInfo->bType[index].isBofYm) {//y transport or y binding
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Yplus1] == 1) {//upper of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yplus1] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaY;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yplus1] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / deltaY;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Yminus1] == 1) {//downer of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yminus1] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaY;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Yminus1] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / deltaY;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaY / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].ny) * rInfo->srStoichiometry[j] * result / (deltaY / 2.0);
 						}
 					} else if (dimension == 3 && (geoInfo->bType[index].isBofZp || geoInfo->bType[index].isBofZm)) {//z transport
 						//transport
 						if (rInfo->spRefList[j]->geoi->isDomain[Zplus1] == 1) {//higher of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zplus1] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaZ;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zplus1] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / deltaZ;
 						}
 						if (rInfo->spRefList[j]->geoi->isDomain[Zminus1] == 1) {//lower of membrane
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zminus1] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / deltaZ;
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + Zminus1] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / deltaZ;
 						}
 						//binding
 						if (rInfo->spRefList[j]->geoi->isDomain[index] == 1) {
-							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * rpStack[st_index] / (deltaZ / 2.0);
+							rInfo->spRefList[j]->delta[m * numOfVolIndexes + index] += fabs(nuVec[index].nz) * rInfo->srStoichiometry[j] * result / (deltaZ / 2.0);
 						}
 					}
 				}
@@ -1270,7 +1068,7 @@ void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVect
 	}
 }
 
-void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yindex, int Zindex, unsigned int m, double dt, unsigned int dimension)
+void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yindex, int Zindex, unsigned int m, double stageDt, unsigned int dimension)
 {
 	int index = 0;
 	unsigned int i, j;
@@ -1278,7 +1076,6 @@ void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yi
 	int dcIndex = 0;
 	double* val = sInfo->value;
 	double* d = sInfo->delta;
-	double rk[4] = {0, 0.5, 0.5, 1.0};
 	GeometryInfo *geoInfo = sInfo->geoi;
 	double area = 0.0;
 	//flux
@@ -1330,8 +1127,8 @@ void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yi
           for (j = 0; j < 2; j++) {
             sInfo->delta[m * numOfVolIndexes + index]
               += sInfo->diffCInfo[0]->value[dcIndex] *
-              ((((val[vorI[index].adjacentIndexXY[j]] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexXY[j]])
-                 - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siXY[j]) / vorI[index].diXY[j]) / area;
+              ((((val[vorI[index].adjacentIndexXY[j]] + stageDt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexXY[j]])
+                 - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siXY[j]) / vorI[index].diXY[j]) / area;
           }
         }
         //yz plane (only 3D)
@@ -1339,8 +1136,8 @@ void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yi
           for (j = 0; j < 2; j++) {
             sInfo->delta[m * numOfVolIndexes + index]
               += sInfo->diffCInfo[0]->value[dcIndex] *
-              ((((val[vorI[index].adjacentIndexYZ[j]] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexYZ[j]])
-                 - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siYZ[j]) / vorI[index].diYZ[j]) / area;
+              ((((val[vorI[index].adjacentIndexYZ[j]] + stageDt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexYZ[j]])
+                 - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siYZ[j]) / vorI[index].diYZ[j]) / area;
           }
         }
         //xz plane (only 3D)
@@ -1348,11 +1145,52 @@ void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yi
           for (j = 0; j < 2; j++) {
             sInfo->delta[m * numOfVolIndexes + index]
               += sInfo->diffCInfo[0]->value[dcIndex] *
-              ((((val[vorI[index].adjacentIndexXZ[j]] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexXZ[j]])
-                 - (val[index] + rk[m] * dt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siXZ[j]) / vorI[index].diXZ[j]) / area;
+              ((((val[vorI[index].adjacentIndexXZ[j]] + stageDt * d[(m - 1) * numOfVolIndexes + vorI[index].adjacentIndexXZ[j]])
+                 - (val[index] + stageDt * d[(m - 1) * numOfVolIndexes + index])) * vorI[index].siXZ[j]) / vorI[index].diXZ[j]) / area;
           }
         }
       }
     }
   }
 }
+
+//multirate: the diffusion of a fast species is sub-cycled by numOfSteps rk4 steps of dt / numOfSteps,
+//the slow terms (reactions) accumulated in the delta slots over the macro step are spread evenly over the sub-steps
+void subcycleDiffusion(variableInfo *sInfo, const BoundaryKind_t *bcKind, voronoiInfo *vorI, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, double dt, unsigned int numOfSteps, unsigned int dimension)
+{
+	int numOfVolIndexes = Xindex * Yindex * Zindex;
+	int numOfDomainIndexes = static_cast<int>(sInfo->geoi->domainIndex.size());
+	double *d = sInfo->delta;
+	double h = dt / numOfSteps;
+	double rk[4] = {0.0, 0.5, 0.5, 1.0};
+	bool hasBoundary = (sInfo->boundaryInfo != 0 && sInfo->geoi->isVol);
+	vector<double> rate(numOfDomainIndexes);
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfDomainIndexes; j++) {
+		int index = sInfo->geoi->domainIndex[j];
+		rate[j] = (d[index] + 2.0 * d[numOfVolIndexes + index] + 2.0 * d[2 * numOfVolIndexes + index] + d[3 * numOfVolIndexes + index]) / 6.0;
+		for (int k = 0; k < 4; k++) d[k * numOfVolIndexes + index] = 0.0;
+	}
+	for (unsigned int s = 0; s < numOfSteps; s++) {
+		for (unsigned int m = 0; m < 4; m++) {
+#pragma omp parallel for schedule(static)
+			for (int j = 0; j < numOfDomainIndexes; j++) {
+				d[m * numOfVolIndexes + sInfo->geoi->domainIndex[j]] += rate[j];
+			}
+			if (sInfo->geoi->isVol) calcDiffusion(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, rk[m] * h);
+			else calcMemDiffusion(sInfo, vorI, Xindex, Yindex, Zindex, m, rk[m] * h, dimension);
+			if (hasBoundary) calcBoundary(sInfo, bcKind, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, dimension);
+		}
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < numOfDomainIndexes; j++) {
+			int index = sInfo->geoi->domainIndex[j];
+			sInfo->value[index] += h * (d[index] + 2.0 * d[numOfVolIndexes + index] + 2.0 * d[2 * numOfVolIndexes + index] + d[3 * numOfVolIndexes + index]) / 6.0;
+			for (int k = 0; k < 4; k++) d[k * numOfVolIndexes + index] = 0.0;
+		}
+	}
+	//dirichlet values are restored, the neumann flux is added by the next sub-cycle
+	if (hasBoundary) {
+		calcBoundary(sInfo, bcKind, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, 0, dimension);
+		fill_n(d, numOfVolIndexes, 0.0);
+	}
+}
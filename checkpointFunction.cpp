@@ -0,0 +1,109 @@
+#include "spatialsim/checkpointFunction.h"
+#include "spatialsim/mystruct.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <stdint.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define CHECKPOINT_MAGIC "SPSCKPT1"
+
+static volatile sig_atomic_t isTerminated = 0;
+
+static void handleTermination(int)
+{
+	isTerminated = 1;
+}
+
+//SIGTERM lets the running step finish, the time loop then writes a checkpoint and stops
+void setCheckpointSignal()
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handleTermination;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, 0);
+}
+
+bool isTerminationRequested()
+{
+	return isTerminated != 0;
+}
+
+static uint64_t getNumOfValues(variableInfo *info, unsigned int numOfVolIndexes)
+{
+	if (info->value == 0) return 0;
+	return (info->isUniform) ? 1 : numOfVolIndexes;
+}
+
+//written to a temporary file and renamed, so a kill while writing leaves the previous checkpoint
+void writeCheckpoint(std::string path, std::vector<variableInfo*> &varInfoList, unsigned int numOfVolIndexes, const checkpointState &state)
+{
+	stringstream tmpPath;
+	tmpPath << path << "." << getpid();
+	ofstream ofs(tmpPath.str().c_str(), ios::binary | ios::trunc);
+	uint32_t header[2] = {numOfVolIndexes, static_cast<uint32_t>(varInfoList.size())};
+	ofs.write(CHECKPOINT_MAGIC, 8);
+	ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+	ofs.write(reinterpret_cast<const char*>(&state), sizeof(checkpointState));
+	for (unsigned int i = 0; i < varInfoList.size(); i++) {
+		variableInfo *info = varInfoList[i];
+		uint32_t idLength = static_cast<uint32_t>(strlen(info->id));
+		uint64_t numOfValues = getNumOfValues(info, numOfVolIndexes);
+		uint64_t numOfDeltas = (info->delta != 0) ? 4 * static_cast<uint64_t>(numOfVolIndexes) : 0;
+		ofs.write(reinterpret_cast<const char*>(&idLength), sizeof(idLength));
+		ofs.write(info->id, idLength);
+		ofs.write(reinterpret_cast<const char*>(&numOfValues), sizeof(numOfValues));
+		if (numOfValues != 0) ofs.write(reinterpret_cast<const char*>(info->value), numOfValues * sizeof(double));
+		ofs.write(reinterpret_cast<const char*>(&numOfDeltas), sizeof(numOfDeltas));
+		if (numOfDeltas != 0) ofs.write(reinterpret_cast<const char*>(info->delta), numOfDeltas * sizeof(double));
+	}
+	ofs.close();
+	if (ofs.fail() || rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+		cerr << "warning: writing the checkpoint " << path << " failed" << endl;
+		remove(tmpPath.str().c_str());
+	}
+}
+
+static void readCheckpointError(std::string path, std::string reason)
+{
+	cerr << "error: cannot restart from " << path << ": " << reason << endl;
+	exit(1);
+}
+
+void readCheckpoint(std::string path, std::vector<variableInfo*> &varInfoList, unsigned int numOfVolIndexes, checkpointState &state)
+{
+	ifstream ifs(path.c_str(), ios::binary);
+	if (!ifs) readCheckpointError(path, "the file is not found");
+	char magic[8];
+	uint32_t header[2];
+	ifs.read(magic, 8);
+	ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!ifs || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0) readCheckpointError(path, "not a checkpoint");
+	if (header[0] != numOfVolIndexes || header[1] != varInfoList.size()) readCheckpointError(path, "the mesh or the model is different");
+	ifs.read(reinterpret_cast<char*>(&state), sizeof(checkpointState));
+	for (unsigned int i = 0; i < varInfoList.size(); i++) {
+		variableInfo *info = varInfoList[i];
+		uint32_t idLength = 0;
+		uint64_t numOfValues = 0, numOfDeltas = 0;
+		ifs.read(reinterpret_cast<char*>(&idLength), sizeof(idLength));
+		string id(idLength, '\0');
+		if (idLength != 0) ifs.read(&id[0], idLength);
+		if (!ifs || id != info->id) readCheckpointError(path, "the variables of the model are different");
+		ifs.read(reinterpret_cast<char*>(&numOfValues), sizeof(numOfValues));
+		if (numOfValues != getNumOfValues(info, numOfVolIndexes)) readCheckpointError(path, string("the size of ") + info->id + " is different");
+		if (numOfValues != 0) ifs.read(reinterpret_cast<char*>(info->value), numOfValues * sizeof(double));
+		ifs.read(reinterpret_cast<char*>(&numOfDeltas), sizeof(numOfDeltas));
+		if (numOfDeltas != ((info->delta != 0) ? 4 * static_cast<uint64_t>(numOfVolIndexes) : 0)) readCheckpointError(path, string("the size of ") + info->id + " is different");
+		if (numOfDeltas != 0) ifs.read(reinterpret_cast<char*>(info->delta), numOfDeltas * sizeof(double));
+	}
+	if (!ifs) readCheckpointError(path, "the file is truncated");
+}
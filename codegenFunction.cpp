@@ -0,0 +1,277 @@
+#include "spatialsim/codegenFunction.h"
+#include "spatialsim/mystruct.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+#define NATIVE_CFLAGS "-O2 -fno-trapping-math -shared -fPIC"
+
+static string nativeOperand(const bytecodeInfo *bc, unsigned int r)
+{
+	stringstream ss;
+	if (r < bc->paramBase) {//constant
+		double c = bc->constPool[r];
+		if (c != c) return "NAN";
+		if (c == HUGE_VAL) return "HUGE_VAL";
+		if (c == -HUGE_VAL) return "(-HUGE_VAL)";
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%a", c);
+		ss << "(" << buf << ")";
+	} else if (r < bc->varBase + bc->varList.size()) {//uniform value or variable
+		ss << "reg[" << r << " * numOfLanes + l]";
+	} else {//temporary
+		ss << "t" << r;
+	}
+	return ss.str();
+}
+
+//same semantics as calcBytecodeOp
+static string nativeExpression(int op, const string &a, const string &b)
+{
+	switch (op) {
+	case BC_PLUS: return a + " + " + b;
+	case BC_MINUS: return a + " - " + b;
+	case BC_TIMES: return a + " * " + b;
+	case BC_DIVIDE: return a + " / " + b;
+	case BC_POWER: return "pow(" + a + ", " + b + ")";
+	case BC_ROOT: return "(" + a + " == 2.0) ? sqrt(" + b + ") : pow(" + b + ", 1.0 / " + a + ")";
+	case BC_SQRT: return "sqrt(" + a + ")";
+	case BC_ABS: return "fabs(" + a + ")";
+	case BC_EXP: return "exp(" + a + ")";
+	case BC_LN: return "log(" + a + ")";
+	case BC_LOG10: return "log10(" + a + ")";
+	case BC_LOG: return "log(" + b + ") / log(" + a + ")";
+	case BC_CEILING: return "ceil(" + a + ")";
+	case BC_FLOOR: return "floor(" + a + ")";
+	case BC_FACTORIAL: return "tgamma(" + a + " + 1.0)";
+	case BC_SIN: return "sin(" + a + ")";
+	case BC_COS: return "cos(" + a + ")";
+	case BC_TAN: return "tan(" + a + ")";
+	case BC_SEC: return "1.0 / cos(" + a + ")";
+	case BC_CSC: return "1.0 / sin(" + a + ")";
+	case BC_COT: return "1.0 / tan(" + a + ")";
+	case BC_SINH: return "sinh(" + a + ")";
+	case BC_COSH: return "cosh(" + a + ")";
+	case BC_TANH: return "tanh(" + a + ")";
+	case BC_SECH: return "1.0 / cosh(" + a + ")";
+	case BC_CSCH: return "1.0 / sinh(" + a + ")";
+	case BC_COTH: return "1.0 / tanh(" + a + ")";
+	case BC_ARCSIN: return "asin(" + a + ")";
+	case BC_ARCCOS: return "acos(" + a + ")";
+	case BC_ARCTAN: return "atan(" + a + ")";
+	case BC_ARCSEC: return "acos(1.0 / " + a + ")";
+	case BC_ARCCSC: return "asin(1.0 / " + a + ")";
+	case BC_ARCCOT: return "atan(1.0 / " + a + ")";
+	case BC_ARCSINH: return "asinh(" + a + ")";
+	case BC_ARCCOSH: return "acosh(" + a + ")";
+	case BC_ARCTANH: return "atanh(" + a + ")";
+	case BC_ARCSECH: return "acosh(1.0 / " + a + ")";
+	case BC_ARCCSCH: return "asinh(1.0 / " + a + ")";
+	case BC_ARCCOTH: return "atanh(1.0 / " + a + ")";
+	case BC_AND: return "(IS_TRUE(" + a + ") && IS_TRUE(" + b + ")) ? 1.0 : 0.0";
+	case BC_OR: return "(IS_TRUE(" + a + ") || IS_TRUE(" + b + ")) ? 1.0 : 0.0";
+	case BC_XOR: return "((IS_TRUE(" + a + ") && IS_FALSE(" + b + ")) || (IS_FALSE(" + a + ") && IS_TRUE(" + b + "))) ? 1.0 : 0.0";
+	case BC_NOT: return "IS_FALSE(" + a + ") ? 1.0 : 0.0";
+	case BC_EQ: return "(" + a + " == " + b + ") ? 1.0 : 0.0";
+	case BC_GEQ: return "(" + a + " >= " + b + ") ? 1.0 : 0.0";
+	case BC_GT: return "(" + a + " > " + b + ") ? 1.0 : 0.0";
+	case BC_LEQ: return "(" + a + " <= " + b + ") ? 1.0 : 0.0";
+	case BC_LT: return "(" + a + " < " + b + ") ? 1.0 : 0.0";
+	case BC_NEQ: return "(" + a + " != " + b + ") ? 1.0 : 0.0";
+	default: return "0.0";
+	}
+}
+
+static void writeNativeKernel(stringstream &src, const bytecodeInfo *bc, unsigned int kernelNum)
+{
+	unsigned int r;
+	unsigned int tempBase = bc->varBase + static_cast<unsigned int>(bc->varList.size());
+	src << "extern \"C\" void spatialsim_kernel_" << kernelNum << "(double *reg, int numOfLanes)" << endl;
+	src << "{" << endl;
+	src << "\tfor (int l = 0; l < numOfLanes; l++) {" << endl;
+	if (bc->numOfRegisters > tempBase) {
+		src << "\t\tdouble";
+		for (r = tempBase; r < bc->numOfRegisters; r++) {
+			src << ((r == tempBase) ? " t" : ", t") << r;
+		}
+		src << ";" << endl;
+	}
+	for (unsigned int i = 0; i < bc->code.size(); i++) {
+		const bytecode &c = bc->code[i];
+		src << "\t\tt" << c.dst << " = " << nativeExpression(c.op, nativeOperand(bc, c.src1), nativeOperand(bc, c.src2)) << ";" << endl;
+	}
+	//a result held in a constant or input register is already in place
+	if (bc->result >= tempBase) {
+		src << "\t\treg[" << bc->result << " * numOfLanes + l] = t" << bc->result << ";" << endl;
+	}
+	src << "\t}" << endl;
+	src << "}" << endl << endl;
+}
+
+//FNV-1a
+unsigned long long hashString(const string &str)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < str.size(); i++) {
+		hash ^= static_cast<unsigned char>(str[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//creates the missing directories of the path with mkdir(2), new ones are private to the user
+static bool makeDirectories(const string &dir)
+{
+	for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+		string sub = dir.substr(0, pos);
+		if (!sub.empty() && mkdir(sub.c_str(), S_IRWXU) != 0 && errno != EEXIST) return false;
+		if (pos == string::npos) return true;
+	}
+}
+
+//the cache holds shared objects that are dlopen'ed and geometry that is trusted, so the directory
+//has to be a real directory of the user that nobody else can write to. the permissions of an
+//existing directory are left as they are ($SPATIALSIM_CACHE may point to a shared directory)
+static bool isPrivateDirectory(const string &dir)
+{
+	struct stat st;
+	if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid()) return false;
+	return (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool isPrivateFile(const string &path)
+{
+	struct stat st;
+	if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) return false;
+	return (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+string getCacheDir()
+{
+	string dir;
+	const char *cacheEnv = getenv("SPATIALSIM_CACHE");
+	const char *home = getenv("HOME");
+	if (cacheEnv != 0 && cacheEnv[0] != '\0') {
+		dir = cacheEnv;
+	} else if (home != 0 && home[0] != '\0') {
+		dir = string(home) + "/.cache/spatialsim";
+	} else {
+		stringstream ss;
+		ss << "/tmp/spatialsim-" << geteuid();
+		dir = ss.str();
+	}
+	if (!makeDirectories(dir) || !isPrivateDirectory(dir)) {
+		cerr << "warning: " << dir << " is not a private directory of the user, the cache is not used" << endl;
+		return string();
+	}
+	return dir;
+}
+
+//$CXX may hold a launcher such as "ccache g++", it is split at spaces and run without a shell
+static bool runCompiler(const string &cxx, const string &outPath, const string &srcPath)
+{
+	vector<string> argList;
+	stringstream ss(cxx + " " + NATIVE_CFLAGS);
+	string arg;
+	while (ss >> arg) argList.push_back(arg);
+	argList.push_back("-o");
+	argList.push_back(outPath);
+	argList.push_back(srcPath);
+	vector<char*> argv;
+	for (size_t i = 0; i < argList.size(); i++) argv.push_back(const_cast<char*>(argList[i].c_str()));
+	argv.push_back(0);
+	cout.flush();
+	pid_t pid = fork();
+	if (pid < 0) return false;
+	if (pid == 0) {
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return false;
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void* setNativeKernels(executionPlan *plan)
+{
+	unsigned int i;
+	vector<bytecodeInfo*> bcList;
+	for (i = 0; i < plan->reactionList.size(); i++) bcList.push_back(plan->reactionList[i].rInfo->bcInfo);
+	for (i = 0; i < plan->rateRuleList.size(); i++) bcList.push_back(plan->rateRuleList[i].rInfo->bcInfo);
+	for (i = 0; i < plan->assignmentList.size(); i++) bcList.push_back(plan->assignmentList[i].info->bcInfo);
+	if (bcList.empty()) return 0;
+
+	//generate source
+	const char *cxxEnv = getenv("CXX");
+	string cxx = (cxxEnv != 0 && cxxEnv[0] != '\0') ? string(cxxEnv) : string("c++");
+	stringstream src;
+	src << "// generated by spatialsimulator (" << cxx << " " << NATIVE_CFLAGS << ")" << endl;
+	src << "#include <cmath>" << endl;
+	src << "#define IS_TRUE(x) (static_cast<int>(x) == 1)" << endl;
+	src << "#define IS_FALSE(x) (static_cast<int>(x) == 0)" << endl << endl;
+	for (i = 0; i < bcList.size(); i++) writeNativeKernel(src, bcList[i], i);
+
+	//the shared object is cached by the hash of its source
+	char hashStr[17];
+	snprintf(hashStr, sizeof(hashStr), "%016llx", hashString(src.str()));
+	string cacheDir = getCacheDir();
+	if (cacheDir.empty()) {
+		cerr << "warning: native code generation needs the cache directory, using the bytecode interpreter" << endl;
+		return 0;
+	}
+	string base = cacheDir + "/spatialsim_" + hashStr;
+	string soPath = base + ".so";
+	void *handle = (isPrivateFile(soPath)) ? dlopen(soPath.c_str(), RTLD_NOW | RTLD_LOCAL) : 0;
+	if (handle == 0) {
+		cout << "compiling kinetic laws to native code: " << soPath << endl;
+		//build under a private name and publish with rename, so concurrent runs never load a partial file
+		stringstream tmpBase;
+		tmpBase << base << "." << getpid();
+		string tmpSrc = tmpBase.str() + ".cpp", tmpSo = tmpBase.str() + ".so";
+		ofstream ofs(tmpSrc.c_str());
+		ofs << src.str();
+		ofs.close();
+		if (!ofs.fail() && runCompiler(cxx, tmpSo, tmpSrc) && chmod(tmpSo.c_str(), S_IRWXU) == 0 && rename(tmpSo.c_str(), soPath.c_str()) == 0) {
+			handle = dlopen(soPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+		}
+		remove(tmpSrc.c_str());
+		if (handle == 0) {
+			cerr << "warning: native code generation failed, using the bytecode interpreter" << endl;
+			remove(tmpSo.c_str());
+			return 0;
+		}
+	} else {
+		cout << "using cached native code: " << soPath << endl;
+	}
+
+	//attach the kernels
+	vector<nativeKernel> kernelList(bcList.size(), static_cast<nativeKernel>(0));
+	for (i = 0; i < bcList.size(); i++) {
+		stringstream name;
+		name << "spatialsim_kernel_" << i;
+		kernelList[i] = reinterpret_cast<nativeKernel>(dlsym(handle, name.str().c_str()));
+		if (kernelList[i] == 0) {
+			cerr << "warning: " << name.str() << " is not found in " << soPath << ", using the bytecode interpreter" << endl;
+			dlclose(handle);
+			return 0;
+		}
+	}
+	for (i = 0; i < bcList.size(); i++) bcList[i]->nativeFunc = kernelList[i];
+	return handle;
+}
@@ -4,6 +4,7 @@
 #include "sbml/extension/SBMLExtensionRegistry.h"
 #include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
 #include <vector>
+#include <dlfcn.h>
 
 using namespace std;
 LIBSBML_CPP_NAMESPACE_USE
@@ -26,32 +27,10 @@ void freeVarInfo(vector<variableInfo*> &varInfoList)
 			info->adCInfo = 0;
 			delete[] info->boundaryInfo;
 			info->boundaryInfo = 0;
-			//rpinfo
-			if (info->rpInfo != 0) {
-				for(unsigned int j = 0; j < info->rpInfo->listNum; j++) {
-					if(info->rpInfo->constList[j] != 0) {
-						delete[] info->rpInfo->constList[j];
-						info->rpInfo->constList[j] = 0;
-//          } else if(info -> rpInfo -> deltaList[j] != 0) {
-//            delete[] info -> rpInfo -> deltaList[j];
-//            info -> rpInfo -> deltaList[j] = 0;
-					}
-				}
-				//varList
-				delete[] info->rpInfo->varList;
-				info->rpInfo->varList = 0;
-				//deltaList
-				delete[] info->rpInfo->deltaList;
-				info->rpInfo->deltaList = 0;
-				//constList
-				delete[] info->rpInfo->constList;
-				info->rpInfo->constList = 0;
-				//opfuncList
-				delete[] info->rpInfo->opfuncList;
-				info->rpInfo->opfuncList = 0;
-				//rpInfo
-				delete info->rpInfo;
-				info->rpInfo = 0;
+			//bcInfo
+			if (info->bcInfo != 0) {
+				delete info->bcInfo;
+				info->bcInfo = 0;
 			}
 			//info
 			delete info;
@@ -69,28 +48,9 @@ void freeAvolInfo(vector<GeometryInfo*> &geoInfoList)
 {
 	for (size_t i = 0; i < geoInfoList.size(); i++) {
 		GeometryInfo *geoInfo = geoInfoList[i];
-		if (geoInfo->rpInfo != 0) {
-			     for(unsigned int j = 0; j < geoInfo->rpInfo->listNum; j++){
-			       if(geoInfo -> rpInfo -> constList[j] != 0) {
-			         delete[] geoInfo -> rpInfo -> constList[j];
-			         geoInfo -> rpInfo -> constList[j] = 0;
-			       }
-			     }
-			//varList
-			delete[] geoInfo->rpInfo->varList;
-			geoInfo->rpInfo->varList = 0;
-			//deltaList
-			delete[] geoInfo->rpInfo->deltaList;
-			geoInfo->rpInfo->deltaList = 0;
-			//constList
-			delete[] geoInfo->rpInfo->constList;
-			geoInfo->rpInfo->constList = 0;
-			//opfuncList
-			delete[] geoInfo->rpInfo->opfuncList;
-			geoInfo->rpInfo->opfuncList = 0;
-			//rpInfo
-			delete geoInfo->rpInfo;
-			geoInfo->rpInfo = 0;
+		if (geoInfo->bcInfo != 0) {
+			delete geoInfo->bcInfo;
+			geoInfo->bcInfo = 0;
 		}
 		//isDomain
 		delete geoInfo->isDomain;
@@ -114,31 +74,32 @@ void freeRInfo(vector<reactionInfo*> &rInfoList)
 		//value
 		delete[] rInfo->value;
 		rInfo->value = 0;
-		if (rInfo->rpInfo != 0) {
-			//varList
-			delete[] rInfo->rpInfo->varList;
-			rInfo->rpInfo->varList = 0;
-			//deltaList
-			delete[] rInfo->rpInfo->deltaList;
-			rInfo->rpInfo->deltaList = 0;
-			//constList
-			for(unsigned int j = 0; j < rInfo->rpInfo->listNum; j++) {
-				if(rInfo->rpInfo->constList[j] != 0) {
-					delete[] rInfo->rpInfo->constList[j];
-					rInfo->rpInfo->constList[j] = 0;
-				}
-			}
-			delete[] rInfo->rpInfo->constList;
-			rInfo->rpInfo->constList = 0;
-			//opfuncList
-			delete[] rInfo->rpInfo->opfuncList;
-			rInfo->rpInfo->opfuncList = 0;
-			//rpInfo
-			delete rInfo->rpInfo;
-			rInfo->rpInfo = 0;
+		if (rInfo->bcInfo != 0) {
+			delete rInfo->bcInfo;
+			rInfo->bcInfo = 0;
 		}
 		//rInfo
 		delete rInfo;
 		rInfo = 0;
 	}
 }
+
+void freeExecutionPlan(executionPlan *plan)
+{
+	//the plan only refers to infos owned by the other lists, except for the implicit diffusion and the reaction systems
+	for (unsigned int i = 0; i < plan->speciesList.size(); i++) {
+		delete plan->speciesList[i].idInfo;
+	}
+	for (unsigned int i = 0; i < plan->systemList.size() + plan->fastSystemList.size(); i++) {
+		reactionSystemInfo *rsInfo = (i < plan->systemList.size()) ? plan->systemList[i] : plan->fastSystemList[i - plan->systemList.size()];
+		for (unsigned int j = 0; j < rsInfo->jacList.size(); j++) delete rsInfo->jacList[j];
+		delete rsInfo;
+	}
+	delete plan;
+	plan = 0;
+}
+
+void freeNativeKernels(void *handle)
+{
+	if (handle != 0) dlclose(handle);
+}
@@ -0,0 +1,232 @@
+#include "spatialsim/geometryCache.h"
+#include "spatialsim/codegenFunction.h"
+#include "spatialsim/mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include "sbml/packages/spatial/common/SpatialExtensionTypes.h"
+#include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+LIBSBML_CPP_NAMESPACE_USE
+
+struct _geometryCache {
+	string cacheDir;
+	string path;
+	unsigned int numOfVolIndexes;
+	ifstream ifs;//positioned after the header while isCached
+	uint64_t remaining;//bytes of ifs not read yet
+	bool isCached;
+	uint32_t numOfGeometries;
+	uint32_t hasNormal;
+};
+
+geometryCache* openGeometryCache(Model *model, int Xdiv, int Ydiv, int Zdiv, unsigned int numOfVolIndexes)
+{
+	SpatialModelPlugin *spPlugin = static_cast<SpatialModelPlugin*>(model->getPlugin("spatial"));
+	Geometry *geometry = spPlugin->getGeometry();
+	stringstream key;
+	char *geometryStr = geometry->toSBML();
+	key << geometryStr << endl;
+	free(geometryStr);
+	//the compartments mapped to the domain types decide the order of geoInfoList
+	ListOfCompartments *loc = model->getListOfCompartments();
+	for (unsigned int i = 0; i < loc->size(); i++) {
+		SpatialCompartmentPlugin *cPlugin = static_cast<SpatialCompartmentPlugin*>(loc->get(i)->getPlugin("spatial"));
+		key << loc->get(i)->getId() << " " << loc->get(i)->getSpatialDimensions();
+		if (cPlugin != 0 && cPlugin->isSetCompartmentMapping()) key << " " << cPlugin->getCompartmentMapping()->getDomainType();
+		key << endl;
+	}
+	key << Xdiv << " " << Ydiv << " " << Zdiv << endl;
+	char hashStr[17];
+	snprintf(hashStr, sizeof(hashStr), "%016llx", hashString(key.str()));
+
+	geometryCache *cache = new geometryCache;
+	cache->cacheDir = getCacheDir();
+	cache->numOfVolIndexes = numOfVolIndexes;
+	cache->isCached = false;
+	cache->numOfGeometries = 0;
+	cache->hasNormal = 0;
+	if (cache->cacheDir.empty()) {//the geometry is computed and not saved
+		delete cache;
+		return 0;
+	}
+	cache->path = cache->cacheDir + "/geometry_" + hashStr + ".bin";
+	cache->remaining = 0;
+	//only a file written by the user is trusted, like the shared objects of the native kernels
+	if (isPrivateFile(cache->path)) {
+		cache->ifs.open(cache->path.c_str(), ios::binary);
+	} else if (access(cache->path.c_str(), F_OK) == 0) {
+		cerr << "warning: ignoring the geometry cache " << cache->path << ", it is not a private file of the user" << endl;
+	}
+	if (cache->ifs.is_open()) {
+		char magic[8];
+		uint32_t header[3];
+		cache->ifs.seekg(0, ios::end);
+		cache->remaining = static_cast<uint64_t>(cache->ifs.tellg());
+		cache->ifs.seekg(0, ios::beg);
+		bool isHeader = (cache->remaining >= sizeof(magic) + sizeof(header));
+		if (isHeader) {
+			cache->ifs.read(magic, 8);
+			cache->ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+			cache->remaining -= sizeof(magic) + sizeof(header);
+		}
+		if (isHeader && cache->ifs && memcmp(magic, GEOMETRY_CACHE_MAGIC, 8) == 0 && header[0] == numOfVolIndexes) {
+			cache->isCached = true;
+			cache->numOfGeometries = header[1];
+			cache->hasNormal = header[2];
+			cout << "using cached geometry: " << cache->path << endl;
+		} else {
+			cerr << "warning: ignoring the geometry cache " << cache->path << ", it is rebuilt" << endl;
+			cache->ifs.close();
+		}
+	}
+	return cache;
+}
+
+bool isGeometryCached(geometryCache *cache)
+{
+	return cache != 0 && cache->isCached;
+}
+
+//the grid is not computed when the cache is used, so a broken file cannot fall back
+static void restoreError(geometryCache *cache, string reason)
+{
+	cerr << "error: the geometry cache " << cache->path << " is broken (" << reason << "), remove it and run again" << endl;
+	exit(1);
+}
+
+//every read is checked against the size of the file first, so a broken file never overruns the arrays
+static void readCache(geometryCache *cache, void *dst, uint64_t size)
+{
+	if (size > cache->remaining) restoreError(cache, "the file is truncated");
+	if (size != 0) cache->ifs.read(reinterpret_cast<char*>(dst), size);
+	if (!cache->ifs) restoreError(cache, "the file is truncated");
+	cache->remaining -= size;
+}
+
+static void writeIndexList(ofstream &ofs, const vector<unsigned int> &indexList)
+{
+	uint64_t size = indexList.size();
+	ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	if (size != 0) ofs.write(reinterpret_cast<const char*>(&indexList[0]), size * sizeof(unsigned int));
+}
+
+static void readIndexList(geometryCache *cache, vector<unsigned int> &indexList)
+{
+	uint64_t size = 0;
+	readCache(cache, &size, sizeof(size));
+	if (size > cache->numOfVolIndexes) restoreError(cache, "bad index list");
+	indexList.resize(size);
+	if (size != 0) readCache(cache, &indexList[0], size * sizeof(unsigned int));
+	for (uint64_t i = 0; i < size; i++) {
+		if (indexList[i] >= cache->numOfVolIndexes) restoreError(cache, "bad index list");
+	}
+}
+
+void restoreGeometry(geometryCache *cache, std::vector<GeometryInfo*> &geoInfoList)
+{
+	unsigned int numOfVolIndexes = cache->numOfVolIndexes;
+	if (cache->numOfGeometries != geoInfoList.size()) restoreError(cache, "the number of compartments is different");
+	for (unsigned int i = 0; i < geoInfoList.size(); i++) {
+		GeometryInfo *geoInfo = geoInfoList[i];
+		uint32_t idLength = 0;
+		uint8_t hasGrid = 0;
+		readCache(cache, &idLength, sizeof(idLength));
+		if (idLength != strlen(geoInfo->compartmentId)) restoreError(cache, "the compartments are different");
+		string id(idLength, '\0');
+		if (idLength != 0) readCache(cache, &id[0], idLength);
+		readCache(cache, &hasGrid, sizeof(hasGrid));
+		if (id != geoInfo->compartmentId) restoreError(cache, "the compartments are different");
+		if (hasGrid == 0) continue;
+		//the grid arrays have numOfVolIndexes elements each
+		if (cache->remaining < static_cast<uint64_t>(numOfVolIndexes) * (2 * sizeof(int) + sizeof(boundaryType))) restoreError(cache, "the file is truncated");
+		if (geoInfo->isDomain == 0) geoInfo->isDomain = new int[numOfVolIndexes];
+		if (geoInfo->isBoundary == 0) geoInfo->isBoundary = new int[numOfVolIndexes];
+		if (geoInfo->bType == 0) geoInfo->bType = new boundaryType[numOfVolIndexes];
+		readCache(cache, geoInfo->isDomain, static_cast<uint64_t>(numOfVolIndexes) * sizeof(int));
+		readCache(cache, geoInfo->isBoundary, static_cast<uint64_t>(numOfVolIndexes) * sizeof(int));
+		readCache(cache, geoInfo->bType, static_cast<uint64_t>(numOfVolIndexes) * sizeof(boundaryType));
+		readIndexList(cache, geoInfo->domainIndex);
+		readIndexList(cache, geoInfo->pseudoMemIndex);
+		readIndexList(cache, geoInfo->boundaryIndex);
+	}
+}
+
+static bool isAdjacentIndex(int index, unsigned int numOfVolIndexes)
+{
+	return index >= -1 && (index < 0 || static_cast<unsigned int>(index) < numOfVolIndexes);
+}
+
+void restoreNormalAndVoronoi(geometryCache *cache, normalUnitVector *&nuVec, voronoiInfo *&vorI)
+{
+	uint64_t numOfVolIndexes = cache->numOfVolIndexes;
+	if (cache->hasNormal == 0) restoreError(cache, "no normal unit vectors");
+	//nothing but the two arrays is left in the file
+	if (cache->remaining != numOfVolIndexes * (sizeof(normalUnitVector) + sizeof(voronoiInfo))) restoreError(cache, "the size of the file is different");
+	nuVec = new normalUnitVector[numOfVolIndexes];
+	vorI = new voronoiInfo[numOfVolIndexes];
+	readCache(cache, nuVec, numOfVolIndexes * sizeof(normalUnitVector));
+	readCache(cache, vorI, numOfVolIndexes * sizeof(voronoiInfo));
+	for (uint64_t i = 0; i < numOfVolIndexes; i++) {
+		for (int j = 0; j < 2; j++) {
+			if (!isAdjacentIndex(vorI[i].adjacentIndexXY[j], cache->numOfVolIndexes) || !isAdjacentIndex(vorI[i].adjacentIndexYZ[j], cache->numOfVolIndexes)
+			    || !isAdjacentIndex(vorI[i].adjacentIndexXZ[j], cache->numOfVolIndexes)) {
+				restoreError(cache, "bad voronoi info");
+			}
+		}
+	}
+}
+
+//written to a temporary file and renamed, so concurrent jobs never read a partial cache
+void saveGeometryCache(geometryCache *cache, std::vector<GeometryInfo*> &geoInfoList, normalUnitVector *nuVec, voronoiInfo *vorI)
+{
+	unsigned int numOfVolIndexes = cache->numOfVolIndexes;
+	//the private directory is made by getCacheDir
+	stringstream tmpPath;
+	tmpPath << cache->path << "." << getpid();
+	ofstream ofs(tmpPath.str().c_str(), ios::binary | ios::trunc);
+	uint32_t header[3] = {numOfVolIndexes, static_cast<uint32_t>(geoInfoList.size()), (nuVec != 0 && vorI != 0) ? 1u : 0u};
+	ofs.write(GEOMETRY_CACHE_MAGIC, 8);
+	ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+	for (unsigned int i = 0; i < geoInfoList.size(); i++) {
+		GeometryInfo *geoInfo = geoInfoList[i];
+		uint32_t idLength = static_cast<uint32_t>(strlen(geoInfo->compartmentId));
+		uint8_t hasGrid = (geoInfo->isDomain != 0 && geoInfo->isBoundary != 0 && geoInfo->bType != 0) ? 1 : 0;
+		ofs.write(reinterpret_cast<const char*>(&idLength), sizeof(idLength));
+		ofs.write(geoInfo->compartmentId, idLength);
+		ofs.write(reinterpret_cast<const char*>(&hasGrid), sizeof(hasGrid));
+		if (hasGrid == 0) continue;
+		ofs.write(reinterpret_cast<const char*>(geoInfo->isDomain), numOfVolIndexes * sizeof(int));
+		ofs.write(reinterpret_cast<const char*>(geoInfo->isBoundary), numOfVolIndexes * sizeof(int));
+		ofs.write(reinterpret_cast<const char*>(geoInfo->bType), numOfVolIndexes * sizeof(boundaryType));
+		writeIndexList(ofs, geoInfo->domainIndex);
+		writeIndexList(ofs, geoInfo->pseudoMemIndex);
+		writeIndexList(ofs, geoInfo->boundaryIndex);
+	}
+	if (header[2] != 0) {
+		ofs.write(reinterpret_cast<const char*>(nuVec), numOfVolIndexes * sizeof(normalUnitVector));
+		ofs.write(reinterpret_cast<const char*>(vorI), numOfVolIndexes * sizeof(voronoiInfo));
+	}
+	ofs.close();
+	if (ofs.fail() || chmod(tmpPath.str().c_str(), S_IRUSR | S_IWUSR) != 0 || rename(tmpPath.str().c_str(), cache->path.c_str()) != 0) {
+		cerr << "warning: writing the geometry cache " << cache->path << " failed" << endl;
+		remove(tmpPath.str().c_str());
+	} else {
+		cout << "geometry cached: " << cache->path << endl;
+	}
+}
+
+void closeGeometryCache(geometryCache *cache)
+{
+	delete cache;
+}
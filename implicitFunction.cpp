@@ -0,0 +1,335 @@
+#include "spatialsim/implicitFunction.h"
+#include "spatialsim/multigridFunction.h"
+#include "spatialsim/mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
+#include <vector>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+LIBSBML_CPP_NAMESPACE_USE
+
+static double diffusionCoefficient(const variableInfo *dcInfo, unsigned int index)
+{
+	return dcInfo->value[(dcInfo->isUniform) ? 0 : index];
+}
+
+//the stencil of calcDiffusion is symmetric for uniform D.
+//a point-wise D is symmetrized by scaling each row with 1 / D, which needs the same D in every direction.
+//the tridiagonal solves of adi do not need the symmetry.
+bool isImplicitDiffusionSupported(variableInfo *sInfo, int solver)
+{
+	unsigned int j, k;
+	if (sInfo->diffCInfo == 0 || !sInfo->geoi->isVol) return false;
+	variableInfo *refInfo = 0;
+	bool isUniform = true;
+	for (k = 0; k < 3; k++) {
+		if (sInfo->diffCInfo[k] == 0) continue;
+		if (refInfo == 0) refInfo = sInfo->diffCInfo[k];
+		if (!sInfo->diffCInfo[k]->isUniform) isUniform = false;
+	}
+	if (refInfo == 0) return false;
+	if (isUniform || solver == DIFFUSION_ADI) return true;
+	GeometryInfo *geoInfo = sInfo->geoi;
+	for (j = 0; j < geoInfo->domainIndex.size(); j++) {
+		unsigned int index = geoInfo->domainIndex[j];
+		if (geoInfo->isDomain[index] != 1) continue;
+		double D = diffusionCoefficient(refInfo, index);
+		if (!(D > 0.0)) return false;
+		for (k = 0; k < 3; k++) {
+			if (sInfo->diffCInfo[k] != 0 && fabs(diffusionCoefficient(sInfo->diffCInfo[k], index) - D) > 1.0e-12 * D) return false;
+		}
+	}
+	return true;
+}
+
+implicitDiffusionInfo* setImplicitDiffusionInfo(variableInfo *sInfo, const BoundaryKind_t *bcKind, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int dimension, int solver)
+{
+	unsigned int j, k;
+	int numOfVolIndexes = Xindex * Yindex * Zindex;
+	GeometryInfo *geoInfo = sInfo->geoi;
+	implicitDiffusionInfo *idInfo = new implicitDiffusionInfo;
+	idInfo->sInfo = sInfo;
+	idInfo->solver = solver;
+	idInfo->deltaX = deltaX;
+	idInfo->deltaY = deltaY;
+	idInfo->deltaZ = deltaZ;
+	idInfo->tolerance = 1.0e-10;
+	idInfo->isScaled = false;
+	for (k = 0; k < 3; k++) {
+		if (solver != DIFFUSION_ADI && sInfo->diffCInfo[k] != 0 && !sInfo->diffCInfo[k]->isUniform) idInfo->isScaled = true;
+	}
+	//unknowns are the domain points of calcDiffusion
+	vector<int> unknownIndex(numOfVolIndexes, -1);
+	for (j = 0; j < geoInfo->domainIndex.size(); j++) {
+		unsigned int index = geoInfo->domainIndex[j];
+		if (geoInfo->isDomain[index] == 1) {
+			unknownIndex[index] = static_cast<int>(idInfo->pointList.size());
+			idInfo->pointList.push_back(index);
+		}
+	}
+	unsigned int numOfUnknowns = static_cast<unsigned int>(idInfo->pointList.size());
+	idInfo->maxIter = numOfUnknowns + 100;
+	idInfo->neighbor.assign(6 * numOfUnknowns, -1);
+	idInfo->isFixed.assign(numOfUnknowns, 0);
+	idInfo->scale.assign(numOfUnknowns, 1.0);
+	idInfo->weight.assign(3 * numOfUnknowns, 0.0);
+	idInfo->diag.assign(numOfUnknowns, 1.0);
+	idInfo->u.assign(numOfUnknowns, 0.0);
+	idInfo->x.assign(numOfUnknowns, 0.0);
+	idInfo->r.assign(numOfUnknowns, 0.0);
+	idInfo->z.assign(numOfUnknowns, 0.0);
+	idInfo->p.assign(numOfUnknowns, 0.0);
+	idInfo->q.assign(numOfUnknowns, 0.0);
+	for (j = 0; j < numOfUnknowns; j++) {
+		int index = idInfo->pointList[j];
+		int Z = index / (Xindex * Yindex);
+		int Y = (index - Z * Xindex * Yindex) / Xindex;
+		int X = index - Z * Xindex * Yindex - Y * Xindex;
+		int *nbr = &(idInfo->neighbor[6 * j]);
+		boundaryType &bType = geoInfo->bType[index];
+		if (sInfo->diffCInfo[0] != 0) {//x-diffusion
+			if (bType.isBofXp == false) nbr[0] = unknownIndex[index + 2];
+			if (bType.isBofXm == false) nbr[1] = unknownIndex[index - 2];
+		}
+		if (sInfo->diffCInfo[1] != 0) {//y-diffusion
+			if (bType.isBofYp == false) nbr[2] = unknownIndex[index + 2 * Xindex];
+			if (bType.isBofYm == false) nbr[3] = unknownIndex[index - 2 * Xindex];
+		}
+		if (sInfo->diffCInfo[2] != 0) {//z-diffusion
+			if (bType.isBofZp == false) nbr[4] = unknownIndex[index + 2 * Xindex * Yindex];
+			if (bType.isBofZm == false) nbr[5] = unknownIndex[index - 2 * Xindex * Yindex];
+		}
+		//dirichlet points keep the value set by calcBoundary
+		if (dimension >= 1) {
+			if ((X == Xindex - 1 && bcKind[Xmax] == SPATIAL_BOUNDARYKIND_DIRICHLET) || (X == 0 && bcKind[Xmin] == SPATIAL_BOUNDARYKIND_DIRICHLET)) idInfo->isFixed[j] = 1;
+		}
+		if (dimension >= 2) {
+			if ((Y == Yindex - 1 && bcKind[Ymax] == SPATIAL_BOUNDARYKIND_DIRICHLET) || (Y == 0 && bcKind[Ymin] == SPATIAL_BOUNDARYKIND_DIRICHLET)) idInfo->isFixed[j] = 1;
+		}
+		if (dimension >= 3) {
+			if ((Z == Zindex - 1 && bcKind[Zmax] == SPATIAL_BOUNDARYKIND_DIRICHLET) || (Z == 0 && bcKind[Zmin] == SPATIAL_BOUNDARYKIND_DIRICHLET)) idInfo->isFixed[j] = 1;
+		}
+	}
+	//a face is kept only when both sides see each other, so the operator stays symmetric and every line has one start
+	for (j = 0; j < numOfUnknowns; j++) {
+		for (k = 0; k < 6; k++) {
+			int n = idInfo->neighbor[6 * j + k];
+			if (n >= 0 && idInfo->neighbor[6 * n + (k ^ 1)] != static_cast<int>(j)) idInfo->neighbor[6 * j + k] = -1;
+		}
+	}
+	//lines start at the unknowns without a minus neighbor
+	for (k = 0; k < 3; k++) {
+		if (sInfo->diffCInfo[k] == 0) continue;
+		for (j = 0; j < numOfUnknowns; j++) {
+			if (idInfo->neighbor[6 * j + 2 * k + 1] < 0) idInfo->lineList[k].push_back(j);
+		}
+	}
+	if (solver == DIFFUSION_MG) setMultigridLevels(idInfo, Xindex, Yindex);
+	return idInfo;
+}
+
+//diffusion coefficients may be changed by rules, so the weights are refreshed every step
+static void updateImplicitCoefficients(implicitDiffusionInfo *idInfo, double h)
+{
+	variableInfo **diffCInfo = idInfo->sInfo->diffCInfo;
+	double delta2[3] = {idInfo->deltaX * idInfo->deltaX, idInfo->deltaY * idInfo->deltaY, idInfo->deltaZ * idInfo->deltaZ};
+	int numOfUnknowns = static_cast<int>(idInfo->pointList.size());
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		unsigned int index = idInfo->pointList[j];
+		double s = 1.0;
+		for (int k = 0; k < 3; k++) {
+			if (idInfo->isScaled && diffCInfo[k] != 0) {
+				s = 1.0 / diffusionCoefficient(diffCInfo[k], index);
+				break;
+			}
+		}
+		double diag = s;
+		for (int k = 0; k < 3; k++) {
+			double w = (diffCInfo[k] != 0) ? s * diffusionCoefficient(diffCInfo[k], index) / delta2[k] : 0.0;
+			idInfo->weight[3 * j + k] = w;
+			if (idInfo->neighbor[6 * j + 2 * k] >= 0) diag += h * w;
+			if (idInfo->neighbor[6 * j + 2 * k + 1] >= 0) diag += h * w;
+		}
+		idInfo->scale[j] = s;
+		idInfo->diag[j] = (idInfo->isFixed[j]) ? 1.0 : diag;
+	}
+}
+
+//q = (S - h * L) p on the free points, returns p.q
+static double applyImplicitOperator(implicitDiffusionInfo *idInfo, const double *p, double *q, double h)
+{
+	int numOfUnknowns = static_cast<int>(idInfo->pointList.size());
+	double pq = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:pq)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		if (idInfo->isFixed[j]) {
+			q[j] = 0.0;
+			continue;
+		}
+		const int *nbr = &(idInfo->neighbor[6 * j]);
+		const double *w = &(idInfo->weight[3 * j]);
+		double sum = 0.0;
+		for (int k = 0; k < 6; k++) {
+			if (nbr[k] >= 0) sum += w[k / 2] * p[nbr[k]];
+		}
+		q[j] = idInfo->diag[j] * p[j] - h * sum;
+		pq += p[j] * q[j];
+	}
+	return pq;
+}
+
+//crank-nicolson step of the calcDiffusion stencil:
+//(S - dt/2 * S L) u = (S + dt/2 * S L) u*, solved for the correction x = u - u* by jacobi or multigrid preconditioned CG
+static void solveCrankNicolson(implicitDiffusionInfo *idInfo, double dt)
+{
+	double h = dt / 2.0;
+	double *val = idInfo->sInfo->value;
+	int numOfUnknowns = static_cast<int>(idInfo->pointList.size());
+	double *u = &(idInfo->u[0]), *x = &(idInfo->x[0]), *r = &(idInfo->r[0]), *z = &(idInfo->z[0]), *p = &(idInfo->p[0]), *q = &(idInfo->q[0]);
+	//r = b - A u* = dt * S L u*
+	double bb = 0.0, rr = 0.0, rz = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:bb, rr, rz)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		x[j] = 0.0;
+		if (idInfo->isFixed[j]) {
+			r[j] = z[j] = 0.0;
+			continue;
+		}
+		const int *nbr = &(idInfo->neighbor[6 * j]);
+		const double *w = &(idInfo->weight[3 * j]);
+		double lu = 0.0;
+		for (int k = 0; k < 6; k++) {
+			if (nbr[k] >= 0) lu += w[k / 2] * (u[nbr[k]] - u[j]);
+		}
+		double b = idInfo->scale[j] * u[j] + h * lu;
+		r[j] = dt * lu;
+		z[j] = r[j] / idInfo->diag[j];
+		bb += b * b;
+		rr += r[j] * r[j];
+		rz += r[j] * z[j];
+	}
+	if (!idInfo->mgLevelList.empty()) rz = applyMultigrid(idInfo, r, z);
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) p[j] = z[j];
+	double threshold = idInfo->tolerance * idInfo->tolerance * bb;
+	unsigned int iter;
+	for (iter = 0; iter < idInfo->maxIter && rr > threshold; iter++) {
+		double alpha = rz / applyImplicitOperator(idInfo, p, q, h);
+		double rzNew = 0.0;
+		rr = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:rr, rzNew)
+		for (int j = 0; j < numOfUnknowns; j++) {
+			x[j] += alpha * p[j];
+			r[j] -= alpha * q[j];
+			z[j] = r[j] / idInfo->diag[j];
+			rr += r[j] * r[j];
+			rzNew += r[j] * z[j];
+		}
+		if (!idInfo->mgLevelList.empty()) rzNew = applyMultigrid(idInfo, r, z);
+		double beta = rzNew / rz;
+		rz = rzNew;
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < numOfUnknowns; j++) p[j] = z[j] + beta * p[j];
+	}
+	if (rr > threshold) {
+		cerr << "warning: CG of " << idInfo->sInfo->id << " did not converge in " << iter << " iterations (residual " << sqrt(rr / bb) << ")" << endl;
+	}
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		if (!idInfo->isFixed[j]) val[idInfo->pointList[j]] = u[j] + x[j];
+	}
+}
+
+//L_k u at unknown j
+static double lineOperator(const implicitDiffusionInfo *idInfo, const double *u, int j, int k)
+{
+	const int *nbr = &(idInfo->neighbor[6 * j + 2 * k]);
+	double lu = 0.0;
+	if (nbr[0] >= 0) lu += u[nbr[0]] - u[j];
+	if (nbr[1] >= 0) lu += u[nbr[1]] - u[j];
+	return idInfo->weight[3 * j + k] * lu;
+}
+
+//(I - h * L_k) x = rhs along every k line by the thomas algorithm, rhs is given in x and c' is kept in z
+static void solveLines(implicitDiffusionInfo *idInfo, double *x, double *z, int k, double h)
+{
+	int numOfLines = static_cast<int>(idInfo->lineList[k].size());
+	//lines differ in length on masked domains
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int l = 0; l < numOfLines; l++) {
+		int j = idInfo->lineList[k][l], prev = -1, last = -1;
+		while (j >= 0) {
+			const int *nbr = &(idInfo->neighbor[6 * j + 2 * k]);
+			double a = 0.0, b = 1.0, c = 0.0;
+			if (!idInfo->isFixed[j]) {
+				double hw = h * idInfo->weight[3 * j + k];
+				if (nbr[1] >= 0) {
+					a = -hw;
+					b += hw;
+				}
+				if (nbr[0] >= 0) {
+					c = -hw;
+					b += hw;
+				}
+			}
+			double denom = (prev >= 0) ? b - a * z[prev] : b;
+			z[j] = c / denom;
+			x[j] = (prev >= 0) ? (x[j] - a * x[prev]) / denom : x[j] / denom;
+			prev = last = j;
+			j = nbr[0];
+		}
+		for (j = idInfo->neighbor[6 * last + 2 * k + 1]; j >= 0; j = idInfo->neighbor[6 * j + 2 * k + 1]) {
+			x[j] -= z[j] * x[idInfo->neighbor[6 * j + 2 * k]];
+		}
+	}
+}
+
+//douglas ADI step (theta = 1/2) of the calcDiffusion stencil:
+//(I - h Lx) v1 = (I + h Lx + 2h Ly + 2h Lz) u*
+//(I - h Ly) v2 = v1 - h Ly u*
+//(I - h Lz) u  = v2 - h Lz u*
+static void solveADI(implicitDiffusionInfo *idInfo, double dt)
+{
+	double h = dt / 2.0;
+	double *val = idInfo->sInfo->value;
+	int numOfUnknowns = static_cast<int>(idInfo->pointList.size());
+	double *u = &(idInfo->u[0]), *x = &(idInfo->x[0]), *r = &(idInfo->r[0]), *z = &(idInfo->z[0]), *p = &(idInfo->p[0]);
+	//r = Ly u*, p = Lz u*
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		r[j] = lineOperator(idInfo, u, j, 1);
+		p[j] = lineOperator(idInfo, u, j, 2);
+		x[j] = (idInfo->isFixed[j]) ? u[j] : u[j] + h * lineOperator(idInfo, u, j, 0) + 2.0 * h * (r[j] + p[j]);
+	}
+	for (int k = 0; k < 3; k++) {
+		if (k > 0) {
+			const double *lu = (k == 1) ? r : p;
+#pragma omp parallel for schedule(static)
+			for (int j = 0; j < numOfUnknowns; j++) {
+				if (!idInfo->isFixed[j]) x[j] -= h * lu[j];
+			}
+		}
+		if (idInfo->sInfo->diffCInfo[k] != 0) solveLines(idInfo, x, z, k, h);
+	}
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) {
+		if (!idInfo->isFixed[j]) val[idInfo->pointList[j]] = x[j];
+	}
+}
+
+void calcImplicitDiffusion(implicitDiffusionInfo *idInfo, double dt)
+{
+	double *val = idInfo->sInfo->value;
+	int numOfUnknowns = static_cast<int>(idInfo->pointList.size());
+	if (numOfUnknowns == 0) return;
+	updateImplicitCoefficients(idInfo, dt / 2.0);
+	if (!idInfo->mgLevelList.empty()) updateMultigridOperator(idInfo, dt / 2.0);
+	double *u = &(idInfo->u[0]);
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < numOfUnknowns; j++) u[j] = val[idInfo->pointList[j]];
+	if (idInfo->solver == DIFFUSION_ADI) solveADI(idInfo, dt);
+	else solveCrankNicolson(idInfo, dt);
+}
@@ -15,7 +15,7 @@ void InitializeVarInfo(variableInfo *varInfo)
 	varInfo->isUniform = false;
 	varInfo->hasAssignmentRule = false;
 	//varInfo->next = 0;
-	varInfo->rpInfo = 0;
+	varInfo->bcInfo = 0;
 	varInfo->value = 0;
 	varInfo->diffCInfo = 0;
 	varInfo->adCInfo = 0;
@@ -38,7 +38,7 @@ void InitializeAVolInfo(GeometryInfo *geoInfo)
 	geoInfo->isDomain = 0;
 	geoInfo->isBoundary = 0;
 	geoInfo->bType = 0;
-	geoInfo->rpInfo = 0;
+	geoInfo->bcInfo = 0;
 }
 
 void InitializeVoronoiInfo(voronoiInfo *vorI, int numOfVolIndexes)
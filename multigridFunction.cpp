@@ -0,0 +1,220 @@
+#include "spatialsim/multigridFunction.h"
+#include "spatialsim/mystruct.h"
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#define MG_SMOOTH 2//red-black sweeps before and after the coarse correction
+#define MG_COARSE_SWEEPS 16
+#define MG_COARSEST 512//unknowns of the coarsest level
+#define MG_MAX_LEVELS 16
+#define MG_PARALLEL 4096//smaller levels are not worth a parallel region
+
+static void resizeMultigridLevel(multigridLevel &lv)
+{
+	unsigned int i, n = static_cast<unsigned int>(lv.coord.size() / 3);
+	lv.diag.assign(n, 1.0);
+	lv.offDiag.assign(6 * n, 0.0);
+	lv.x.assign(n, 0.0);
+	lv.b.assign(n, 0.0);
+	lv.r.assign(n, 0.0);
+	for (i = 0; i < n; i++) {
+		lv.colorList[(lv.coord[3 * i] + lv.coord[3 * i + 1] + lv.coord[3 * i + 2]) % 2].push_back(i);
+	}
+}
+
+//2x2x2 cells of the fine level are aggregated into one coarse cell, dirichlet points are left out
+static void coarsenMultigridLevel(multigridLevel &fine, multigridLevel &coarse, const vector<char> *isFixed)
+{
+	unsigned int i, k;
+	unsigned int n = static_cast<unsigned int>(fine.diag.size());
+	int ext[3] = {1, 1, 1};
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < 3; k++) ext[k] = max(ext[k], fine.coord[3 * i + k] / 2 + 1);
+	}
+	vector<int> cellIndex(static_cast<size_t>(ext[0]) * ext[1] * ext[2], -1);
+	fine.parent.assign(n, -1);
+	for (i = 0; i < n; i++) {
+		if (isFixed != 0 && (*isFixed)[i]) continue;
+		int cx = fine.coord[3 * i], cy = fine.coord[3 * i + 1], cz = fine.coord[3 * i + 2];
+		size_t cell = (static_cast<size_t>(cz / 2) * ext[1] + cy / 2) * ext[0] + cx / 2;
+		if (cellIndex[cell] < 0) {
+			cellIndex[cell] = static_cast<int>(coarse.coord.size() / 3);
+			coarse.coord.push_back(cx / 2);
+			coarse.coord.push_back(cy / 2);
+			coarse.coord.push_back(cz / 2);
+			coarse.child.insert(coarse.child.end(), 8, -1);
+		}
+		fine.parent[i] = cellIndex[cell];
+		coarse.child[8 * cellIndex[cell] + (cx % 2) + 2 * (cy % 2) + 4 * (cz % 2)] = i;
+	}
+	unsigned int m = static_cast<unsigned int>(coarse.coord.size() / 3);
+	coarse.neighbor.assign(6 * m, -1);
+	for (i = 0; i < n; i++) {
+		int I = fine.parent[i];
+		if (I < 0) continue;
+		for (k = 0; k < 6; k++) {
+			int j = fine.neighbor[6 * i + k];
+			if (j < 0 || fine.parent[j] < 0 || fine.parent[j] == I) continue;
+			coarse.neighbor[6 * I + k] = fine.parent[j];
+		}
+	}
+	resizeMultigridLevel(coarse);
+}
+
+void setMultigridLevels(implicitDiffusionInfo *idInfo, int Xindex, int Yindex)
+{
+	unsigned int j;
+	vector<multigridLevel> &levelList = idInfo->mgLevelList;
+	levelList.clear();
+	levelList.push_back(multigridLevel());
+	multigridLevel &top = levelList[0];
+	//the finest level is the grid of calcDiffusion
+	for (j = 0; j < idInfo->pointList.size(); j++) {
+		int index = idInfo->pointList[j];
+		int Z = index / (Xindex * Yindex);
+		int Y = (index - Z * Xindex * Yindex) / Xindex;
+		int X = index - Z * Xindex * Yindex - Y * Xindex;
+		top.coord.push_back(X / 2);
+		top.coord.push_back(Y / 2);
+		top.coord.push_back(Z / 2);
+	}
+	top.neighbor = idInfo->neighbor;
+	resizeMultigridLevel(top);
+	while (levelList.back().diag.size() > MG_COARSEST && levelList.size() < MG_MAX_LEVELS) {
+		multigridLevel coarse;
+		coarsenMultigridLevel(levelList.back(), coarse, (levelList.size() == 1) ? &(idInfo->isFixed) : 0);
+		if (coarse.diag.empty() || coarse.diag.size() == levelList.back().diag.size()) {
+			levelList.back().parent.clear();
+			break;
+		}
+		levelList.push_back(coarse);
+	}
+}
+
+//A_coarse = P^T A P with the piecewise constant prolongation P
+void updateMultigridOperator(implicitDiffusionInfo *idInfo, double h)
+{
+	vector<multigridLevel> &levelList = idInfo->mgLevelList;
+	multigridLevel &top = levelList[0];
+	int n = static_cast<int>(top.diag.size());
+	//same operator as applyImplicitOperator, the columns of dirichlet points are dropped
+#pragma omp parallel for schedule(static)
+	for (int j = 0; j < n; j++) {
+		top.diag[j] = idInfo->diag[j];
+		for (int k = 0; k < 6; k++) {
+			int nbr = top.neighbor[6 * j + k];
+			top.offDiag[6 * j + k] = (nbr >= 0 && !idInfo->isFixed[j] && !idInfo->isFixed[nbr]) ? h * idInfo->weight[3 * j + k / 2] : 0.0;
+		}
+	}
+	for (unsigned int l = 1; l < levelList.size(); l++) {
+		multigridLevel &fine = levelList[l - 1];
+		multigridLevel &coarse = levelList[l];
+		int m = static_cast<int>(coarse.diag.size());
+#pragma omp parallel for schedule(static)
+		for (int I = 0; I < m; I++) {
+			double diag = 0.0;
+			double *off = &(coarse.offDiag[6 * I]);
+			fill_n(off, 6, 0.0);
+			for (int c = 0; c < 8; c++) {
+				int i = coarse.child[8 * I + c];
+				if (i < 0) continue;
+				diag += fine.diag[i];
+				for (int k = 0; k < 6; k++) {
+					int j = fine.neighbor[6 * i + k];
+					if (j < 0 || fine.parent[j] < 0) continue;
+					if (fine.parent[j] == I) diag -= fine.offDiag[6 * i + k];
+					else off[k] += fine.offDiag[6 * i + k];
+				}
+			}
+			coarse.diag[I] = diag;
+		}
+	}
+}
+
+static void smoothMultigridLevel(multigridLevel &lv, int color)
+{
+	int num = static_cast<int>(lv.colorList[color].size());
+#pragma omp parallel for schedule(static) if (num > MG_PARALLEL)
+	for (int l = 0; l < num; l++) {
+		int i = lv.colorList[color][l];
+		double sum = lv.b[i];
+		for (int k = 0; k < 6; k++) {
+			int j = lv.neighbor[6 * i + k];
+			if (j >= 0) sum += lv.offDiag[6 * i + k] * lv.x[j];
+		}
+		lv.x[i] = sum / lv.diag[i];
+	}
+}
+
+//the post-smoother runs the colors in reverse, so the V-cycle is a symmetric preconditioner
+static void vcycle(vector<multigridLevel> &levelList, unsigned int l)
+{
+	int s;
+	multigridLevel &lv = levelList[l];
+	int n = static_cast<int>(lv.diag.size());
+	fill(lv.x.begin(), lv.x.end(), 0.0);
+	if (l + 1 == levelList.size()) {
+		for (s = 0; s < MG_COARSE_SWEEPS; s++) {
+			smoothMultigridLevel(lv, 0);
+			smoothMultigridLevel(lv, 1);
+		}
+		for (s = 0; s < MG_COARSE_SWEEPS; s++) {
+			smoothMultigridLevel(lv, 1);
+			smoothMultigridLevel(lv, 0);
+		}
+		return;
+	}
+	for (s = 0; s < MG_SMOOTH; s++) {
+		smoothMultigridLevel(lv, 0);
+		smoothMultigridLevel(lv, 1);
+	}
+	multigridLevel &coarse = levelList[l + 1];
+	int m = static_cast<int>(coarse.diag.size());
+#pragma omp parallel for schedule(static) if (n > MG_PARALLEL)
+	for (int i = 0; i < n; i++) {
+		double sum = lv.b[i] - lv.diag[i] * lv.x[i];
+		for (int k = 0; k < 6; k++) {
+			int j = lv.neighbor[6 * i + k];
+			if (j >= 0) sum += lv.offDiag[6 * i + k] * lv.x[j];
+		}
+		lv.r[i] = sum;
+	}
+	//restriction R = P^T
+#pragma omp parallel for schedule(static) if (m > MG_PARALLEL)
+	for (int I = 0; I < m; I++) {
+		double sum = 0.0;
+		for (int c = 0; c < 8; c++) {
+			int i = coarse.child[8 * I + c];
+			if (i >= 0) sum += lv.r[i];
+		}
+		coarse.b[I] = sum;
+	}
+	vcycle(levelList, l + 1);
+#pragma omp parallel for schedule(static) if (n > MG_PARALLEL)
+	for (int i = 0; i < n; i++) {
+		if (lv.parent[i] >= 0) lv.x[i] += coarse.x[lv.parent[i]];
+	}
+	for (s = 0; s < MG_SMOOTH; s++) {
+		smoothMultigridLevel(lv, 1);
+		smoothMultigridLevel(lv, 0);
+	}
+}
+
+//z = M^-1 r by one V-cycle, returns r.z
+double applyMultigrid(implicitDiffusionInfo *idInfo, const double *r, double *z)
+{
+	vector<multigridLevel> &levelList = idInfo->mgLevelList;
+	multigridLevel &top = levelList[0];
+	int n = static_cast<int>(top.diag.size());
+	copy(r, r + n, top.b.begin());
+	vcycle(levelList, 0);
+	double rz = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:rz)
+	for (int j = 0; j < n; j++) {
+		z[j] = top.x[j];
+		rz += r[j] * z[j];
+	}
+	return rz;
+}
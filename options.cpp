@@ -4,6 +4,7 @@
 #include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
 #include <float.h>
 #include <getopt.h>
+#include <stdio.h>
 #include <string.h>
 #include <iostream>
 
@@ -28,6 +29,28 @@ void printErrorMessage(char *str)
   cout << "                 [default:Max value of InitialConcentration or InitialAmount]" << endl;
   cout << " -s char#(int) : {x,y,z} and the number of slice (only 3D) (ex. -s z10)" << endl;
 //cout << " -p            : create simulation image" << endl;
+  cout << " -j #(int)     : the number of threads for diffusion and initial values (ex. -j 4 [default:1])" << endl;
+  cout << " -g            : compile kinetic laws and rules to native code" << endl;
+  cout << "                 (cached in $SPATIALSIM_CACHE [default:~/.cache/spatialsim])" << endl;
+  cout << " -M solver     : diffusion solver {explicit,cn,adi,mg} (ex. -M cn [default:explicit])" << endl;
+  cout << "                 cn: Crank-Nicolson solved by conjugate gradient, dt is not limited by the mesh" << endl;
+  cout << "                 adi: alternating direction implicit (tridiagonal solves along x, y and z lines)" << endl;
+  cout << "                 mg: Crank-Nicolson solved by multigrid preconditioned conjugate gradient" << endl;
+  cout << " -A #(double)  : adaptive time step with the error tolerance # (ex. -A 1e-4)" << endl;
+  cout << "                 -d gives the initial step and -o the output interval (# * dt)" << endl;
+  cout << " -S a,d,r      : strang splitting with a, d and r sub-steps of advection, diffusion and reaction" << endl;
+  cout << "                 (ex. -S 1,4,1), cannot be combined with -A" << endl;
+  cout << " -m            : multirate, species with fast diffusion or advection sub-cycle with their own step" << endl;
+  cout << "                 instead of limiting dt (cannot be combined with -A)" << endl;
+  cout << " -R solver     : reaction solver {explicit,ros2} (ex. -R ros2 [default:explicit])" << endl;
+  cout << "                 ros2: point-wise rosenbrock with the jacobian of the kinetic laws, for stiff reactions" << endl;
+  cout << " -b #(int)     : also write every output to the memory mapped ring file TimeCourseData.ring" << endl;
+  cout << "                 holding the last # outputs, for readers running alongside (ex. -b 100)" << endl;
+  cout << " -k #(int)     : write result/<model>/checkpoint.bin every # seconds of wall-clock time" << endl;
+  cout << "                 and when SIGTERM is received, then stop (ex. -k 3600, 0: only on SIGTERM)" << endl;
+  cout << " -G            : cache the grid, normal vectors and voronoi info of the geometry and reuse them" << endl;
+  cout << "                 in later runs with the same geometry and -x, -y, -z (in $SPATIALSIM_CACHE)" << endl;
+  cout << " -r            : restart from result/<model>/checkpoint.bin with the same model and options" << endl;
   cout << " -O outDir     : path to output directory" << endl << endl;
   cout << "(ex)           : " << str << " -t 0.1 -d 0.001 -o 10 -C 10 sam2d.xml" << endl;
   exit(1);
@@ -57,10 +80,22 @@ optionList getOptionList(int argc, char **argv, SBMLDocument *doc){
     .docFlag = 0,
     .document = 0,
     .outpath = 0,
+    .threads = 1,
+    .nativeFlag = 0,
+    .diffSolver = DIFFUSION_EXPLICIT,
+    .tolerance = 0.0,
+    .splitFlag = 0,
+    .subSteps = {1, 1, 1},
+    .multirateFlag = 0,
+    .reactionSolver = REACTION_EXPLICIT,
+    .ringFrames = 0,
+    .checkpointInterval = -1,
+    .restartFlag = 0,
+    .geometryCacheFlag = 0,
   };
   char *myname = argv[0];
   int opt_result;
-  while ((opt_result = getopt(argc, argv, "x:y:z:t:d:o:c:C:s:O:h")) != -1) {
+  while ((opt_result = getopt(argc, argv, "x:y:z:t:d:o:c:C:s:O:j:gM:A:S:mR:b:k:rGh")) != -1) {
     switch(opt_result) {
       case 'h':
         printErrorMessage(myname);
@@ -123,6 +158,62 @@ optionList getOptionList(int argc, char **argv, SBMLDocument *doc){
         options.slice = atoi(optarg + 1) * 2;
         if (dimension != 3) printErrorMessage(myname);
         break;
+      case 'j':
+        for (unsigned int i = 0; i < string(optarg).size(); i++) {
+          if (!isdigit(optarg[i])) printErrorMessage(myname);
+        }
+        options.threads = atoi(optarg);
+        if (options.threads < 1) printErrorMessage(myname);
+        break;
+      case 'g':
+        options.nativeFlag = 1;
+        break;
+      case 'M':
+        if (strcmp(optarg, "explicit") == 0) options.diffSolver = DIFFUSION_EXPLICIT;
+        else if (strcmp(optarg, "cn") == 0) options.diffSolver = DIFFUSION_CN;
+        else if (strcmp(optarg, "adi") == 0) options.diffSolver = DIFFUSION_ADI;
+        else if (strcmp(optarg, "mg") == 0) options.diffSolver = DIFFUSION_MG;
+        else printErrorMessage(myname);
+        break;
+      case 'A':
+        for (unsigned int i = 0; i < string(optarg).size(); i++) {
+          if (!isdigit(optarg[i]) && optarg[i] != '.' && optarg[i] != 'e' && optarg[i] != '-') printErrorMessage(myname);
+        }
+        options.tolerance = atof(optarg);
+        if (options.tolerance <= 0.0) printErrorMessage(myname);
+        break;
+      case 'S':
+        if (sscanf(optarg, "%d,%d,%d", &options.subSteps[0], &options.subSteps[1], &options.subSteps[2]) != 3) printErrorMessage(myname);
+        if (options.subSteps[0] < 1 || options.subSteps[1] < 1 || options.subSteps[2] < 1) printErrorMessage(myname);
+        options.splitFlag = 1;
+        break;
+      case 'm':
+        options.multirateFlag = 1;
+        break;
+      case 'R':
+        if (strcmp(optarg, "explicit") == 0) options.reactionSolver = REACTION_EXPLICIT;
+        else if (strcmp(optarg, "ros2") == 0) options.reactionSolver = REACTION_ROS2;
+        else printErrorMessage(myname);
+        break;
+      case 'b':
+        for (unsigned int i = 0; i < string(optarg).size(); i++) {
+          if (!isdigit(optarg[i])) printErrorMessage(myname);
+        }
+        options.ringFrames = atoi(optarg);
+        if (options.ringFrames < 1) printErrorMessage(myname);
+        break;
+      case 'k':
+        for (unsigned int i = 0; i < string(optarg).size(); i++) {
+          if (!isdigit(optarg[i])) printErrorMessage(myname);
+        }
+        options.checkpointInterval = atoi(optarg);
+        break;
+      case 'r':
+        options.restartFlag = 1;
+        break;
+      case 'G':
+        options.geometryCacheFlag = 1;
+        break;
       case 'O':
         options.outpath = static_cast<char*>(malloc(sizeof(char) * strlen(optarg) + 1));
         strncpy(options.outpath, optarg, strlen(optarg) + 1);
@@ -133,6 +224,11 @@ optionList getOptionList(int argc, char **argv, SBMLDocument *doc){
     }
   }
 
+  //the error estimate of -A needs the unsplit runge-kutta stages
+  if (options.splitFlag && options.tolerance > 0.0) printErrorMessage(myname);
+  //the sub-step counts of -m are fixed from -d
+  if (options.multirateFlag && options.tolerance > 0.0) printErrorMessage(myname);
+
   if(options.outpath == NULL){
     options.outpath = static_cast<char*>(malloc(sizeof(char) * strlen(".") + 1));
     strncpy(options.outpath, ".", strlen(".") + 1);
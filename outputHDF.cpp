@@ -10,6 +10,13 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <deque>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 using namespace H5;
 LIBSBML_CPP_NAMESPACE_USE
@@ -18,6 +25,33 @@ using namespace std;
 const string FILENAME = "TimeCourseData.h5";
 const string IMGFILENAME = "ImageData.h5";
 
+//snapshots waiting for the writer thread, the solver waits only when all of them are in use
+#define HDF_QUEUE_SIZE 4
+#define HDF_DEFLATE_LEVEL 4
+#define HDF_TIME_CHUNK 1024//entries of the time dataset per chunk
+
+typedef struct _hdfSnapshot {
+  double sim_time;
+  vector<vector<double> > data;//one buffer per species
+}hdfSnapshot;
+
+struct _hdfWriter {
+  H5File file;
+  vector<variableInfo*> infoList;
+  vector<DataSet> datasetList;//"<species id>/value" of (time, space) shape
+  DataSet timeDataset;//"time"
+  hsize_t numOfFrames;
+  int Xdiv, Ydiv, Zdiv, dimension;
+  deque<hdfSnapshot*> queue;//filled by the solver
+  vector<hdfSnapshot*> freeList;//written snapshots for reuse
+  mutex lock;
+  condition_variable isQueued, isWritten;
+  bool isClosing;
+  bool isIdle;//everything pushed is written and flushed
+  bool hasFailed;
+  thread worker;
+};
+
 void makeHDF(std::string fname, ListOfSpecies* los, std::string outpath) {//シミュレーション開始前にファイルを作成
   H5File file(outpath + "/result/" + fname + "/HDF5/" + FILENAME, H5F_ACC_TRUNC);
   for (unsigned int i = 0; i < los->size(); ++i) {
@@ -79,6 +113,182 @@ void outputValueData(std::vector<variableInfo*>&varInfoList, ListOfSpecies* los,
   file.close();
 }
 
+//appends one row to an extendible dataset whose first dimension is time
+static void appendFrame(DataSet &dataset, int rank, const hsize_t *frameDim, hsize_t row, const double *data)
+{
+  hsize_t size[4], count[4], offset[4] = {row, 0, 0, 0};
+  size[0] = row + 1;
+  count[0] = 1;
+  for (int i = 1; i < rank; i++) {
+    size[i] = count[i] = frameDim[i - 1];
+  }
+  dataset.extend(size);
+  DataSpace filespace = dataset.getSpace();
+  filespace.selectHyperslab(H5S_SELECT_SET, count, offset);
+  DataSpace memspace(rank, count);
+  dataset.write(data, PredType::NATIVE_DOUBLE, memspace, filespace);
+}
+
+static void writeSnapshot(hdfWriter *writer, hdfSnapshot *snapshot)
+{
+  hsize_t dim[3];
+  for (unsigned int i = 0; i < writer->datasetList.size(); i++) {
+    bool isVol = writer->infoList[i]->inVol;
+    dim[0] = (isVol) ? writer->Xdiv : writer->Xdiv * 2 - 1;
+    dim[1] = (isVol) ? writer->Ydiv : writer->Ydiv * 2 - 1;
+    dim[2] = (isVol) ? writer->Zdiv : writer->Zdiv * 2 - 1;
+    appendFrame(writer->datasetList[i], writer->dimension + 1, dim, writer->numOfFrames, &(snapshot->data[i][0]));
+  }
+  appendFrame(writer->timeDataset, 1, dim, writer->numOfFrames, &(snapshot->sim_time));
+  writer->numOfFrames++;
+}
+
+static void runHDFWriter(hdfWriter *writer)
+{
+  unique_lock<mutex> guard(writer->lock);
+  while (true) {
+    writer->isQueued.wait(guard, [writer] { return !writer->queue.empty() || writer->isClosing; });
+    if (writer->queue.empty()) break;
+    hdfSnapshot *snapshot = writer->queue.front();
+    guard.unlock();
+    bool isWritten = true;
+    try {
+      if (!writer->hasFailed) writeSnapshot(writer, snapshot);
+    } catch (Exception &e) {
+      cerr << "error: writing " << FILENAME << " failed (" << e.getDetailMsg() << "), the remaining outputs are dropped" << endl;
+      isWritten = false;
+    }
+    guard.lock();
+    if (!isWritten) writer->hasFailed = true;
+    writer->queue.pop_front();
+    writer->freeList.push_back(snapshot);
+    //the file is flushed whenever the writer catches up with the solver
+    if (writer->queue.empty()) {
+      if (!writer->hasFailed) {
+        guard.unlock();
+        try {
+          writer->file.flush(H5F_SCOPE_LOCAL);
+        } catch (Exception &e) {
+          cerr << "warning: flushing " << FILENAME << " failed (" << e.getDetailMsg() << ")" << endl;
+        }
+        guard.lock();
+      }
+      writer->isIdle = writer->queue.empty();
+    }
+    writer->isWritten.notify_all();
+  }
+}
+
+hdfWriter* openHDFWriter(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xdiv, int Ydiv, int Zdiv, int dimension, std::string fname, std::string outpath, int numOfFrames)
+{
+  hdfWriter *writer = new hdfWriter;
+  writer->file = H5File(outpath + "/result/" + fname + "/HDF5/" + FILENAME, H5F_ACC_RDWR);
+  writer->numOfFrames = numOfFrames;
+  if (numOfFrames != 0) {//restart, the rows from numOfFrames on are overwritten
+    try {
+      for (unsigned int i = 0; i < los->size(); i++) {
+        writer->infoList.push_back(searchInfoById(varInfoList, los->get(i)->getId().c_str()));
+        writer->datasetList.push_back(writer->file.openGroup(los->get(i)->getId()).openDataSet("value"));
+      }
+      writer->timeDataset = writer->file.openDataSet("time");
+    } catch (Exception &e) {
+      cerr << "error: cannot continue " << FILENAME << " (" << e.getDetailMsg() << ")" << endl;
+      exit(1);
+    }
+  } else {
+    //one chunk holds one output step of a species, the time dimension grows with every output
+    hsize_t volDim[4] = {0, static_cast<hsize_t>(Xdiv), static_cast<hsize_t>(Ydiv), static_cast<hsize_t>(Zdiv)};
+    hsize_t memDim[4] = {0, static_cast<hsize_t>(Xdiv * 2 - 1), static_cast<hsize_t>(Ydiv * 2 - 1), static_cast<hsize_t>(Zdiv * 2 - 1)};
+    hsize_t maxDim[4], chunkDim[4];
+    for (unsigned int i = 0; i < los->size(); i++) {
+      variableInfo *sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
+      hsize_t *dim = (sInfo->inVol) ? volDim : memDim;
+      copy(dim, dim + 4, maxDim);
+      copy(dim, dim + 4, chunkDim);
+      maxDim[0] = H5S_UNLIMITED;
+      chunkDim[0] = 1;
+      DSetCreatPropList prop;
+      prop.setChunk(dimension + 1, chunkDim);
+      prop.setShuffle();
+      prop.setDeflate(HDF_DEFLATE_LEVEL);
+      DataSpace dataspace(dimension + 1, dim, maxDim);
+      Group spGroup = writer->file.openGroup(los->get(i)->getId());
+      writer->infoList.push_back(sInfo);
+      writer->datasetList.push_back(spGroup.createDataSet("value", PredType::NATIVE_DOUBLE, dataspace, prop));
+    }
+    hsize_t timeDim = 0, timeMaxDim = H5S_UNLIMITED, timeChunkDim = HDF_TIME_CHUNK;
+    DSetCreatPropList timeProp;
+    timeProp.setChunk(1, &timeChunkDim);
+    writer->timeDataset = writer->file.createDataSet("time", PredType::NATIVE_DOUBLE, DataSpace(1, &timeDim, &timeMaxDim), timeProp);
+  }
+  writer->Xdiv = Xdiv;
+  writer->Ydiv = Ydiv;
+  writer->Zdiv = Zdiv;
+  writer->dimension = dimension;
+  writer->isClosing = false;
+  writer->isIdle = true;
+  writer->hasFailed = false;
+  for (unsigned int i = 0; i < HDF_QUEUE_SIZE; i++) writer->freeList.push_back(new hdfSnapshot);
+  writer->worker = thread(runHDFWriter, writer);
+  return writer;
+}
+
+//same layout as outputValueData: volume species are subsampled to the Xdiv * Ydiv * Zdiv points
+void pushValueData(hdfWriter *writer, double sim_time)
+{
+  int Xindex = writer->Xdiv * 2 - 1, Yindex = writer->Ydiv * 2 - 1, Zindex = writer->Zdiv * 2 - 1;
+  int X, Y, Z;
+  hdfSnapshot *snapshot = 0;
+  {
+    unique_lock<mutex> guard(writer->lock);
+    writer->isWritten.wait(guard, [writer] { return !writer->freeList.empty(); });
+    snapshot = writer->freeList.back();
+    writer->freeList.pop_back();
+  }
+  snapshot->sim_time = sim_time;
+  snapshot->data.resize(writer->infoList.size());
+  for (unsigned int i = 0; i < writer->infoList.size(); i++) {
+    variableInfo *sInfo = writer->infoList[i];
+    vector<double> &value = snapshot->data[i];
+    if (sInfo->inVol) {//volume
+      value.resize(writer->Zdiv * writer->Ydiv * writer->Xdiv);
+      for (Z = 0; Z < Zindex; Z += 2)
+        for (Y = 0; Y < Yindex; Y += 2)
+          for (X = 0; X < Xindex; X += 2)
+            value[Z / 2 * writer->Ydiv * writer->Xdiv + Y / 2 * writer->Xdiv + X / 2] = sInfo->value[Z * Yindex * Xindex + Y * Xindex + X];
+    } else {//membrane
+      value.assign(sInfo->value, sInfo->value + Xindex * Yindex * Zindex);
+    }
+  }
+  {
+    lock_guard<mutex> guard(writer->lock);
+    writer->queue.push_back(snapshot);
+    writer->isIdle = false;
+  }
+  writer->isQueued.notify_one();
+}
+
+void flushHDFWriter(hdfWriter *writer)
+{
+  unique_lock<mutex> guard(writer->lock);
+  writer->isWritten.wait(guard, [writer] { return writer->isIdle; });
+}
+
+void closeHDFWriter(hdfWriter *writer)
+{
+  {
+    lock_guard<mutex> guard(writer->lock);
+    writer->isClosing = true;
+  }
+  writer->isQueued.notify_one();
+  writer->worker.join();
+  for (unsigned int i = 0; i < writer->freeList.size(); i++) delete writer->freeList[i];
+  writer->datasetList.clear();
+  writer->timeDataset.close();
+  writer->file.close();
+  delete writer;
+}
+
 void output3D_uint8 (std::vector<variableInfo*>&varInfoList, ListOfSpecies* los, int Xindex, int Yindex, int Zindex, int file_num, std::string fname, double range_max, std::string outpath) {
   int i, X, Y, Z, index;
   uint8_t ***value;
@@ -14,6 +14,13 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <sys/stat.h>
 
 using namespace cv;
@@ -26,6 +33,104 @@ Vec3b nanVec(255, 192, 255);
 #define barSizeY 400
 #define cbAreaX 100
 #define cbAreaY 420
+#define COLOR_LUT_SIZE 5120//1024 bins per color segment of getRBGValue
+#define IMG_MAX_WORKERS 8
+#define IMG_QUEUE_SIZE 256//species images waiting for the workers
+
+//species images are rendered and encoded by these threads while the simulation goes on
+typedef struct _imagePool {
+  vector<thread> workerList;
+  deque<function<void()> > queue;
+  mutex lock;
+  condition_variable isQueued, isTaken;
+  unsigned int numOfRunning;
+  bool isClosing;
+}imagePool;
+
+static imagePool *imgPool = 0;
+
+static void runImageWorker()
+{
+  unique_lock<mutex> guard(imgPool->lock);
+  while (true) {
+    imgPool->isQueued.wait(guard, [] { return !imgPool->queue.empty() || imgPool->isClosing; });
+    if (imgPool->queue.empty()) break;
+    function<void()> task = imgPool->queue.front();
+    imgPool->queue.pop_front();
+    imgPool->numOfRunning++;
+    guard.unlock();
+    imgPool->isTaken.notify_all();
+    try {
+      task();
+    } catch (cv::Exception &e) {
+      cerr << "warning: writing an image failed (" << e.what() << ")" << endl;
+    }
+    guard.lock();
+    imgPool->numOfRunning--;
+    imgPool->isTaken.notify_all();
+  }
+}
+
+//without workers the image is rendered right away
+static void runImageTask(const function<void()> &task)
+{
+  if (imgPool == 0) {
+    task();
+    return;
+  }
+  {
+    unique_lock<mutex> guard(imgPool->lock);
+    imgPool->isTaken.wait(guard, [] { return imgPool->queue.size() < IMG_QUEUE_SIZE; });
+    imgPool->queue.push_back(task);
+  }
+  imgPool->isQueued.notify_one();
+}
+
+void startImageWorkers(unsigned int numOfThreads) {
+  if (imgPool != 0) return;
+  if (numOfThreads == 0) numOfThreads = min(max(thread::hardware_concurrency(), 1u), static_cast<unsigned int>(IMG_MAX_WORKERS));
+  imgPool = new imagePool;
+  imgPool->numOfRunning = 0;
+  imgPool->isClosing = false;
+  for (unsigned int i = 0; i < numOfThreads; i++) imgPool->workerList.push_back(thread(runImageWorker));
+}
+
+void flushImageWorkers() {
+  if (imgPool == 0) return;
+  unique_lock<mutex> guard(imgPool->lock);
+  imgPool->isTaken.wait(guard, [] { return imgPool->queue.empty() && imgPool->numOfRunning == 0; });
+}
+
+void finishImageWorkers() {
+  if (imgPool == 0) return;
+  {
+    lock_guard<mutex> guard(imgPool->lock);
+    imgPool->isClosing = true;
+  }
+  imgPool->isQueued.notify_all();
+  for (unsigned int i = 0; i < imgPool->workerList.size(); i++) imgPool->workerList[i].join();
+  delete imgPool;
+  imgPool = 0;
+}
+
+//everything but the value area and the time label, drawn once per species
+typedef struct _imageTemplate {
+  string key;//range and geometry the template was drawn for
+  Mat image;
+}imageTemplate;
+
+static map<string, imageTemplate> imgTemplateList;
+
+static Mat makeColorBarImage(int* cbAreaSize, int* cbSize, int* cbIndent, double range_min, double range_max)
+{
+  Mat colorBar(Size(barSizeX, barSizeY), CV_8UC3, Scalar(255, 255, 255));
+  Mat colorBarArea(Size(cbAreaSize[0], cbAreaSize[1]), CV_8UC3, Scalar(255, 255, 255));
+  Mat Roi_colorBar(colorBarArea, Rect(cbIndent[0], cbIndent[1], cbSize[0], cbSize[1]));//ROIの指定
+  makeColorBar(colorBar);
+  resize(colorBar, Roi_colorBar, Size(cbSize[0], cbSize[1]), INTER_NEAREST);//カラー領域をリサイズ
+  makeColorBarArea(colorBarArea, range_max, range_min, cbSize, cbIndent);
+  return colorBarArea;
+}
 
 void outputImg(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_edge, int Xdiv, int Ydiv, double minX, double maxX, double minY, double maxY, double t, double range_min, double range_max, std::string fname, int file_num, std::string outpath, int num_digits) {
   int Xindex = Xdiv * 2 - 1,  Yindex = Ydiv * 2 - 1, magnification = 1;
@@ -49,15 +154,11 @@ void outputImg(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_e
   cbIndent[0] = areaSize[0] * 10 / 200;
   if (cbIndent[0] == 0) cbIndent[0] = 10;
   cbIndent[1] = (cbAreaSize[1] - cbSize[1]) / 2;
-  Mat colorBar(Size(barSizeX, barSizeY), CV_8UC3, Scalar(255, 255, 255));
-  Mat colorBarArea(Size(cbAreaSize[0], cbAreaSize[1]), CV_8UC3, Scalar(255, 255, 255));
-  Mat Roi_colorBar(colorBarArea, Rect(cbIndent[0], cbIndent[1], cbSize[0], cbSize[1]));//ROIの指定
-  makeColorBar(colorBar);
-  resize(colorBar, Roi_colorBar, Size(cbSize[0], cbSize[1]), INTER_NEAREST);//カラー領域をリサイズ
-  makeColorBarArea(colorBarArea, range_max, range_min, cbSize, cbIndent);
+  Mat colorBarArea;//drawn only when a template is (re)built
+  stringstream key;
+  key << setprecision(17) << range_min << " " << range_max << " " << minX << " " << maxX << " " << minY << " " << maxY << " " << Xdiv << " " << Ydiv << " " << fname;
 
-  stringstream ss;
-  string dir_name, s_id;
+  string s_id;
   unsigned int i;
   unsigned int numOfSpecies = static_cast<unsigned int>(model->getNumSpecies());
   ListOfSpecies *los = model->getListOfSpecies();
@@ -65,35 +166,68 @@ void outputImg(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_e
   for (i = 0; i < numOfSpecies; ++i) {
     sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
     s_id = los->get(i)->getId();
-    Mat image(Size(imageSize[0], imageSize[1]), CV_8UC3, Scalar(255, 255, 255));
-    //================== value area =====================
-    Mat valueMat(Size(Xdiv, Ydiv), CV_8UC3, Scalar(0, 0, 0));
-    Mat valueMat_sparse(Size(Xindex, Yindex), CV_8UC3, Scalar(0, 0, 0));
-    if (sInfo->inVol) {
-      makeValueMat(valueMat, sInfo->value, Xindex, Yindex, range_min, range_max);
-    }
-    sparseMat(valueMat, valueMat_sparse);//縦横２倍
-    addMemToValueMat(valueMat_sparse, geo_edge, Xdiv, Ydiv);
-    if (!sInfo->inVol) {
-      makeMemValueMat(valueMat_sparse, sInfo->value, geo_edge, Xindex, Yindex, range_min, range_max);
+    bool inVol = sInfo->inVol;
+    double *spValue = sInfo->value;
+    imageTemplate &tmpl = imgTemplateList[s_id];
+    if (tmpl.image.empty() || tmpl.key != key.str()) {
+      if (colorBarArea.empty()) colorBarArea = makeColorBarImage(cbAreaSize, cbSize, cbIndent, range_min, range_max);
+      tmpl.key = key.str();
+      tmpl.image = Mat(Size(imageSize[0], imageSize[1]), CV_8UC3, Scalar(255, 255, 255));
+      //================== colorbar area ==================
+      Mat Roi_cbArea(tmpl.image, Rect(indent[0] + areaSize[0], 0, cbAreaSize[0], cbAreaSize[1]));
+      colorBarArea.copyTo(Roi_cbArea);
+      //================= value area frame & number =====================
+      setFrameDetail(tmpl.image, indent, areaSize, minX, maxX, minY, maxY, Xdiv, Ydiv, fname, s_id, magnification);
     }
-    Mat Roi_val(image, Rect(indent[0], indent[1], areaSize[0], areaSize[1]));//ROIの指定
-    if (1 < magnification) {
-      Mat valueMat_mag(Size(areaSize[0], areaSize[1]), CV_8UC3, Scalar(0, 0, 0));
-      resizeMat(valueMat_sparse, valueMat_mag, magnification);
-      valueMat_mag.copyTo(Roi_val);
-    } else {
-      valueMat_sparse.copyTo(Roi_val);//ROI_valに反応空間の値をコピー
+    Mat frame = tmpl.image;
+    shared_ptr<vector<double> > snapshot;//the workers render a copy, the simulation goes on
+    if (imgPool != 0) snapshot = make_shared<vector<double> >(sInfo->value, sInfo->value + Xindex * Yindex);
+    runImageTask([=]() mutable {
+      double *value = (snapshot) ? &(*snapshot)[0] : spValue;
+      stringstream ss;
+      Mat image = frame.clone();
+      //================== value area =====================
+      Mat valueMat(Size(Xdiv, Ydiv), CV_8UC3, Scalar(0, 0, 0));
+      Mat valueMat_sparse(Size(Xindex, Yindex), CV_8UC3, Scalar(0, 0, 0));
+      if (inVol) {
+        makeValueMat(valueMat, value, Xindex, Yindex, range_min, range_max);
+      }
+      sparseMat(valueMat, valueMat_sparse);//縦横２倍
+      addMemToValueMat(valueMat_sparse, geo_edge, Xdiv, Ydiv);
+      if (!inVol) {
+        makeMemValueMat(valueMat_sparse, value, geo_edge, Xindex, Yindex, range_min, range_max);
+      }
+      Mat Roi_val(image, Rect(indent[0], indent[1], areaSize[0], areaSize[1]));//ROIの指定
+      if (1 < magnification) {
+        Mat valueMat_mag(Size(areaSize[0], areaSize[1]), CV_8UC3, Scalar(0, 0, 0));
+        resizeMat(valueMat_sparse, valueMat_mag, magnification);
+        valueMat_mag.copyTo(Roi_val);
+      } else {
+        valueMat_sparse.copyTo(Roi_val);//ROI_valに反応空間の値をコピー
+      }
+      //=============== t ====================
+      addFrameTime(image, indent, areaSize, t, num_digits);
+      ss << outpath << "/result/" << fname << "/img/" << s_id << "/" << setfill('0') << setw(4) << file_num << ".png";
+      imwrite(ss.str(), image);
+    });
+  }
+}
+
+//copy of the plane at 'slice', stored as slice 0 of a volume of index[0] * index[1] * 1 points
+template<typename T>
+static shared_ptr<vector<T> > copySlicePlane(const T* volume, int Xindex, int Yindex, const int* index, int slice, char slicedim) {
+  shared_ptr<vector<T> > plane = make_shared<vector<T> >(static_cast<size_t>(index[0]) * index[1]);
+  long XYindex = static_cast<long>(Xindex) * Yindex;
+  for (int p1 = 0; p1 < index[1]; ++p1) {
+    for (int p0 = 0; p0 < index[0]; ++p0) {
+      long src;
+      if (slicedim == 'x') src = p1 * XYindex + static_cast<long>(p0) * Xindex + slice;
+      else if (slicedim == 'y') src = p1 * XYindex + static_cast<long>(slice) * Xindex + p0;
+      else src = slice * XYindex + static_cast<long>(p1) * Xindex + p0;
+      (*plane)[static_cast<size_t>(p1) * index[0] + p0] = volume[src];
     }
-    //================== colorbar area ==================
-    Mat Roi_cbArea(image, Rect(indent[0] + areaSize[0], 0, cbAreaSize[0], cbAreaSize[1]));
-    colorBarArea.copyTo(Roi_cbArea);
-    //================= value area frame & number =====================
-    setDetail(image, indent, areaSize, t, minX, maxX, minY, maxY, Xdiv, Ydiv, fname, s_id, magnification, num_digits);
-    ss << outpath << "/result/" << fname << "/img/" << s_id << "/" << setfill('0') << setw(4) << file_num << ".png";
-    imwrite(ss.str(), image);
-    ss.str("");
   }
+  return plane;
 }
 
 void outputImg_slice(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_edge, int Xdiv, int Ydiv, int Zdiv, double min0, double max0, double min1, double max1, double t, double range_min, double range_max, std::string fname, int file_num, int slice, char slicedim, std::string outpath, int num_digits) {
@@ -140,50 +274,69 @@ void outputImg_slice(Model *model, std::vector<variableInfo*> &varInfoList, int*
   cbIndent[0] = areaSize[0] * 10 / 200;
   if (cbIndent[0] == 0) cbIndent[0] = 10;
   cbIndent[1] = (cbAreaSize[1] - cbSize[1]) / 2;
-  Mat colorBar(Size(barSizeX, barSizeY), CV_8UC3, Scalar(255, 255, 255));
-  Mat colorBarArea(Size(cbAreaSize[0], cbAreaSize[1]), CV_8UC3, Scalar(255, 255, 255));
-  Mat Roi_colorBar(colorBarArea, Rect(cbIndent[0], cbIndent[1], cbSize[0], cbSize[1]));//ROIの指定
-  makeColorBar(colorBar);
-  resize(colorBar, Roi_colorBar, Size(cbSize[0], cbSize[1]), INTER_NEAREST);//カラー領域をリサイズ
-  makeColorBarArea(colorBarArea, range_max, range_min, cbSize, cbIndent);
+  Mat colorBarArea;//drawn only when a template is (re)built
+  stringstream key;
+  key << setprecision(17) << range_min << " " << range_max << " " << min0 << " " << max0 << " " << min1 << " " << max1 << " " << Xdiv << " " << Ydiv << " " << Zdiv << " " << slice << slicedim << " " << fname;
 
-  stringstream ss;
-  string dir_name, s_id;
+  string s_id;
   unsigned int i;
   unsigned int numOfSpecies = static_cast<unsigned int>(model->getNumSpecies());
   ListOfSpecies *los = model->getListOfSpecies();
   variableInfo *sInfo;
+  shared_ptr<vector<int> > edgePlane;//membrane flags of the plane, shared by the species of this step
+  if (imgPool != 0) edgePlane = copySlicePlane(geo_edge, Xindex, Yindex, index, slice, slicedim);
   for (i = 0; i < numOfSpecies; ++i) {
     sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
     s_id = los->get(i)->getId();
-    Mat image(Size(imageSize[0], imageSize[1]), CV_8UC3, Scalar(255, 255, 255));
-    //================== value area =====================
-    Mat valueMat(Size(division[0], division[1]), CV_8UC3, Scalar(0, 0, 0));
-    Mat valueMat_sparse(Size(index[0], index[1]), CV_8UC3, Scalar(0, 0, 0));
-    if (sInfo->inVol) {
-      makeValueMat_slice(valueMat, sInfo->value, Xindex, Yindex, Zindex, range_min, range_max, slice, slicedim);
+    bool inVol = sInfo->inVol;
+    double *spValue = sInfo->value;
+    imageTemplate &tmpl = imgTemplateList[s_id];
+    if (tmpl.image.empty() || tmpl.key != key.str()) {
+      if (colorBarArea.empty()) colorBarArea = makeColorBarImage(cbAreaSize, cbSize, cbIndent, range_min, range_max);
+      tmpl.key = key.str();
+      tmpl.image = Mat(Size(imageSize[0], imageSize[1]), CV_8UC3, Scalar(255, 255, 255));
+      //================== colorbar area ==================
+      Mat Roi_cbArea(tmpl.image, Rect(indent[0] + areaSize[0], 0, cbAreaSize[0], cbAreaSize[1]));
+      colorBarArea.copyTo(Roi_cbArea);
+      //================= value area frame & number =====================
+      setFrameDetail_slice(tmpl.image, indent, areaSize, min0, max0, min1, max1, Xdiv, Ydiv, Zdiv, fname, s_id, magnification, slice, slicedim);
     }
-    sparseMat(valueMat, valueMat_sparse);//縦横２倍
-    addMemToValueMat_slice(valueMat_sparse, geo_edge, Xdiv, Ydiv, Zdiv, slice, slicedim);
-    if (!sInfo->inVol) {
-      makeMemValueMat_slice(valueMat_sparse, sInfo->value, geo_edge, Xindex, Yindex, Zindex, range_min, range_max, slice, slicedim);
-    }
-    Mat Roi_val(image, Rect(indent[0], indent[1], areaSize[0], areaSize[1]));//ROIの指定
-    if (1 < magnification) {
-      Mat valueMat_mag(Size(areaSize[0], areaSize[1]), CV_8UC3, Scalar(0, 0, 0));
-      resizeMat(valueMat_sparse, valueMat_mag, magnification);
-      valueMat_mag.copyTo(Roi_val);
-    } else {
-      valueMat_sparse.copyTo(Roi_val);//ROI_valに反応空間の値をコピー
-    }
-    //================== colorbar area ==================
-    Mat Roi_cbArea(image, Rect(indent[0] + areaSize[0], 0, cbAreaSize[0], cbAreaSize[1]));
-    colorBarArea.copyTo(Roi_cbArea);
-    //================= value area frame & number =====================
-    setDetail_slice(image, indent, areaSize, t, min0, max0, min1, max1, Xdiv, Ydiv, Zdiv, fname, s_id, magnification, slice, slicedim, num_digits);
-    ss << outpath << "/result/" << fname << "/img/" << s_id << "/" << setfill('0') << setw(4) << file_num << ".png";
-    imwrite(ss.str(), image);
-    ss.str("");
+    Mat frame = tmpl.image;
+    shared_ptr<vector<double> > snapshot;//the workers render a copy of the slice plane, the simulation goes on
+    if (imgPool != 0) snapshot = copySlicePlane(spValue, Xindex, Yindex, index, slice, slicedim);
+    runImageTask([=]() mutable {
+      double *value = (snapshot) ? &(*snapshot)[0] : spValue;
+      int *edge = (snapshot) ? &(*edgePlane)[0] : geo_edge;
+      //the copied plane is indexed as slice 0 of a volume with one layer in z
+      int volX = (snapshot) ? index[0] : Xindex, volY = (snapshot) ? index[1] : Yindex, volZ = (snapshot) ? 1 : Zindex;
+      int volSlice = (snapshot) ? 0 : slice;
+      char volDim = (snapshot) ? 'z' : slicedim;
+      stringstream ss;
+      Mat image = frame.clone();
+      //================== value area =====================
+      Mat valueMat(Size(division[0], division[1]), CV_8UC3, Scalar(0, 0, 0));
+      Mat valueMat_sparse(Size(index[0], index[1]), CV_8UC3, Scalar(0, 0, 0));
+      if (inVol) {
+        makeValueMat_slice(valueMat, value, volX, volY, volZ, range_min, range_max, volSlice, volDim);
+      }
+      sparseMat(valueMat, valueMat_sparse);//縦横２倍
+      addMemToValueMat_slice(valueMat_sparse, geo_edge, Xdiv, Ydiv, Zdiv, slice, slicedim);
+      if (!inVol) {
+        makeMemValueMat_slice(valueMat_sparse, value, edge, volX, volY, volZ, range_min, range_max, volSlice, volDim);
+      }
+      Mat Roi_val(image, Rect(indent[0], indent[1], areaSize[0], areaSize[1]));//ROIの指定
+      if (1 < magnification) {
+        Mat valueMat_mag(Size(areaSize[0], areaSize[1]), CV_8UC3, Scalar(0, 0, 0));
+        resizeMat(valueMat_sparse, valueMat_mag, magnification);
+        valueMat_mag.copyTo(Roi_val);
+      } else {
+        valueMat_sparse.copyTo(Roi_val);//ROI_valに反応空間の値をコピー
+      }
+      //=============== t ====================
+      addFrameTime(image, indent, areaSize, t, num_digits);
+      ss << outpath << "/result/" << fname << "/img/" << s_id << "/" << setfill('0') << setw(4) << file_num << ".png";
+      imwrite(ss.str(), image);
+    });
   }
 }
 
@@ -279,14 +432,75 @@ Vec3b getRBGValue(double value, double range_min, double range_max){
   }
 }
 
-void makeValueMat(cv::Mat mat, double* value, int Xindex, int Yindex, double range_min, double range_max) {
-  int X, Y, index;
-  for (Y = 0; Y < mat.rows; ++Y) {
-    for (X = 0; X < mat.cols; ++X) {
-      index = (Yindex - 1 - Y * 2) * Xindex + X * 2;//疎行列用 なんかこうしないと逆になっちゃう
-      mat.at<Vec3b>(Y, X) = getRBGValue(value[index], range_min, range_max);
+//getRBGValue sampled on COLOR_LUT_SIZE bins of [range_min, range_max], plus the colors below and above the range
+static const vector<Vec3b>& getColorLUT() {
+  static vector<Vec3b> lut;
+  static once_flag isBuilt;
+  call_once(isBuilt, [] {
+    lut.resize(COLOR_LUT_SIZE + 2);
+    lut[0] = getRBGValue(-1.0, 0.0, 5.0);
+    for (int i = 0; i < COLOR_LUT_SIZE; ++i) {
+      lut[i + 1] = getRBGValue((i + 0.5) * 5.0 / COLOR_LUT_SIZE, 0.0, 5.0);
     }
+    lut[COLOR_LUT_SIZE + 1] = getRBGValue(6.0, 0.0, 5.0);
+  });
+  return lut;
+}
+
+//mat(y, x) = color of value[base + y * rowStep + x * colStep]
+static void makeColorMat(cv::Mat mat, const double* value, long base, long rowStep, long colStep, double range_min, double range_max) {
+  const vector<Vec3b> &lut = getColorLUT();
+  double scale = COLOR_LUT_SIZE / (range_max - range_min);
+  for (int y = 0; y < mat.rows; ++y) {
+    Vec3b *row = mat.ptr<Vec3b>(y);
+    const double *src = value + base + y * rowStep;
+    for (int x = 0; x < mat.cols; ++x) {
+      double level = (src[x * colStep] - range_min) * scale;
+      if (level >= 0 && level < COLOR_LUT_SIZE) row[x] = lut[static_cast<int>(level) + 1];
+      else if (level < 0) row[x] = lut[0];
+      else if (level >= COLOR_LUT_SIZE) row[x] = lut[(level == COLOR_LUT_SIZE) ? COLOR_LUT_SIZE : COLOR_LUT_SIZE + 1];
+      else row[x] = nanVec;
+    }
+  }
+}
+
+//mask(y, x) = 255 where geo_edge[base + y * rowStep + x * colStep] is membrane
+static cv::Mat makeMemMask(const int* geo_edge, int rows, int cols, long base, long rowStep, long colStep) {
+  Mat mask(rows, cols, CV_8U);
+  for (int y = 0; y < rows; ++y) {
+    unsigned char *row = mask.ptr<unsigned char>(y);
+    const int *src = geo_edge + base + y * rowStep;
+    for (int x = 0; x < cols; ++x) {
+      int edge = src[x * colStep];
+      row[x] = (edge == 1 || edge == 2) ? 255 : 0;
+    }
+  }
+  return mask;
+}
+
+//same indexing as makeValueMat_slice (step 2) and makeMemValueMat_slice (step 1), the image is flipped vertically
+static bool getSliceStride(int Xindex, int Yindex, int Zindex, int slice, char slicedim, int step, long& base, long& rowStep, long& colStep) {
+  long XYindex = static_cast<long>(Xindex) * Yindex;
+  if (slicedim == 'x') {
+    base = (Zindex - 1) * XYindex + slice;
+    rowStep = -step * XYindex;
+    colStep = step * Xindex;
+  } else if (slicedim == 'y') {
+    base = (Zindex - 1) * XYindex + slice * Xindex;
+    rowStep = -step * XYindex;
+    colStep = step;
+  } else if (slicedim == 'z') {
+    base = slice * XYindex + (Yindex - 1) * Xindex;
+    rowStep = -step * Xindex;
+    colStep = step;
+  } else {
+    return false;
   }
+  return true;
+}
+
+void makeValueMat(cv::Mat mat, double* value, int Xindex, int Yindex, double range_min, double range_max) {
+  makeColorMat(mat, value, static_cast<long>(Yindex - 1) * Xindex, -2 * Xindex, 2, range_min, range_max);//疎行列用 なんかこうしないと逆になっちゃう
 }
 
 void makeValueMatSlice_gray(cv::Mat mat, double* value, int Xindex, int Yindex, int slice, double range_min, double range_max){
@@ -310,49 +524,30 @@ void makeValueMatSlice_gray(cv::Mat mat, double* value, int Xindex, int Yindex,
 }
 
 void makeValueMat_slice(cv::Mat mat, double* value, int Xindex, int Yindex, int Zindex, double range_min, double range_max, int slice, char slicedim) {
-  int x, y, index;
-  if (slicedim != 'x' && slicedim != 'y' && slicedim != 'z') {
+  long base, rowStep, colStep;
+  if (!getSliceStride(Xindex, Yindex, Zindex, slice, slicedim, 2, base, rowStep, colStep)) {
     cerr << "Error in makeValueMat_slice(): 'slicedim' should be either 'x', 'y' or 'z'." << endl;
     return;
   }
-  for (y = 0; y < mat.rows; ++y) {
-    for (x = 0; x < mat.cols; ++x) {
-      if (slicedim == 'x') index = (Zindex - 1 - y * 2) * Xindex * Yindex + (x * 2) * Xindex + slice;
-      if (slicedim == 'y') index = (Zindex - 1 - y * 2) * Xindex * Yindex + slice * Xindex + x * 2;
-      if (slicedim == 'z') index = slice * Xindex * Yindex + (Yindex - 1 - y * 2) * Xindex + x * 2;
-      mat.at<Vec3b>(y, x) = getRBGValue(value[index], range_min, range_max);
-    }
-  }
+  makeColorMat(mat, value, base, rowStep, colStep, range_min, range_max);
 }
 
 void makeMemValueMat(cv::Mat mat, double* value, int* geo_edge, int Xindex, int Yindex, double range_min, double range_max) {
-  int X, Y, index;
-  for (Y = 0; Y < Yindex; ++Y) {
-    for (X = 0; X < Xindex; ++X) {
-      index = (Yindex - 1 - Y) * Xindex + X;//疎行列用 なんかこうしないと逆になっちゃう
-      if (geo_edge[index] == 1 || geo_edge[index] == 2) {
-        mat.at<Vec3b>(Y, X) = getRBGValue(value[index], range_min, range_max);
-      }
-    }
-  }
+  long base = static_cast<long>(Yindex - 1) * Xindex;//疎行列用 なんかこうしないと逆になっちゃう
+  Mat colorMat(Yindex, Xindex, CV_8UC3);
+  makeColorMat(colorMat, value, base, -Xindex, 1, range_min, range_max);
+  colorMat.copyTo(mat, makeMemMask(geo_edge, Yindex, Xindex, base, -Xindex, 1));
 }
 
 void makeMemValueMat_slice(cv::Mat mat, double* value, int* geo_edge, int Xindex, int Yindex, int Zindex, double range_min, double range_max, int slice, char slicedim) {
-  int x, y, index;
-  if (slicedim != 'x' && slicedim != 'y' && slicedim != 'z') {
+  long base, rowStep, colStep;
+  if (!getSliceStride(Xindex, Yindex, Zindex, slice, slicedim, 1, base, rowStep, colStep)) {
     cerr << "Error in makeMemValueMat_slice(): 'slicedim' should be either 'x', 'y' or 'z'." << endl;
     return;
   }
-  for (y = 0; y < mat.rows; ++y) {
-    for (x = 0; x < mat.cols; ++x) {
-      if (slicedim == 'x') index = (Zindex - 1 - y) * Xindex * Yindex + x * Xindex + slice;
-      if (slicedim == 'y') index = (Zindex - 1 - y) * Xindex * Yindex + slice * Xindex + x;
-      if (slicedim == 'z') index = slice * Xindex * Yindex + (Yindex - 1 - y) * Xindex + x;
-      if (geo_edge[index] == 1 || geo_edge[index] == 2) {
-        mat.at<Vec3b>(y, x) = getRBGValue(value[index], range_min, range_max);
-      }
-    }
-  }
+  Mat colorMat(mat.rows, mat.cols, CV_8UC3);
+  makeColorMat(colorMat, value, base, rowStep, colStep, range_min, range_max);
+  colorMat.copyTo(mat, makeMemMask(geo_edge, mat.rows, mat.cols, base, rowStep, colStep));
 }
 
 void makeMemValueMatSlice_gray(cv::Mat mat, double* value, int* geo_edge, int Xindex, int Yindex, int slice, double range_min, double range_max) {
@@ -376,70 +571,29 @@ void makeMemValueMatSlice_gray(cv::Mat mat, double* value, int* geo_edge, int Xi
   }
 }
 
+//result(y, x) = origin((y + 1) / 2, x / 2), i.e. twice the size without the first row and the last column
 void sparseMat(cv::Mat origin, cv::Mat result) {
-  int Y, X, rX, rY;
-  for (Y = 0; Y < origin.rows; ++Y) {
-    for (X = 0; X < origin.cols; ++X) {
-      rX = X * 2;
-      rY = Y * 2;
-      result.at<Vec3b>(rY, rX) = origin.at<Vec3b>(Y, X);
-      if (X != origin.cols - 1) result.at<Vec3b>(rY, rX + 1) = origin.at<Vec3b>(Y, X);
-      if (Y != 0) result.at<Vec3b>(rY - 1, rX) = origin.at<Vec3b>(Y, X);
-      if (Y != 0 && X != origin.cols - 1) result.at<Vec3b>(rY - 1, rX + 1) = origin.at<Vec3b>(Y, X);
-    }
-  }
+  Mat doubled;
+  resize(origin, doubled, Size(origin.cols * 2, origin.rows * 2), 0, 0, INTER_NEAREST);
+  doubled(Rect(0, 1, result.cols, result.rows)).copyTo(result);
 }
 
 void resizeMat(cv::Mat origin, cv::Mat result, int magnification) {
-  int Y, X, rX, rY, i, j;
-  for (Y = 0; Y < origin.rows; ++Y) {
-    for (X = 0; X < origin.cols; ++X) {
-      rX = X * magnification;
-      rY = Y * magnification;
-      for (i = 0; i < magnification; ++i) {
-        for (j = 0; j < magnification; ++j) {
-          result.at<Vec3b>(rY + j, rX + i) = origin.at<Vec3b>(Y, X);
-        }
-      }
-    }
-  }
+  resize(origin, result, Size(origin.cols * magnification, origin.rows * magnification), 0, 0, INTER_NEAREST);
 }
 
 void addMemToValueMat(cv::Mat valueMat, int* geo_edge, int Xdiv, int Ydiv) {
-  int Xindex = Xdiv * 2 - 1, Yindex = Ydiv * 2 - 1, index;
-  for (int Y = 0; Y < Yindex; ++Y) {
-    for (int X = 0; X < Xindex; ++X) {
-      index = (Yindex - 1 - Y) * Xindex + X;
-      if (geo_edge[index] == 2 || geo_edge[index] == 1) {
-        valueMat.at<Vec3b>(Y, X)[0] = 255;
-        valueMat.at<Vec3b>(Y, X)[1] = 255;
-        valueMat.at<Vec3b>(Y, X)[2] = 255;
-      }
-    }
-  }
+  int Xindex = Xdiv * 2 - 1, Yindex = Ydiv * 2 - 1;
+  valueMat.setTo(Scalar::all(255), makeMemMask(geo_edge, Yindex, Xindex, static_cast<long>(Yindex - 1) * Xindex, -Xindex, 1));
 }
 
 void addMemToValueMat_slice(cv::Mat valueMat, int* geo_edge, int Xdiv, int Ydiv, int Zdiv, int slice, char slicedim) {
-  int Xindex = Xdiv * 2 - 1;
-  int Yindex = Ydiv * 2 - 1;
-  int Zindex = Zdiv * 2 - 1;
-  int index;
-  if (slicedim != 'x' && slicedim != 'y' && slicedim != 'z') {
+  long base, rowStep, colStep;
+  if (!getSliceStride(Xdiv * 2 - 1, Ydiv * 2 - 1, Zdiv * 2 - 1, slice, slicedim, 1, base, rowStep, colStep)) {
     cerr << "Error in addMemToValueMat_slice(): 'slicedim' should be either 'x', 'y' or 'z'." << endl;
     return;
   }
-  for (int y = 0; y < valueMat.rows; ++y) {
-    for (int x = 0; x < valueMat.cols; ++x) {
-      if (slicedim == 'x') index = (Zindex - 1 - y) * Yindex * Xindex + x * Xindex + slice;
-      if (slicedim == 'y') index = (Zindex - 1 - y) * Yindex * Xindex + slice * Xindex + x;
-      if (slicedim == 'z') index = slice * Yindex * Xindex + (Yindex - 1 - y) * Xindex + x;
-      if (geo_edge[index] == 2 || geo_edge[index] == 1) {
-        valueMat.at<Vec3b>(y, x)[0] = 255;
-        valueMat.at<Vec3b>(y, x)[1] = 255;
-        valueMat.at<Vec3b>(y, x)[2] = 255;
-      }
-    }
-  }
+  valueMat.setTo(Scalar::all(255), makeMemMask(geo_edge, valueMat.rows, valueMat.cols, base, rowStep, colStep));
 }
 
 void makeColorBar(cv::Mat colorBar) {
@@ -516,6 +670,11 @@ void makeColorBarArea(cv::Mat area, double range_max, double range_min, int* cbS
 }
 
 void setDetail(cv::Mat image, int* indent, int* areaSize, double t, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, std::string fname, string s_id, int magnification, int num_digits) {
+  setFrameDetail(image, indent, areaSize, minX, maxX, minY, maxY, Xdiv, Ydiv, fname, s_id, magnification);
+  addFrameTime(image, indent, areaSize, t, num_digits);
+}
+
+void setFrameDetail(cv::Mat image, int* indent, int* areaSize, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, std::string fname, string s_id, int magnification) {
   int thickness, lticks, sticks;
   float fontsize;
   Point left_top, right_top, left_bottom, right_bottom;
@@ -525,8 +684,6 @@ void setDetail(cv::Mat image, int* indent, int* areaSize, double t, double minX,
   addAxisLabel(image, indent, areaSize, fontsize, thickness, lticks, "x", "y");
   //============== Add Ticks ==================
   addTicks(image, fontsize, thickness, Xdiv, Ydiv, lticks, sticks, left_bottom);
-  //=============== t ====================
-  addSimulationTime(image, indent, fontsize, thickness, t, num_digits);
   //=============== resize font ====================
   resizeFont(fontsize, thickness, 0.5);
   //=============== Xdiv Ydiv magnification ====================
@@ -538,6 +695,11 @@ void setDetail(cv::Mat image, int* indent, int* areaSize, double t, double minX,
 }
 
 void setDetail_slice(cv::Mat image, int* indent, int* areaSize, double t, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, int Zdiv, std::string fname, string s_id, int magnification, int slice, char slicedim, int num_digits) {
+  setFrameDetail_slice(image, indent, areaSize, minX, maxX, minY, maxY, Xdiv, Ydiv, Zdiv, fname, s_id, magnification, slice, slicedim);
+  addFrameTime(image, indent, areaSize, t, num_digits);
+}
+
+void setFrameDetail_slice(cv::Mat image, int* indent, int* areaSize, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, int Zdiv, std::string fname, string s_id, int magnification, int slice, char slicedim) {
   int thickness, lticks, sticks;
   float fontsize;
   Point left_top, right_top, left_bottom, right_bottom;
@@ -566,8 +728,6 @@ void setDetail_slice(cv::Mat image, int* indent, int* areaSize, double t, double
   addAxisLabel(image, indent, areaSize, fontsize, thickness, lticks, xlabel, ylabel);
   //============== Add Ticks ==================
   addTicks(image, fontsize, thickness, XresultImg, YresultImg, lticks, sticks, left_bottom);
-  //=============== t ====================
-  addSimulationTime(image, indent, fontsize, thickness, t, num_digits);
   //=============== resize font ====================
   resizeFont(fontsize, thickness, 0.5);
   //=============== Xdiv Ydiv Zdiv magnification ====================
@@ -580,11 +740,22 @@ void setDetail_slice(cv::Mat image, int* indent, int* areaSize, double t, double
   addSliceInfo(image, indent, fontsize, thickness, slice, slicedim);
 }
 
-void initializeImage(cv::Mat image, int* indent, int* areaSize, float& fontsize, int& thickness, int& lticks, int& sticks, cv::Point& left_top, cv::Point& right_top, cv::Point& left_bottom, cv::Point& right_bottom) {
+void addFrameTime(cv::Mat image, int* indent, int* areaSize, double t, int num_digits) {
+  int thickness;
+  float fontsize;
+  calcFontSize(areaSize, fontsize, thickness);
+  addSimulationTime(image, indent, fontsize, thickness, t, num_digits);
+}
+
+void calcFontSize(int* areaSize, float& fontsize, int& thickness) {
   int baseSize = (areaSize[0] < areaSize[1])? areaSize[0] : areaSize[1];
   thickness = baseSize / 250;
   if (thickness == 0) thickness = 1;
   fontsize = baseSize * 0.6 / 200;
+}
+
+void initializeImage(cv::Mat image, int* indent, int* areaSize, float& fontsize, int& thickness, int& lticks, int& sticks, cv::Point& left_top, cv::Point& right_top, cv::Point& left_bottom, cv::Point& right_bottom) {
+  calcFontSize(areaSize, fontsize, thickness);
   //============== ticks length =====================
   lticks = areaSize[0] * 8 / 200;
   if(lticks == 0) lticks = 2;
@@ -737,7 +908,8 @@ int calcMagnification(int Xdiv, int Ydiv) {
 
 string getCurrentTime() {
   time_t now = time(NULL);
-  struct tm *pnow = localtime(&now);
+  struct tm tnow;
+  struct tm *pnow = localtime_r(&now, &tnow);//images are rendered on several threads
   char week[7][4] = {"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
   stringstream ss;
   char mdstr[100];
@@ -0,0 +1,113 @@
+#include "spatialsim/outputRaw.h"
+#include "spatialsim/mystruct.h"
+#include "spatialsim/searchFunction.h"
+#include "sbml/SBMLTypes.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+LIBSBML_CPP_NAMESPACE_USE
+
+const string RINGFILENAME = "TimeCourseData.ring";
+
+#define RING_PAGE_SIZE 4096
+#define RING_SLOT_ALIGN 64
+
+struct _ringWriter {
+	int fd;
+	char *map;
+	size_t mapSize;
+	ringFileHeader *header;
+	vector<variableInfo*> infoList;
+	size_t numOfValues;//per species
+};
+
+static size_t alignSize(size_t size, size_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+ringWriter* openRingWriter(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xindex, int Yindex, int Zindex, int dimension, unsigned int numOfFrames, std::string fname, std::string outpath)
+{
+	unsigned int i;
+	const uint16_t endian = 1;
+	if (*reinterpret_cast<const unsigned char*>(&endian) != 1) {
+		cerr << "error: " << RINGFILENAME << " is little-endian and this host is not" << endl;
+		exit(1);
+	}
+	ringWriter *writer = new ringWriter;
+	writer->numOfValues = static_cast<size_t>(Xindex) * Yindex * Zindex;
+	for (i = 0; i < los->size(); i++) {
+		writer->infoList.push_back(searchInfoById(varInfoList, los->get(i)->getId().c_str()));
+	}
+	size_t headerSize = alignSize(sizeof(ringFileHeader) + los->size() * sizeof(ringSpeciesEntry), RING_PAGE_SIZE);
+	size_t frameSize = alignSize(sizeof(ringFrameHeader) + los->size() * writer->numOfValues * sizeof(double), RING_SLOT_ALIGN);
+	writer->mapSize = headerSize + numOfFrames * frameSize;
+
+	string path = outpath + "/result/" + fname + "/" + RINGFILENAME;
+	writer->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (writer->fd < 0 || ftruncate(writer->fd, static_cast<off_t>(writer->mapSize)) != 0) {
+		cerr << "error: cannot create " << path << " (" << strerror(errno) << ")" << endl;
+		exit(1);
+	}
+	void *map = mmap(0, writer->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+	if (map == MAP_FAILED) {
+		cerr << "error: cannot map " << path << " (" << strerror(errno) << ")" << endl;
+		exit(1);
+	}
+	writer->map = static_cast<char*>(map);
+	writer->header = reinterpret_cast<ringFileHeader*>(writer->map);
+
+	//the file is zero filled by ftruncate, so every slot starts with seq = 0 (empty)
+	ringFileHeader *header = writer->header;
+	header->version = 1;
+	header->headerSize = static_cast<uint32_t>(headerSize);
+	header->dimension = dimension;
+	header->numOfSpecies = static_cast<uint32_t>(los->size());
+	header->Xindex = Xindex;
+	header->Yindex = Yindex;
+	header->Zindex = Zindex;
+	header->numOfFrames = numOfFrames;
+	header->frameSize = frameSize;
+	header->writeCount = 0;
+	ringSpeciesEntry *entry = reinterpret_cast<ringSpeciesEntry*>(writer->map + sizeof(ringFileHeader));
+	for (i = 0; i < los->size(); i++) {
+		strncpy(entry[i].id, los->get(i)->getId().c_str(), RING_ID_LENGTH - 1);
+		entry[i].inVol = writer->infoList[i]->inVol;
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(header->magic, RING_MAGIC, sizeof(header->magic));
+	return writer;
+}
+
+void pushRingFrame(ringWriter *writer, double sim_time)
+{
+	ringFileHeader *header = writer->header;
+	uint64_t n = header->writeCount;
+	char *slot = writer->map + header->headerSize + (n % header->numOfFrames) * header->frameSize;
+	ringFrameHeader *frame = reinterpret_cast<ringFrameHeader*>(slot);
+	__atomic_store_n(&frame->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	frame->sim_time = sim_time;
+	double *data = reinterpret_cast<double*>(slot + sizeof(ringFrameHeader));
+	for (unsigned int i = 0; i < writer->infoList.size(); i++) {
+		memcpy(data + i * writer->numOfValues, writer->infoList[i]->value, writer->numOfValues * sizeof(double));
+	}
+	__atomic_store_n(&frame->seq, 2 * n + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->writeCount, n + 1, __ATOMIC_RELEASE);
+}
+
+void closeRingWriter(ringWriter *writer)
+{
+	msync(writer->map, writer->mapSize, MS_SYNC);
+	munmap(writer->map, writer->mapSize);
+	close(writer->fd);
+	delete writer;
+}
@@ -0,0 +1,332 @@
+#include "spatialsim/rosenbrockFunction.h"
+#include "spatialsim/mystruct.h"
+#include "spatialsim/astFunction.h"
+#include "spatialsim/calcPDE.h"
+#include "sbml/SBMLTypes.h"
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+LIBSBML_CPP_NAMESPACE_USE
+
+//ros2 (verwer et al.), second order and l-stable for any approximation of the jacobian
+#define ROS2_GAMMA (1.0 + M_SQRT1_2)
+#define EQ_MAX_ITER 50
+#define EQ_TOLERANCE 1.0e-12
+#define EQ_DAMPING 1.0e-10//relative to the largest diagonal of W^T W
+
+static unsigned int addSystemSpecies(reactionSystemInfo *rsInfo, variableInfo *sInfo)
+{
+	for (unsigned int q = 0; q < rsInfo->spList.size(); q++) {
+		if (rsInfo->spList[q] == sInfo) return q;
+	}
+	rsInfo->spList.push_back(sInfo);
+	return static_cast<unsigned int>(rsInfo->spList.size() - 1);
+}
+
+static vector<int> mapSystemVars(const bytecodeInfo *bc, const reactionSystemInfo *rsInfo)
+{
+	vector<int> varMap(bc->varList.size(), -1);
+	for (unsigned int v = 0; v < bc->varList.size(); v++) {
+		for (unsigned int q = 0; q < rsInfo->spList.size(); q++) {
+			if (bc->varList[v] == rsInfo->spList[q]->value) varMap[v] = static_cast<int>(q);
+		}
+	}
+	return varMap;
+}
+
+//the system of geoi, created on first use
+static reactionSystemInfo* getReactionSystem(vector<reactionSystemInfo*> &systemList, vector<vector<const ASTNode*> > &systemASTList, GeometryInfo *geoi, unsigned int &k)
+{
+	for (k = 0; k < systemList.size(); k++) {
+		if (systemList[k]->geoi == geoi) return systemList[k];
+	}
+	reactionSystemInfo *rsInfo = new reactionSystemInfo;
+	rsInfo->geoi = geoi;
+	rsInfo->stoichBegin.push_back(0);
+	systemList.push_back(rsInfo);
+	systemASTList.push_back(vector<const ASTNode*>());
+	return rsInfo;
+}
+
+static void addSystemRate(reactionSystemInfo *rsInfo, reactionInfo *rInfo, unsigned int numOfReactants, bool isRateRule)
+{
+	//modifiers follow the reactants and products in spRefList but have no stoichiometry
+	for (unsigned int q = 0; q < rInfo->srStoichiometry.size(); q++) {
+		if (!rInfo->isVariable[q]) continue;
+		rsInfo->stoichSpecies.push_back(addSystemSpecies(rsInfo, rInfo->spRefList[q]));
+		rsInfo->stoichCoef.push_back((q < numOfReactants && !isRateRule) ? -rInfo->srStoichiometry[q] : rInfo->srStoichiometry[q]);
+	}
+	rsInfo->rateList.push_back(rInfo->bcInfo);
+	rsInfo->stoichBegin.push_back(static_cast<unsigned int>(rsInfo->stoichSpecies.size()));
+}
+
+//d rate r / d spList[q] of every rate
+static void setSystemJacobian(reactionSystemInfo *rsInfo, const vector<const ASTNode*> &astList, vector<variableInfo*> &varInfoList)
+{
+	unsigned int r, q;
+	unsigned int n = static_cast<unsigned int>(rsInfo->spList.size());
+	rsInfo->jacList.assign(rsInfo->rateList.size() * n, static_cast<bytecodeInfo*>(0));
+	rsInfo->jacVarMap.resize(rsInfo->rateList.size() * n);
+	for (r = 0; r < rsInfo->rateList.size(); r++) {
+		rsInfo->rateVarMap.push_back(mapSystemVars(rsInfo->rateList[r], rsInfo));
+		for (q = 0; q < n; q++) {
+			ASTNode *derivative = differentiateAST(astList[r], rsInfo->spList[q]->id);
+			bytecodeInfo *bc = compileAST(derivative, varInfoList, false);
+			delete derivative;
+			if (bc->code.empty() && bc->result < bc->paramBase && bc->constPool[bc->result] == 0.0) {
+				delete bc;
+				continue;
+			}
+			rsInfo->jacList[r * n + q] = bc;
+			rsInfo->jacVarMap[r * n + q] = mapSystemVars(bc, rsInfo);
+		}
+	}
+}
+
+void setReactionSystems(Model *model, executionPlan *plan, vector<variableInfo*> &varInfoList)
+{
+	unsigned int i, k;
+	vector<reactionSystemInfo*> &systemList = plan->systemList;
+	vector<vector<const ASTNode*> > systemASTList;
+	for (i = 0; i < plan->reactionList.size() + plan->rateRuleList.size(); i++) {
+		bool isRateRule = (i >= plan->reactionList.size());
+		reactionPlan *rPlan = (isRateRule) ? &(plan->rateRuleList[i - plan->reactionList.size()]) : &(plan->reactionList[i]);
+		reactionInfo *rInfo = rPlan->rInfo;
+		//membrane transport couples the points of two geometries and stays explicit
+		if (rInfo->isMemTransport) continue;
+		reactionSystemInfo *rsInfo = getReactionSystem(systemList, systemASTList, rPlan->geoi, k);
+		addSystemRate(rsInfo, rInfo, rPlan->numOfReactants, isRateRule);
+		systemASTList[k].push_back((isRateRule) ? model->getRule(rInfo->id)->getMath() : rInfo->reaction->getKineticLaw()->getMath());
+		rPlan->isImplicit = true;
+	}
+	for (k = 0; k < systemList.size(); k++) {
+		setSystemJacobian(systemList[k], systemASTList[k], varInfoList);
+		cout << "ros2: " << systemList[k]->rateList.size() << " rates of " << systemList[k]->spList.size() << " species in " << systemList[k]->geoi->domainTypeId << endl;
+	}
+}
+
+void setFastReactionSystems(executionPlan *plan, vector<reactionInfo*> &fast_rInfoList, vector<variableInfo*> &varInfoList)
+{
+	unsigned int i, k;
+	vector<reactionSystemInfo*> &systemList = plan->fastSystemList;
+	vector<vector<const ASTNode*> > systemASTList;
+	for (i = 0; i < fast_rInfoList.size(); i++) {
+		reactionInfo *rInfo = fast_rInfoList[i];
+		if (rInfo->isMemTransport) {
+			cerr << "warning: fast membrane transport " << rInfo->id << " is not supported, it is ignored" << endl;
+			continue;
+		}
+		reactionSystemInfo *rsInfo = getReactionSystem(systemList, systemASTList, rInfo->spRefList[0]->geoi, k);
+		addSystemRate(rsInfo, rInfo, rInfo->reaction->getNumReactants(), false);
+		systemASTList[k].push_back(rInfo->reaction->getKineticLaw()->getMath());
+	}
+	for (k = 0; k < systemList.size(); k++) {
+		setSystemJacobian(systemList[k], systemASTList[k], varInfoList);
+		cout << "fast reaction: " << systemList[k]->rateList.size() << " reactions of " << systemList[k]->spList.size() << " species in " << systemList[k]->geoi->domainTypeId << endl;
+	}
+}
+
+static double evaluateSystemBytecode(const bytecodeInfo *bc, const vector<int> &varMap, double *reg, const double *y, unsigned int index)
+{
+	for (unsigned int v = 0; v < varMap.size(); v++) {
+		reg[bc->varBase + v] = (varMap[v] >= 0) ? y[varMap[v]] : bc->varList[v][index];
+	}
+	return executeBytecode(bc, reg);
+}
+
+//f(y) of one point
+static void calcSystemRates(const reactionSystemInfo *rsInfo, vector<vector<double> > &regList, const double *y, unsigned int index, double *f)
+{
+	unsigned int r, s;
+	fill_n(f, rsInfo->spList.size(), 0.0);
+	for (r = 0; r < rsInfo->rateList.size(); r++) {
+		double rate = evaluateSystemBytecode(rsInfo->rateList[r], rsInfo->rateVarMap[r], &regList[r][0], y, index);
+		for (s = rsInfo->stoichBegin[r]; s < rsInfo->stoichBegin[r + 1]; s++) {
+			f[rsInfo->stoichSpecies[s]] += rsInfo->stoichCoef[s] * rate;
+		}
+	}
+}
+
+//lu decomposition with partial pivoting, false if w is singular
+static bool decomposeLU(double *w, int *pivot, int n)
+{
+	int i, j, k;
+	for (k = 0; k < n; k++) {
+		int p = k;
+		for (i = k + 1; i < n; i++) {
+			if (fabs(w[i * n + k]) > fabs(w[p * n + k])) p = i;
+		}
+		if (fabs(w[p * n + k]) < DBL_MIN) return false;
+		pivot[k] = p;
+		if (p != k) {
+			for (j = 0; j < n; j++) swap(w[k * n + j], w[p * n + j]);
+		}
+		for (i = k + 1; i < n; i++) {
+			double l = w[i * n + k] / w[k * n + k];
+			w[i * n + k] = l;
+			for (j = k + 1; j < n; j++) w[i * n + j] -= l * w[k * n + j];
+		}
+	}
+	return true;
+}
+
+static void solveLU(const double *w, const int *pivot, int n, double *b)
+{
+	int i, j;
+	for (i = 0; i < n; i++) {
+		if (pivot[i] != i) swap(b[i], b[pivot[i]]);
+		for (j = 0; j < i; j++) b[i] -= w[i * n + j] * b[j];
+	}
+	for (i = n - 1; i >= 0; i--) {
+		for (j = i + 1; j < n; j++) b[i] -= w[i * n + j] * b[j];
+		b[i] /= w[i * n + i];
+	}
+}
+
+//(W^T W + mu I) dx = -W^T v, when W is singular (dependent fast reactions, or a point where a rate
+//does not depend on the extents) the step goes along the extents that change v. false if none does
+static bool solveDampedLeastSquares(const double *jw, const double *v, double *dx, double *w, int *pivot, int n)
+{
+	int i, j, k;
+	double mu = 0.0;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			w[i * n + j] = 0.0;
+			for (k = 0; k < n; k++) w[i * n + j] += jw[k * n + i] * jw[k * n + j];
+		}
+		mu = max(mu, w[i * n + i]);
+	}
+	if (mu < DBL_MIN) return false;
+	for (i = 0; i < n; i++) {
+		w[i * n + i] += EQ_DAMPING * mu;
+		dx[i] = 0.0;
+		for (k = 0; k < n; k++) dx[i] -= jw[k * n + i] * v[k];
+	}
+	if (!decomposeLU(w, pivot, n)) return false;
+	solveLU(w, pivot, n, dx);
+	return true;
+}
+
+//(I - gamma * dt * J) k1 = f(y), (I - gamma * dt * J) k2 = f(y + dt * k1) - 2 * k1, y += dt * (3 * k1 + k2) / 2
+//the points are independent, so they are shared among the threads
+void calcRosenbrock(reactionSystemInfo *rsInfo, double dt)
+{
+	int n = static_cast<int>(rsInfo->spList.size());
+	int numOfRates = static_cast<int>(rsInfo->rateList.size());
+	int numOfDomainIndexes = static_cast<int>(rsInfo->geoi->domainIndex.size());
+#pragma omp parallel
+	{
+		int i, q, r;
+		vector<double> y0(n), y1(n), f(n), k1(n), k2(n), w(n * n);
+		vector<int> pivot(n);
+		//registers of the rates and of the jacobian, uniform values do not change during the step
+		vector<vector<double> > regList(numOfRates), jacRegList(rsInfo->jacList.size());
+		for (r = 0; r < numOfRates; r++) loadBytecodeRegisters(rsInfo->rateList[r], regList[r]);
+		for (i = 0; i < static_cast<int>(rsInfo->jacList.size()); i++) {
+			if (rsInfo->jacList[i] != 0) loadBytecodeRegisters(rsInfo->jacList[i], jacRegList[i]);
+		}
+#pragma omp for schedule(dynamic, 64)
+		for (int j = 0; j < numOfDomainIndexes; j++) {
+			unsigned int index = rsInfo->geoi->domainIndex[j];
+			for (q = 0; q < n; q++) y0[q] = rsInfo->spList[q]->value[index];
+			calcSystemRates(rsInfo, regList, &y0[0], index, &f[0]);
+			//w = I - gamma * dt * J
+			fill(w.begin(), w.end(), 0.0);
+			for (r = 0; r < numOfRates; r++) {
+				for (q = 0; q < n; q++) {
+					const bytecodeInfo *bc = rsInfo->jacList[r * n + q];
+					if (bc == 0) continue;
+					double dRate = evaluateSystemBytecode(bc, rsInfo->jacVarMap[r * n + q], &jacRegList[r * n + q][0], &y0[0], index);
+					for (unsigned int s = rsInfo->stoichBegin[r]; s < rsInfo->stoichBegin[r + 1]; s++) {
+						w[rsInfo->stoichSpecies[s] * n + q] -= ROS2_GAMMA * dt * rsInfo->stoichCoef[s] * dRate;
+					}
+				}
+			}
+			for (q = 0; q < n; q++) w[q * n + q] += 1.0;
+			if (!decomposeLU(&w[0], &pivot[0], n)) {//explicit euler
+				for (q = 0; q < n; q++) rsInfo->spList[q]->value[index] = y0[q] + dt * f[q];
+				continue;
+			}
+			k1 = f;
+			solveLU(&w[0], &pivot[0], n, &k1[0]);
+			for (q = 0; q < n; q++) y1[q] = y0[q] + dt * k1[q];
+			calcSystemRates(rsInfo, regList, &y1[0], index, &k2[0]);
+			for (q = 0; q < n; q++) k2[q] -= 2.0 * k1[q];
+			solveLU(&w[0], &pivot[0], n, &k2[0]);
+			for (q = 0; q < n; q++) rsInfo->spList[q]->value[index] = y0[q] + dt * (1.5 * k1[q] + 0.5 * k2[q]);
+		}
+	}
+}
+
+//rapid equilibrium: the fast rates v(y) are driven to 0 by newton on the reaction extents x, y = y0 + N x,
+//so the conservation laws of the stoichiometry N hold exactly
+void calcRapidEquilibrium(reactionSystemInfo *rsInfo)
+{
+	int n = static_cast<int>(rsInfo->spList.size());
+	int numOfRates = static_cast<int>(rsInfo->rateList.size());
+	int numOfDomainIndexes = static_cast<int>(rsInfo->geoi->domainIndex.size());
+	int numOfSingular = 0;//points where no extent changes the fast rates
+#pragma omp parallel reduction(+:numOfSingular)
+	{
+		int i, q, r, it;
+		vector<double> y(n), dy(n), v(numOfRates), dx(numOfRates), dvdy(numOfRates * n), w(numOfRates * numOfRates), jw(numOfRates * numOfRates);
+		vector<int> pivot(numOfRates);
+		vector<vector<double> > regList(numOfRates), jacRegList(rsInfo->jacList.size());
+		for (r = 0; r < numOfRates; r++) loadBytecodeRegisters(rsInfo->rateList[r], regList[r]);
+		for (i = 0; i < static_cast<int>(rsInfo->jacList.size()); i++) {
+			if (rsInfo->jacList[i] != 0) loadBytecodeRegisters(rsInfo->jacList[i], jacRegList[i]);
+		}
+#pragma omp for schedule(dynamic, 64)
+		for (int j = 0; j < numOfDomainIndexes; j++) {
+			unsigned int index = rsInfo->geoi->domainIndex[j];
+			for (q = 0; q < n; q++) y[q] = rsInfo->spList[q]->value[index];
+			for (it = 0; it < EQ_MAX_ITER; it++) {
+				for (r = 0; r < numOfRates; r++) {
+					v[r] = evaluateSystemBytecode(rsInfo->rateList[r], rsInfo->rateVarMap[r], &regList[r][0], &y[0], index);
+					for (q = 0; q < n; q++) {
+						const bytecodeInfo *bc = rsInfo->jacList[r * n + q];
+						dvdy[r * n + q] = (bc == 0) ? 0.0 : evaluateSystemBytecode(bc, rsInfo->jacVarMap[r * n + q], &jacRegList[r * n + q][0], &y[0], index);
+					}
+				}
+				//w = dv/dy * N
+				fill(w.begin(), w.end(), 0.0);
+				for (r = 0; r < numOfRates; r++) {
+					for (int s = 0; s < numOfRates; s++) {
+						for (unsigned int t = rsInfo->stoichBegin[s]; t < rsInfo->stoichBegin[s + 1]; t++) {
+							w[r * numOfRates + s] += dvdy[r * n + rsInfo->stoichSpecies[t]] * rsInfo->stoichCoef[t];
+						}
+					}
+				}
+				jw = w;
+				if (decomposeLU(&w[0], &pivot[0], numOfRates)) {
+					for (r = 0; r < numOfRates; r++) dx[r] = -v[r];
+					solveLU(&w[0], &pivot[0], numOfRates, &dx[0]);
+				} else if (!solveDampedLeastSquares(&jw[0], &v[0], &dx[0], &w[0], &pivot[0], numOfRates)) {
+					numOfSingular++;
+					break;
+				}
+				fill(dy.begin(), dy.end(), 0.0);
+				for (r = 0; r < numOfRates; r++) {
+					for (unsigned int t = rsInfo->stoichBegin[r]; t < rsInfo->stoichBegin[r + 1]; t++) dy[rsInfo->stoichSpecies[t]] += rsInfo->stoichCoef[t] * dx[r];
+				}
+				//the step is shortened so that no concentration becomes negative
+				double lambda = 1.0, change = 0.0;
+				for (q = 0; q < n; q++) {
+					if (y[q] >= 0.0 && y[q] + dy[q] < 0.0) lambda = min(lambda, 0.99 * y[q] / -dy[q]);
+				}
+				for (q = 0; q < n; q++) {
+					y[q] += lambda * dy[q];
+					change = max(change, fabs(lambda * dy[q]) / (fabs(y[q]) + EQ_TOLERANCE));
+				}
+				if (change < EQ_TOLERANCE) break;
+			}
+			for (q = 0; q < n; q++) rsInfo->spList[q]->value[index] = y[q];
+		}
+	}
+	if (numOfSingular > 0) {
+		cerr << "warning: the fast reactions in " << rsInfo->geoi->domainTypeId << " do not depend on their extents at " << numOfSingular << " points, the equilibrium is not reached there" << endl;
+	}
+}
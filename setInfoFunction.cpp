@@ -8,6 +8,7 @@
 #include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
 #include <vector>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 LIBSBML_CPP_NAMESPACE_USE
@@ -292,7 +293,6 @@ void setReactionInfo(Model *model, std::vector<variableInfo*> &varInfoList, vect
 	unsigned int numOfReactions = static_cast<unsigned int>(model->getNumReactions());
 	unsigned int i, j, k;
 	ASTNode *ast = 0;
-	unsigned int numOfASTNodes = 0;
 	Species *s;
 	for (i = 0; i < numOfReactions; i++) {
 		Reaction *r = lor->get(i);
@@ -372,20 +372,7 @@ void setReactionInfo(Model *model, std::vector<variableInfo*> &varInfoList, vect
       } else {
         cout << "mem trans: " << SBML_formulaToString(ast) << endl;
       }
-      numOfASTNodes = 0;
-      countAST(ast, numOfASTNodes);
-      //cerr << "num_of_nodes: " << numOfASTNodes << endl;
-      rInfo->rpInfo = new reversePolishInfo();
-      rInfo->rpInfo->varList = new double*[numOfASTNodes];
-      fill_n(rInfo->rpInfo->varList, numOfASTNodes, reinterpret_cast<double*>(0));
-      rInfo->rpInfo->deltaList = new double*[numOfASTNodes];
-      fill_n(rInfo->rpInfo->deltaList, numOfASTNodes, reinterpret_cast<double*>(0));
-      rInfo->rpInfo->constList = new double*[numOfASTNodes];
-      fill_n(rInfo->rpInfo->constList, numOfASTNodes, reinterpret_cast<double*>(0));
-      rInfo->rpInfo->opfuncList = new int[numOfASTNodes];
-      fill_n(rInfo->rpInfo->opfuncList, numOfASTNodes, 0);
-      rInfo->rpInfo->listNum = numOfASTNodes;
-      parseAST(ast, rInfo->rpInfo, varInfoList, numOfASTNodes);
+      rInfo->bcInfo = compileAST(ast, varInfoList, true);
       if (!r->getFast()) {
         rInfoList.push_back(rInfo);
       } else {
@@ -400,31 +387,20 @@ void setRateRuleInfo(Model *model, std::vector<variableInfo*> &varInfoList, std:
 	unsigned int numOfRules = static_cast<unsigned int>(model->getNumRules());
 	unsigned int i;
 	ASTNode *ast = 0;
-	unsigned int numOfASTNodes = 0;
 	Species *s;
 	for (i = 0; i < numOfRules; i++) {
 		if (model->getRule(i)->isRate()) {
 			RateRule *rrule = static_cast<RateRule*>(model->getRule(i));
 			reactionInfo *rInfo = new reactionInfo;
+			rInfo->reaction = 0;
+			rInfo->isMemTransport = false;
 			rInfo->id = rrule->getVariable().c_str();
 			rInfo->value = new double[numOfVolIndexes];
 			fill_n(rInfo->value, numOfVolIndexes, 0);
 			ast = const_cast<ASTNode*>(rrule->getMath());
 			rearrangeAST(ast);
 			cout << "rate rule: " << SBML_formulaToString(ast) << endl;
-			numOfASTNodes = 0;
-			countAST(ast, numOfASTNodes);
-			rInfo->rpInfo = new reversePolishInfo();
-			rInfo->rpInfo->varList = new double*[numOfASTNodes];
-			fill_n(rInfo->rpInfo->varList, numOfASTNodes, reinterpret_cast<double*>(0));
-			rInfo->rpInfo->deltaList = new double*[numOfASTNodes];
-			fill_n(rInfo->rpInfo->deltaList, numOfASTNodes, reinterpret_cast<double*>(0));
-			rInfo->rpInfo->constList = new double*[numOfASTNodes];
-			fill_n(rInfo->rpInfo->constList, numOfASTNodes, reinterpret_cast<double*>(0));
-			rInfo->rpInfo->opfuncList = new int[numOfASTNodes];
-			fill_n(rInfo->rpInfo->opfuncList, numOfASTNodes, 0);
-			rInfo->rpInfo->listNum = numOfASTNodes;
-			parseAST(ast, rInfo->rpInfo, varInfoList, numOfASTNodes);
+			rInfo->bcInfo = compileAST(ast, varInfoList, true);
 			rInfo->spRefList.push_back(searchInfoById(varInfoList, rrule->getVariable().c_str()));
 			rInfo->srStoichiometry.push_back(1.0);
 			s = model->getSpecies(rrule->getVariable());
@@ -438,9 +414,428 @@ void setRateRuleInfo(Model *model, std::vector<variableInfo*> &varInfoList, std:
 	}
 }
 
+executionPlan* setExecutionPlan(Model *model, std::vector<variableInfo*> &varInfoList, std::vector<GeometryInfo*> &geoInfoList, std::vector<reactionInfo*> &rInfoList, std::vector<variableInfo*> &orderedARule, GeometryInfo *allAreaInfo)
+{
+	unsigned int i, j, k;
+	executionPlan *plan = new executionPlan;
+	ListOfSpecies *los = model->getListOfSpecies();
+	//species
+	for (i = 0; i < model->getNumSpecies(); i++) {
+		Species *s = los->get(i);
+		speciesPlan sPlan;
+		sPlan.sInfo = searchInfoById(varInfoList, s->getId().c_str());
+		sPlan.isVariable = (!s->isSetConstant() || !s->getConstant());
+		sPlan.hasVolDiffusion = (sPlan.sInfo->diffCInfo != 0 && sPlan.sInfo->geoi->isVol);
+		sPlan.hasMemDiffusion = (sPlan.sInfo->diffCInfo != 0 && !sPlan.sInfo->geoi->isVol);
+		sPlan.hasAdvection = (sPlan.sInfo->adCInfo != 0);
+		sPlan.hasBoundary = (sPlan.sInfo->boundaryInfo != 0);
+		sPlan.idInfo = 0;
+		sPlan.numOfDiffSteps = 1;
+		sPlan.numOfAdSteps = 1;
+		sPlan.pseudoMemTable = -1;
+		for (k = 0; k < 6; k++) {
+			sPlan.bcKind[k] = SPATIAL_BOUNDARYKIND_INVALID;
+			if (sPlan.hasBoundary && sPlan.sInfo->boundaryInfo[k] != 0 && sPlan.sInfo->boundaryInfo[k]->para != 0) {
+				SpatialParameterPlugin *pPlugin = static_cast<SpatialParameterPlugin*>(sPlan.sInfo->boundaryInfo[k]->para->getPlugin("spatial"));
+				sPlan.bcKind[k] = pPlugin->getBoundaryCondition()->getType();
+			}
+		}
+		plan->speciesList.push_back(sPlan);
+	}
+	//reaction and rate rule
+	for (i = 0; i < rInfoList.size(); i++) {
+		reactionInfo *rInfo = rInfoList[i];
+		reactionPlan rPlan;
+		rPlan.rInfo = rInfo;
+		rPlan.geoi = rInfo->spRefList[0]->geoi;
+		rPlan.isImplicit = false;
+		if (rInfo->reaction == 0) {//rate rule
+			rPlan.numOfReactants = 1;
+			plan->rateRuleList.push_back(rPlan);
+			continue;
+		}
+		Reaction *r = rInfo->reaction;
+		rPlan.numOfReactants = r->getNumReactants();
+		if (rInfo->isMemTransport) {
+			GeometryInfo *reactantGeo = rInfo->spRefList[0]->geoi;
+			GeometryInfo *productGeo = rInfo->spRefList[r->getNumReactants()]->geoi;
+			for (j = 0; j < geoInfoList.size(); j++) {
+				if (!geoInfoList[j]->isVol) {
+					if ((geoInfoList[j]->adjacentGeo1 == reactantGeo && geoInfoList[j]->adjacentGeo2 == productGeo)
+					    || (geoInfoList[j]->adjacentGeo1 == productGeo && geoInfoList[j]->adjacentGeo2 == reactantGeo)) {//mem transport
+						rPlan.memGeoList.push_back(geoInfoList[j]);
+						break;
+					}
+				}
+			}
+			if (reactantGeo->isVol ^ productGeo->isVol) {
+				if (!reactantGeo->isVol) rPlan.memGeoList.push_back(reactantGeo);
+				if (!productGeo->isVol) rPlan.memGeoList.push_back(productGeo);
+			}
+		}
+		plan->reactionList.push_back(rPlan);
+	}
+	//assignment rule
+	for (i = 0; i < orderedARule.size(); i++) {
+		variableInfo *info = orderedARule[i];
+		assignmentPlan aPlan;
+		aPlan.info = info;
+		if (info->sp != 0) {
+			aPlan.indexList = &(info->geoi->domainIndex);
+			aPlan.isAllArea = false;
+		} else if (info->para != 0 && (static_cast<SpatialParameterPlugin*>(info->para->getPlugin("spatial")))->isSpatialParameter()) {
+			aPlan.indexList = &(info->geoi->domainIndex);
+			aPlan.isAllArea = false;
+		} else {
+			aPlan.indexList = &(allAreaInfo->domainIndex);
+			aPlan.isAllArea = true;
+		}
+		plan->assignmentList.push_back(aPlan);
+	}
+	return plan;
+}
+
+//bit when the point step points away on the axis is inside the grid and the domain
+static unsigned short getStencilBit(const int *isD, int index, int coord, int size, int step, int stride, unsigned short bit)
+{
+	return (coord + step >= 0 && coord + step < size && isD[index + step * stride] == 1) ? bit : 0;
+}
+
+//the kernels of the time loop reach the neighbors by constant strides, the coordinates of each point are
+//only needed for these tests, which do not change during the run
+void setStencilMasks(std::vector<GeometryInfo*> &geoInfoList, int Xindex, int Yindex, int Zindex, unsigned int dimension)
+{
+	for (unsigned int i = 0; i < geoInfoList.size(); i++) {
+		GeometryInfo *geoInfo = geoInfoList[i];
+		const int *isD = geoInfo->isDomain;
+		geoInfo->stencilMask.assign(geoInfo->domainIndex.size(), 0);
+		for (unsigned int j = 0; j < geoInfo->domainIndex.size(); j++) {
+			int index = geoInfo->domainIndex[j];
+			int Z = index / (Xindex * Yindex);
+			int Y = (index - Z * Xindex * Yindex) / Xindex;
+			int X = index - Z * Xindex * Yindex - Y * Xindex;
+			unsigned short mask = 0;
+			mask |= getStencilBit(isD, index, X, Xindex, 2, 1, STENCIL_XP2) | getStencilBit(isD, index, X, Xindex, -2, 1, STENCIL_XM2);
+			mask |= getStencilBit(isD, index, Y, Yindex, 2, Xindex, STENCIL_YP2) | getStencilBit(isD, index, Y, Yindex, -2, Xindex, STENCIL_YM2);
+			mask |= getStencilBit(isD, index, Z, Zindex, 2, Xindex * Yindex, STENCIL_ZP2) | getStencilBit(isD, index, Z, Zindex, -2, Xindex * Yindex, STENCIL_ZM2);
+			mask |= getStencilBit(isD, index, X, Xindex, 4, 1, STENCIL_XP4) | getStencilBit(isD, index, X, Xindex, -4, 1, STENCIL_XM4);
+			mask |= getStencilBit(isD, index, Y, Yindex, 4, Xindex, STENCIL_YP4) | getStencilBit(isD, index, Y, Yindex, -4, Xindex, STENCIL_YM4);
+			mask |= getStencilBit(isD, index, Z, Zindex, 4, Xindex * Yindex, STENCIL_ZP4) | getStencilBit(isD, index, Z, Zindex, -4, Xindex * Yindex, STENCIL_ZM4);
+			if (!((dimension == 3 && (X * Y * Z == 0 || X == Xindex - 1 || Y == Yindex - 1 || Z == Zindex - 1))
+			      || (dimension == 2 && (X * Y == 0 || X == Xindex - 1 || Y == Yindex - 1)))) {
+				mask |= STENCIL_INTERIOR;
+			}
+			geoInfo->stencilMask[j] = mask;
+		}
+	}
+}
+
+//the pair of membrane points copied to each pseudo membrane point does not change during the run,
+//so the choice is made once here, in the same order of precedence as before
+void setPseudoMemTables(executionPlan *plan, int Xindex, int Yindex, int Zindex, unsigned int dimension)
+{
+	unsigned int i, j, k;
+	for (i = 0; i < plan->speciesList.size(); i++) {
+		GeometryInfo *geoInfo = plan->speciesList[i].sInfo->geoi;
+		if (geoInfo->isVol) continue;
+		//species of the same membrane share the table
+		for (k = 0; k < i; k++) {
+			if (plan->speciesList[k].sInfo->geoi == geoInfo) break;
+		}
+		if (k < i) {
+			plan->speciesList[i].pseudoMemTable = plan->speciesList[k].pseudoMemTable;
+			continue;
+		}
+		plan->speciesList[i].pseudoMemTable = static_cast<int>(plan->pseudoMemTableList.size());
+		plan->pseudoMemTableList.push_back(vector<pseudoMemEntry>());
+		vector<pseudoMemEntry> &table = plan->pseudoMemTableList.back();
+		table.reserve(geoInfo->pseudoMemIndex.size());
+		const int *isD = geoInfo->isDomain;
+		for (j = 0; j < geoInfo->pseudoMemIndex.size(); j++) {
+			int index = geoInfo->pseudoMemIndex[j];
+			int Z = index / (Xindex * Yindex);
+			int Y = (index - Z * Xindex * Yindex) / Xindex;
+			int X = index - Z * Xindex * Yindex - Y * Xindex;
+			int Xplus1 = Z * Yindex * Xindex + Y * Xindex + (X + 1);
+			int Xminus1 = Z * Yindex * Xindex + Y * Xindex + (X - 1);
+			int Yplus1 = Z * Yindex * Xindex + (Y + 1) * Xindex + X;
+			int Yminus1 = Z * Yindex * Xindex + (Y - 1) * Xindex + X;
+			int Zplus1 = (Z + 1) * Yindex * Xindex + Y * Xindex + X;
+			int Zminus1 = (Z - 1) * Yindex * Xindex + Y * Xindex + X;
+			//candidate pairs, the pairs with z are only for 3d
+			const int pairList[15][3] = {
+				{Xplus1, Xminus1, 0}, {Yplus1, Yminus1, 0}, {Zplus1, Zminus1, 1},
+				{Xplus1, Yplus1, 0}, {Xplus1, Yminus1, 0}, {Xplus1, Zplus1, 1}, {Xplus1, Zminus1, 1},
+				{Xminus1, Yplus1, 0}, {Xminus1, Yminus1, 0}, {Xminus1, Zplus1, 1}, {Xminus1, Zminus1, 1},
+				{Yplus1, Zplus1, 1}, {Yplus1, Zminus1, 1}, {Yminus1, Zplus1, 1}, {Yminus1, Zminus1, 1}
+			};
+			for (k = 0; k < 15; k++) {
+				if (pairList[k][2] == 1 && dimension != 3) continue;
+				if (isD[pairList[k][0]] == 1 && isD[pairList[k][1]] == 1) {
+					pseudoMemEntry e = {index, pairList[k][0], pairList[k][1]};
+					table.push_back(e);
+					break;
+				}
+			}
+		}
+	}
+}
+
+//membrane points of one plane ("xy", "yz" or "xz") ordered along their contours
+typedef struct _membraneContour {
+  std::string plane;
+  int sH, sV, horIndex, verIndex;//strides and sizes of the grid coordinates of the plane
+  std::vector<int> order;//positions in domainIndex, contour by contour
+  std::vector<int> hor, ver;//grid coordinates of order
+  std::vector<int> dir;//+1: oneStepSearch finds the next element first, -1: the previous one, 0: not a simple chain
+  std::vector<int> numOfBranches;//elements of order before i with dir == 0
+  std::vector<int> contourOf;//contour of each element of order
+  std::vector<int> begin;//first element of each contour, and order.size()
+  std::vector<bool> isClosed;
+  std::vector<double> maxRadius;//max|r_i - r_j| / 2 over each contour, contours that meet count as one
+  std::vector<int> elementOf;//element of order of each membrane point, -1: not traced
+}membraneContour;
+
+//directions of preDirection (N, NE, E, SE, S, SW, W, NW) in grid coordinates of the plane
+static const int dirHor[8] = {0, 1, 2, 1, 0, -1, -2, -1};
+static const int dirVer[8] = {2, 1, 0, -1, -2, -1, 0, 1};
+
+//the contour goes on from index in the direction d (the neighbor test of oneStepSearch)
+static bool isContourStep(const int *isD, const membraneContour &mc, int index, int hor, int ver, int d)
+{
+  int nextHor = hor + dirHor[d], nextVer = ver + dirVer[d];
+  if (nextHor < 0 || nextHor >= mc.horIndex || nextVer < 0 || nextVer >= mc.verIndex) return false;
+  if (isD[index + dirHor[d] * mc.sH + dirVer[d] * mc.sV] != 1) return false;
+  //a straight step crosses a pseudo membrane point
+  return d % 2 != 0 || isD[index + dirHor[d] / 2 * mc.sH + dirVer[d] / 2 * mc.sV] == 2;
+}
+
+//walk the contour from index with the rule of stepSearch until it meets a traced point (the start
+//when the contour is closed), returns the index of that point or -1 at the end of an open contour
+static int traceContour(const int *isD, const vector<int> &posOf, membraneContour &mc, int index, int hor, int ver, unsigned int numOfMem)
+{
+  int preD = -1, d;
+  for (unsigned int k = 0; k < numOfMem; k++) {
+    int pos = posOf[index];
+    if (pos < 0 || mc.elementOf[pos] >= 0) return index;
+    mc.elementOf[pos] = mc.order.size();
+    mc.order.push_back(pos);
+    mc.hor.push_back(hor);
+    mc.ver.push_back(ver);
+    for (d = 0; d < 8; d++) {
+      if ((preD < 0 || d != (preD + 4) % 8) && isContourStep(isD, mc, index, hor, ver, d)) break;
+    }
+    if (d == 8) return -1;
+    index += dirHor[d] * mc.sH + dirVer[d] * mc.sV;
+    hor += dirHor[d];
+    ver += dirVer[d];
+    preD = d;
+  }
+  return index;
+}
+
+//|r_i - r_j| / 2 for the grid offsets dh, dv (twice the offsets in units of the grid size)
+static double halfDistance(int dh, int dv, double hHor, double hVer)
+{
+  return sqrt(pow(dh * hHor / 2.0, 2) + pow(dv * hVer / 2.0, 2)) / 2.0;
+}
+
+//contour that c was merged into
+static int findContour(vector<int> &mergedTo, int c)
+{
+  while (mergedTo[c] != c) c = mergedTo[c] = mergedTo[mergedTo[c]];
+  return c;
+}
+
+//orders elements of the order by their grid coordinates
+struct contourElementLess {
+  const membraneContour &mc;
+  contourElementLess(const membraneContour &mc) : mc(mc) {}
+  bool operator()(int a, int b) const { return mc.hor[a] < mc.hor[b] || (mc.hor[a] == mc.hor[b] && mc.ver[a] < mc.ver[b]); }
+};
+
+//(b - a) x (c - a) in grid coordinates of the plane
+static long crossProduct(const membraneContour &mc, int a, int b, int c)
+{
+  return static_cast<long>(mc.hor[b] - mc.hor[a]) * (mc.ver[c] - mc.ver[a]) - static_cast<long>(mc.ver[b] - mc.ver[a]) * (mc.hor[c] - mc.hor[a]);
+}
+
+//max|r_i - r_j| / 2 over the given elements of the order. the farthest pair is on the convex hull
+//(monotone chain), and is found by rotating calipers. the grid size scales the hull without
+//changing which pairs are antipodal, so the hull is built in grid coordinates
+static double getContourRadius(const membraneContour &mc, vector<int> &elements, double hHor, double hVer)
+{
+  int n = elements.size(), k = 0, i, j, next;
+  vector<int> hull(2 * n);
+  double max_radius = 0.0;
+  sort(elements.begin(), elements.end(), contourElementLess(mc));
+  for (i = 0; i < n; i++) {//lower hull
+    while (k >= 2 && crossProduct(mc, hull[k - 2], hull[k - 1], elements[i]) <= 0) k--;
+    hull[k++] = elements[i];
+  }
+  for (i = n - 2, j = k + 1; i >= 0; i--) {//upper hull
+    while (k >= j && crossProduct(mc, hull[k - 2], hull[k - 1], elements[i]) <= 0) k--;
+    hull[k++] = elements[i];
+  }
+  if (n < 2) return 0.0;
+  k--;//the last point is the first one
+  if (k == 2) return halfDistance(mc.hor[hull[1]] - mc.hor[hull[0]], mc.ver[hull[1]] - mc.ver[hull[0]], hHor, hVer);
+  for (i = 0, j = 1; i < k; i++) {
+    next = (i + 1) % k;
+    //the hull point farthest from the edge (i, next)
+    while (crossProduct(mc, hull[i], hull[next], hull[(j + 1) % k]) > crossProduct(mc, hull[i], hull[next], hull[j])) j = (j + 1) % k;
+    max_radius = max(max_radius, halfDistance(mc.hor[hull[j]] - mc.hor[hull[i]], mc.ver[hull[j]] - mc.ver[hull[i]], hHor, hVer));
+    max_radius = max(max_radius, halfDistance(mc.hor[hull[j]] - mc.hor[hull[next]], mc.ver[hull[j]] - mc.ver[hull[next]], hHor, hVer));
+    //an edge parallel to (i, next) has two farthest points
+    if (crossProduct(mc, hull[i], hull[next], hull[(j + 1) % k]) == crossProduct(mc, hull[i], hull[next], hull[j])) {
+      max_radius = max(max_radius, halfDistance(mc.hor[hull[(j + 1) % k]] - mc.hor[hull[i]], mc.ver[hull[(j + 1) % k]] - mc.ver[hull[i]], hHor, hVer));
+    }
+  }
+  return max_radius;
+}
+
+//max|r_i - r_j| / 2 of the contour of the membrane point j
+static double getMaxRadius(const membraneContour &mc, unsigned int j)
+{
+  return (mc.elementOf[j] >= 0) ? mc.maxRadius[mc.contourOf[mc.elementOf[j]]] : 0.0;
+}
+
+/*
+  order the membrane points of a plane along their contours. each contour is traced once
+  (an open one from its end), then for every membrane point
+  - which neighbor oneStepSearch takes first, so r_i+k and r_i-k are read from the order
+  and max|r_i - r_j| / 2 of every contour, with the contours that meet merged into one
+  posOf holds the position of the membrane points in domainIndex and -1 elsewhere.
+*/
+static void setMembraneContour(GeometryInfo *geoInfo, const vector<int> &posOf, string plane, int Xindex, int Yindex, int Zindex, double hHor, double hVer, membraneContour &mc)
+{
+  unsigned int j, numOfMem = geoInfo->domainIndex.size();
+  int X, Y, Z, index, first, length, d, e, c, numOfNeighbors, neighbor[2];
+  const int *isD = geoInfo->isDomain;
+  vector<int> mergedTo, metContour;
+  vector<vector<int> > elementsOf;
+  mc.plane = plane;
+  mc.sH = (plane == "yz") ? Xindex : 1;
+  mc.sV = (plane == "xy") ? Xindex : Xindex * Yindex;
+  mc.horIndex = (plane == "yz") ? Yindex : Xindex;
+  mc.verIndex = (plane == "xy") ? Yindex : Zindex;
+  mc.order.clear();
+  mc.hor.clear();
+  mc.ver.clear();
+  mc.contourOf.clear();
+  mc.begin.assign(1, 0);
+  mc.isClosed.clear();
+  mc.elementOf.assign(numOfMem, -1);
+  for (j = 0; j < numOfMem; j++) {
+    boundaryType &bt = geoInfo->bType[geoInfo->domainIndex[j]];
+    bool isXplane = bt.isBofXp && bt.isBofXm, isYplane = bt.isBofYp && bt.isBofYm, isZplane = bt.isBofZp && bt.isBofZm;
+    if (mc.elementOf[j] >= 0) continue;
+    if ((plane == "xy" && !(isXplane || isYplane)) || (plane == "yz" && !(isYplane || isZplane)) || (plane == "xz" && !(isXplane || isZplane))) continue;
+    index = geoInfo->domainIndex[j];
+    Z = index / (Xindex * Yindex);
+    Y = (index - Z * Xindex * Yindex) / Xindex;
+    X = index - Z * Xindex * Yindex - Y * Xindex;
+    first = mc.order.size();
+    int stopIndex = traceContour(isD, posOf, mc, index, (plane == "yz") ? Y : X, (plane == "xy") ? Y : Z, numOfMem);
+    bool isClosed = (stopIndex == index);
+    int met = (stopIndex >= 0 && posOf[stopIndex] >= 0) ? mc.elementOf[posOf[stopIndex]] : -1;
+    if (stopIndex < 0 && mc.order.size() - first > 1) {//open contour, trace it again from the end
+      int endHor = mc.hor.back(), endVer = mc.ver.back();
+      int endIndex = geoInfo->domainIndex[mc.order.back()];
+      for (e = first; e < static_cast<int>(mc.order.size()); e++) mc.elementOf[mc.order[e]] = -1;
+      mc.order.resize(first);
+      mc.hor.resize(first);
+      mc.ver.resize(first);
+      stopIndex = traceContour(isD, posOf, mc, endIndex, endHor, endVer, numOfMem);
+      met = (stopIndex >= 0 && posOf[stopIndex] >= 0) ? mc.elementOf[posOf[stopIndex]] : -1;
+      isClosed = false;
+    }
+    mc.begin.push_back(mc.order.size());
+    mc.isClosed.push_back(isClosed);
+    mc.contourOf.resize(mc.order.size(), mc.isClosed.size() - 1);
+    //the trace stopped at a point of an earlier contour
+    mergedTo.push_back(mc.isClosed.size() - 1);
+    metContour.push_back((met >= 0 && met < first) ? mc.contourOf[met] : -1);
+  }
+  //max|r_i - r_j| / 2 once per contour
+  for (c = 0; c < static_cast<int>(mc.isClosed.size()); c++) {
+    if (metContour[c] >= 0) mergedTo[findContour(mergedTo, c)] = findContour(mergedTo, metContour[c]);
+  }
+  elementsOf.resize(mc.isClosed.size());
+  for (e = 0; e < static_cast<int>(mc.order.size()); e++) elementsOf[findContour(mergedTo, mc.contourOf[e])].push_back(e);
+  mc.maxRadius.assign(mc.isClosed.size(), 0.0);
+  for (c = 0; c < static_cast<int>(mc.isClosed.size()); c++) {
+    if (!elementsOf[c].empty()) mc.maxRadius[c] = getContourRadius(mc, elementsOf[c], hHor, hVer);
+  }
+  for (c = 0; c < static_cast<int>(mc.isClosed.size()); c++) mc.maxRadius[c] = mc.maxRadius[findContour(mergedTo, c)];
+  //the first neighbor of oneStepSearch, when the contour is a simple chain at the element
+  mc.dir.assign(mc.order.size(), 0);
+  mc.numOfBranches.assign(mc.order.size() + 1, 0);
+  for (e = 0; e < static_cast<int>(mc.order.size()); e++) {
+    int next = e + 1, prev = e - 1;
+    c = mc.contourOf[e];
+    first = mc.begin[c];
+    length = mc.begin[c + 1] - first;
+    if (mc.isClosed[c]) {
+      next = first + (e - first + 1) % length;
+      prev = first + (e - first + length - 1) % length;
+    }
+    index = geoInfo->domainIndex[mc.order[e]];
+    numOfNeighbors = 0;
+    for (d = 0; d < 8; d++) {
+      if (isContourStep(isD, mc, index, mc.hor[e], mc.ver[e], d)) {
+        if (numOfNeighbors < 2) neighbor[numOfNeighbors] = posOf[index + dirHor[d] * mc.sH + dirVer[d] * mc.sV];
+        numOfNeighbors++;
+      }
+    }
+    if (numOfNeighbors == 2 && length > 2 && next < first + length && prev >= first) {
+      if (neighbor[0] == mc.order[next] && neighbor[1] == mc.order[prev]) mc.dir[e] = 1;
+      else if (neighbor[0] == mc.order[prev] && neighbor[1] == mc.order[next]) mc.dir[e] = -1;
+    }
+    mc.numOfBranches[e + 1] = mc.numOfBranches[e] + ((mc.dir[e] == 0) ? 1 : 0);
+  }
+}
+
+//r_i+k and r_i-k (in the order of oneStepSearch) read from the ordered contour;
+//oneStepSearch walks the grid where the contour around r_i is not a simple chain
+static void contourStepSearch(const membraneContour &mc, unsigned int j, int step_k, int X, int Y, int Z, int Xindex, int Yindex, int Zindex, int *horComponent, int *verComponent, int *isD)
+{
+  int e = mc.elementOf[j], k = max(step_k, 1);
+  if (e >= 0) {
+    int c = mc.contourOf[e], first = mc.begin[c], length = mc.begin[c + 1] - first, p = e - first;
+    int numOfBranches = -1;
+    if (mc.isClosed[c] && 2 * k + 1 >= length) {
+      numOfBranches = mc.numOfBranches[first + length] - mc.numOfBranches[first];
+    } else if (mc.isClosed[c]) {
+      int lo = p - k, hi = p + k + 1;//[lo, hi) wrapped around the contour
+      if (lo < 0) numOfBranches = mc.numOfBranches[first + hi] - mc.numOfBranches[first] + mc.numOfBranches[first + length] - mc.numOfBranches[first + length + lo];
+      else if (hi > length) numOfBranches = mc.numOfBranches[first + length] - mc.numOfBranches[first + lo] + mc.numOfBranches[first + hi - length] - mc.numOfBranches[first];
+      else numOfBranches = mc.numOfBranches[first + hi] - mc.numOfBranches[first + lo];
+    } else if (p - k >= 0 && p + k < length) {
+      numOfBranches = mc.numOfBranches[first + p + k + 1] - mc.numOfBranches[first + p - k];
+    }
+    if (numOfBranches == 0) {
+      int forward = first + ((p + mc.dir[e] * k) % length + length) % length;
+      int backward = first + ((p - mc.dir[e] * k) % length + length) % length;
+      horComponent[0] = mc.hor[forward];
+      verComponent[0] = mc.ver[forward];
+      horComponent[1] = mc.hor[backward];
+      verComponent[1] = mc.ver[backward];
+    } else {
+      oneStepSearch(1, step_k, X, Y, Z, Xindex, Yindex, Zindex, horComponent, verComponent, isD, mc.plane);
+    }
+  } else {
+    oneStepSearch(1, step_k, X, Y, Z, Xindex, Yindex, Zindex, horComponent, verComponent, isD, mc.plane);
+  }
+  //the two walks met (around branches or on a short loop), take the largest k where they do not
+  if (step_k > 1 && horComponent[0] == horComponent[1] && verComponent[0] == verComponent[1]) {
+    contourStepSearch(mc, j, step_k - 1, X, Y, Z, Xindex, Yindex, Zindex, horComponent, verComponent, isD);
+  }
+}
+
 normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double Xsize, double Ysize, double Zsize, int dimension, int Xindex, int Yindex, int Zindex, unsigned int numOfVolIndexes)
 {
-  unsigned int i, j, k, step_kXY = 0, step_kYZ = 0, step_kXZ = 0;
+  unsigned int i, j, step_kXY = 0, step_kYZ = 0, step_kXZ = 0;
   int X, Y, Z, index;
   normalUnitVector *nuVec = new normalUnitVector[numOfVolIndexes];
   int *isD = 0;
@@ -448,8 +843,8 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
   double X1 = 0.0, X2 = 0.0, Y1 = 0.0, Y2 = 0.0, Z1 = 0.0, Z2 = 0.0, len, rhoXY = 0.0, rhoYZ = 0.0, rhoXZ = 0.0;
   double a = 0.0, b = 0.0, c = 0.0;//length of triangle
   double max_radiusXY = 0.0, max_radiusYZ = 0.0, max_radiusXZ = 0.0;
-  int startX, startY, startZ;
-  int preD = -1;
+  vector<int> posOf(numOfVolIndexes, -1);//position in domainIndex
+  membraneContour contourXY, contourYZ, contourXZ;
   int Xdiv = (Xindex + 1) / 2;
   int Ydiv = (Yindex + 1) / 2;
   int Zdiv = (Zindex + 1) / 2;
@@ -486,161 +881,24 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
       geoInfo = geoInfoList[i];
       isD = geoInfo->isDomain;
       if (geoInfo->isVol == false) {//avol is membrane
-        //calc max_radius
+        //order the membrane contours once, instead of walking the contour from every point
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = j;
+        setMembraneContour(geoInfo, posOf, "xy", Xindex, Yindex, Zindex, hX, hY, contourXY);
+        if (dimension == 3) {
+          setMembraneContour(geoInfo, posOf, "yz", Xindex, Yindex, Zindex, hY, hZ, contourYZ);
+          setMembraneContour(geoInfo, posOf, "xz", Xindex, Yindex, Zindex, hX, hZ, contourXZ);
+        }
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = -1;
         for (j = 0; j < geoInfo->domainIndex.size(); j++) {
           index = geoInfo->domainIndex[j];
           Z = index / (Xindex * Yindex);
           Y = (index - Z * Xindex * Yindex) / Xindex;
           X = index - Z * Xindex * Yindex - Y * Xindex;
-          startX = X;
-          startY = Y;
-          startZ = Z;
-          preD = -1;
           //calc max|r_i - r_j|
-          max_radiusXY = 0.0;
-          max_radiusYZ = 0.0;
-          max_radiusXZ = 0.0;
-          if ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) {//xy plane
-            for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-              if ((Y + 2 < Yindex) &&
-                  (isD[Z * Yindex * Xindex + (Y + 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y + 1) * Xindex + X] == 2 && preD != S)) {//north
-                //X = X;//self assign
-                Y = Y + 2;
-                preD = N;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X + 1)] == 1 && preD != SW) {//northeast
-                X = X + 1;
-                Y = Y + 1;
-                preD = NE;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X + 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X + 1)] == 2 && preD != W) {//east
-                X = X + 2;
-                //Y = Y;//self assign
-                preD = E;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X + 1)] == 1 && preD != NW) {//southeast
-                X = X + 1;
-                Y = Y - 1;
-                preD = SE;
-              } else if ((Y - 2 >= 0) &&
-                         (isD[Z * Yindex * Xindex + (Y - 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y - 1) * Xindex + X] == 2 && preD != N)) {//south
-                //X = X;//self assign
-                Y = Y - 2;
-                preD = S;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X - 1)] == 1 && preD != NE) {//southwest
-                X = X - 1;
-                Y = Y - 1;
-                preD = SW;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X - 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X - 1)] == 2 && preD != E) {//west
-                X = X - 2;
-                //Y = Y;//self assign
-                preD = W;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X - 1)] == 1 && preD != SE) {//northwest
-                X = X - 1;
-                Y = Y + 1;
-                preD = NW;
-              }
-              max_radiusXY = max(max_radiusXY, sqrt(pow(((X - startX) / 2) * hX, 2) + pow(((Y - startY) / 2) * hY, 2)) / 2.0);
-              if (X == startX && Y == startY) {
-                break;
-              }
-            }
-          }
-          X = startX;
-          Y = startY;
-          Z = startZ;
-          preD = -1;
+          max_radiusXY = ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) ? getMaxRadius(contourXY, j) : 0.0;//xy plane
           if (dimension == 3) {
-            if ((geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) {//yz plane
-              for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-                if ((Z + 2 < Zindex) &&
-                    (isD[(Z + 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z + 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != S)) {//north
-                  //Y = Y;//self assign
-                  Z = Z + 2;
-                  preD = N;
-                } else if (isD[(Z + 1) * Yindex * Xindex + (Y + 1) * Xindex + X] == 1 && preD != SW) {//northeast
-                  Y = Y + 1;
-                  Z = Z + 1;
-                  preD = NE;
-                } else if (isD[Z * Yindex * Xindex + (Y + 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y + 1) * Xindex + X] == 2 && preD != W) {//east
-                  Y = Y + 2;
-                  //Z = Z;//self assign
-                  preD = E;
-                } else if (isD[(Z - 1) * Yindex * Xindex + (Y + 1) * Xindex + X] == 1 && preD != NW) {//southeast
-                  Y = Y + 1;
-                  Z = Z - 1;
-                  preD = SE;
-                } else if ((Z - 2 >= 0) &&
-                           (isD[(Z - 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z - 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != N)) {//south
-                  //Y = Y;//self assign
-                  Z = Z - 2;
-                  preD = S;
-                } else if (isD[(Z - 1) * Yindex * Xindex + (Y - 1) * Xindex + X] == 1 && preD != NE) {//southwest
-                  Y = Y - 1;
-                  Z = Z - 1;
-                  preD = SW;
-                } else if (isD[Z * Yindex * Xindex + (Y - 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y - 1) * Xindex + X] == 2 && preD != E) {//west
-                  Y = Y - 2;
-                  //Z = Z;//self assign
-                  preD = W;
-                } else if (isD[(Z + 1) * Yindex * Xindex + (Y - 1) * Xindex + X] == 1 && preD != SE) {//northwest
-                  Y = Y - 1;
-                  Z = Z + 1;
-                  preD = NW;
-                }
-                max_radiusYZ = max(max_radiusYZ, sqrt(pow(((Y - startY) / 2) * hY, 2) + pow(((Z - startZ) / 2) * hZ, 2)) / 2.0);
-                if (Y == startY && Z == startZ) {
-                  break;
-                }
-              }
-            }
-            X = startX;
-            Y = startY;
-            Z = startZ;
-            preD = -1;
-            if ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) {//xz plane
-              for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-                if ((Z + 2 < Zindex) &&
-                    (isD[(Z + 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z + 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != S)) {//north
-                  //X = X;//self assign
-                  Z = Z + 2;
-                  preD = N;
-                } else if (isD[(Z + 1) * Yindex * Xindex + Y * Xindex + (X + 1)] == 1 && preD != SW) {//northeast
-                  X = X + 1;
-                  Z = Z + 1;
-                  preD = NE;
-                } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X + 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X + 1)] == 2 && preD != W) {//east
-                  X = X + 2;
-                  //Z = Z;//self assign
-                  preD = E;
-                } else if (isD[(Z - 1) * Yindex * Xindex + Y * Xindex + (X + 1)] == 1 && preD != NW) {//southeast
-                  X = X + 1;
-                  Z = Z - 1;
-                  preD = SE;
-                } else if ((Z - 2 >= 0) &&
-                           (isD[(Z - 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z - 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != N)) {//south
-                  //X = X;//self assign
-                  Z = Z - 2;
-                  preD = S;
-                } else if (isD[(Z - 1) * Yindex * Xindex + Y * Xindex + (X - 1)] == 1 && preD != NE) {//southwest
-                  X = X - 1;
-                  Z = Z - 1;
-                  preD = SW;
-                } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X - 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X - 1)] == 2 && preD != E) {//west
-                  X = X - 2;
-                  //Z = Z;//self assign
-                  preD = W;
-                } else if (isD[(Z + 1) * Yindex * Xindex + Y * Xindex + (X - 1)] == 1 && preD != SE) {//northwest
-                  X = X - 1;
-                  Z = Z + 1;
-                  preD = NW;
-                }
-                max_radiusXZ = max(max_radiusXZ, sqrt(pow(((X - startX) / 2) * hX, 2) + pow(((Z - startZ) / 2) * hZ, 2)) / 2.0);
-                if (X == startX && Z == startZ) {
-                  break;
-                }
-              }
-            }
-            X = startX;
-            Y = startY;
-            Z = startZ;
+            max_radiusYZ = ((geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) ? getMaxRadius(contourYZ, j) : 0.0;//yz plane
+            max_radiusXZ = ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) ? getMaxRadius(contourXZ, j) : 0.0;//xz plane
           }
           /* calc local radius of curvature */
           //calc tmp step_k to calc local radius of curvature
@@ -655,7 +913,7 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
           if (step_kXZ == 0) step_kXZ = 1;
           if ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) {//xy plane
             //calc the radius of circumscribed circle
-            oneStepSearch(1, step_kXY, X, Y, Z, Xindex, Yindex, Zindex, xyPlaneX, xyPlaneY, isD, "xy");
+            contourStepSearch(contourXY, j, step_kXY, X, Y, Z, Xindex, Yindex, Zindex, xyPlaneX, xyPlaneY, isD);
             a = sqrt(pow(((X - xyPlaneX[0]) * hX) / 2.0, 2) + pow(((Y - xyPlaneY[0]) * hY) / 2.0, 2));
             b = sqrt(pow(((X - xyPlaneX[1]) * hX) / 2.0, 2) + pow(((Y - xyPlaneY[1]) * hY) / 2.0, 2));
             c = sqrt(pow(((xyPlaneX[0] - xyPlaneX[1]) * hX) / 2.0, 2) + pow(((xyPlaneY[0] - xyPlaneY[1]) * hY) / 2.0, 2));
@@ -672,13 +930,13 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
             //cout << X / 2 * hX << " " << Y / 2 * hY << " " << step_kXY << endl;
             //cout << X / 2 * hX << " " << Y / 2 * hY << " " << rhoXY << " " << max_radiusXY << " " << hXY << endl;
             //calc tangent vector
-            oneStepSearch(1, step_kXY, X, Y, Z, Xindex, Yindex, Zindex, xyPlaneX, xyPlaneY, isD, "xy");
+            contourStepSearch(contourXY, j, step_kXY, X, Y, Z, Xindex, Yindex, Zindex, xyPlaneX, xyPlaneY, isD);
           }
           if (dimension == 3) {
             //yz-plane
             if ((geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) {//yz plane
               //calc the radius of circumscribed circle
-              oneStepSearch(1, step_kYZ, X, Y, Z, Xindex, Yindex, Zindex, yzPlaneY, yzPlaneZ, isD, "yz");
+              contourStepSearch(contourYZ, j, step_kYZ, X, Y, Z, Xindex, Yindex, Zindex, yzPlaneY, yzPlaneZ, isD);
               a = sqrt(pow(((Y - yzPlaneY[0]) * hY) / 2.0, 2) + pow(((Z - yzPlaneZ[0]) * hZ) / 2.0, 2));
               b = sqrt(pow(((Y - yzPlaneY[1]) * hY) / 2.0, 2) + pow(((Z - yzPlaneZ[1]) * hZ) / 2.0, 2));
               c = sqrt(pow(((yzPlaneY[0] - yzPlaneY[1]) * hY) / 2.0, 2) + pow(((yzPlaneZ[0] - yzPlaneZ[1]) * hZ) / 2.0, 2));
@@ -692,12 +950,12 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
                 //step_kYZ = static_cast<int>(pow((rhoYZ / hYZ), 2.0 / 3.0));
               }
               //calc tangent vector
-              oneStepSearch(1, step_kYZ, X, Y, Z, Xindex, Yindex, Zindex, yzPlaneY, yzPlaneZ, isD, "yz");
+              contourStepSearch(contourYZ, j, step_kYZ, X, Y, Z, Xindex, Yindex, Zindex, yzPlaneY, yzPlaneZ, isD);
             }
             //xz-plane
             if ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) {//xz plane
               //calc the radius of circumscribed circle
-              oneStepSearch(1, step_kXZ, X, Y, Z, Xindex, Yindex, Zindex, xzPlaneX, xzPlaneZ, isD, "xz");
+              contourStepSearch(contourXZ, j, step_kXZ, X, Y, Z, Xindex, Yindex, Zindex, xzPlaneX, xzPlaneZ, isD);
               a = sqrt(pow(((X - xzPlaneX[0]) * hX) / 2.0, 2) + pow(((Z - xzPlaneZ[0]) * hZ) / 2.0, 2));
               b = sqrt(pow(((X - xzPlaneX[1]) * hX) / 2.0, 2) + pow(((Z - xzPlaneZ[1]) * hZ) / 2.0, 2));
               c = sqrt(pow(((xzPlaneX[0] - xzPlaneX[1]) * hX) / 2.0, 2) + pow(((xzPlaneZ[0] - xzPlaneZ[1]) * hZ) / 2.0, 2));
@@ -711,7 +969,7 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
                 //step_kXZ = static_cast<int>(pow((rhoXZ / hXZ), 2.0 / 3.0));
               }
               //calc tangent vector
-              oneStepSearch(1, step_kXZ, X, Y, Z, Xindex, Yindex, Zindex, xzPlaneX, xzPlaneZ, isD, "xz");
+              contourStepSearch(contourXZ, j, step_kXZ, X, Y, Z, Xindex, Yindex, Zindex, xzPlaneX, xzPlaneZ, isD);
             }
           }
 
@@ -826,7 +1084,7 @@ normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double
 
 normalUnitVector* setNormalAngle_modify(std::vector<GeometryInfo*> &geoInfoList, double Xsize, double Ysize, double Zsize, int dimension, int Xindex, int Yindex, int Zindex, unsigned int numOfVolIndexes)
 {
-  unsigned int i, j, k, step_kXY = 0, step_kYZ = 0, step_kXZ = 0;
+  unsigned int i, j, step_kXY = 0, step_kYZ = 0, step_kXZ = 0;
   int X, Y, Z, index;
   normalUnitVector *nuVec = new normalUnitVector[numOfVolIndexes];
   int *isD = 0;
@@ -834,8 +1092,8 @@ normalUnitVector* setNormalAngle_modify(std::vector<GeometryInfo*> &geoInfoList,
   double X1 = 0.0, X2 = 0.0, Y1 = 0.0, Y2 = 0.0, Z1 = 0.0, Z2 = 0.0, len, rhoXY = 0.0, rhoYZ = 0.0, rhoXZ = 0.0;
   double a = 0.0, b = 0.0, c = 0.0;//length of triangle
   double max_radiusXY = 0.0, max_radiusYZ = 0.0, max_radiusXZ = 0.0;
-  int startX, startY, startZ;
-  int preD = -1;
+  vector<int> posOf(numOfVolIndexes, -1);//position in domainIndex
+  membraneContour contourXY, contourYZ, contourXZ;
   int Xdiv = (Xindex + 1) / 2;
   int Ydiv = (Yindex + 1) / 2;
   int Zdiv = (Zindex + 1) / 2;
@@ -858,67 +1116,17 @@ normalUnitVector* setNormalAngle_modify(std::vector<GeometryInfo*> &geoInfoList,
       geoInfo = geoInfoList[i];
       isD = geoInfo->isDomain;
       if (geoInfo->isVol == false) {//avol is membrane
-        //calc max_radius
+        //order the membrane contours once, instead of walking the contour from every point
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = j;
+        setMembraneContour(geoInfo, posOf, "xy", Xindex, Yindex, Zindex, hX, hY, contourXY);
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = -1;
         for (j = 0; j < geoInfo->domainIndex.size(); j++) {
           index = geoInfo->domainIndex[j];
           Z = index / (Xindex * Yindex);
           Y = (index - Z * Xindex * Yindex) / Xindex;
           X = index - Z * Xindex * Yindex - Y * Xindex;
-          startX = X;
-          startY = Y;
-          startZ = Z;
-          preD = -1;
           //calc max|r_i - r_j|
-          max_radiusXY = 0.0;
-          max_radiusYZ = 0.0;
-          max_radiusXZ = 0.0;
-          if ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) {//xy plane
-            for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-              if ((Y + 2 < Yindex) &&
-                  (isD[Z * Yindex * Xindex + (Y + 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y + 1) * Xindex + X] == 2 && preD != S)) {//north
-                //X = X;//self assign
-                Y = Y + 2;
-                preD = N;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X + 1)] == 1 && preD != SW) {//northeast
-                X = X + 1;
-                Y = Y + 1;
-                preD = NE;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X + 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X + 1)] == 2 && preD != W) {//east
-                X = X + 2;
-                //Y = Y;//self assign
-                preD = E;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X + 1)] == 1 && preD != NW) {//southeast
-                X = X + 1;
-                Y = Y - 1;
-                preD = SE;
-              } else if ((Y - 2 >= 0) &&
-                         (isD[Z * Yindex * Xindex + (Y - 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y - 1) * Xindex + X] == 2 && preD != N)) {//south
-                //X = X;//self assign
-                Y = Y - 2;
-                preD = S;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X - 1)] == 1 && preD != NE) {//southwest
-                X = X - 1;
-                Y = Y - 1;
-                preD = SW;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X - 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X - 1)] == 2 && preD != E) {//west
-                X = X - 2;
-                //Y = Y;//self assign
-                preD = W;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X - 1)] == 1 && preD != SE) {//northwest
-                X = X - 1;
-                Y = Y + 1;
-                preD = NW;
-              }
-              max_radiusXY = max(max_radiusXY, sqrt(pow(((X - startX) / 2) * hX, 2) + pow(((Y - startY) / 2) * hY, 2)) / 2.0);
-              if (X == startX && Y == startY) {
-                break;
-              }
-            }
-          }
-          X = startX;
-          Y = startY;
-          Z = startZ;
-          preD = -1;
+          max_radiusXY = ((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) ? getMaxRadius(contourXY, j) : 0.0;//xy plane
 
           /* calc local radius of curvature */
           //calc tmp step_k to calc local radius of curvature
@@ -977,147 +1185,21 @@ normalUnitVector* setNormalAngle_modify(std::vector<GeometryInfo*> &geoInfoList,
       geoInfo = geoInfoList[i];
       isD = geoInfo->isDomain;
       if (geoInfo->isVol == false) {//avol is membrane
-        //calc max_radius
+        //order the membrane contours once, instead of walking the contour from every point
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = j;
+        setMembraneContour(geoInfo, posOf, "xy", Xindex, Yindex, Zindex, hX, hY, contourXY);
+        setMembraneContour(geoInfo, posOf, "yz", Xindex, Yindex, Zindex, hY, hZ, contourYZ);
+        setMembraneContour(geoInfo, posOf, "xz", Xindex, Yindex, Zindex, hX, hZ, contourXZ);
+        for (j = 0; j < geoInfo->domainIndex.size(); j++) posOf[geoInfo->domainIndex[j]] = -1;
         for (j = 0; j < geoInfo->domainIndex.size(); j++) {
           index = geoInfo->domainIndex[j];
           Z = index / (Xindex * Yindex);
           Y = (index - Z * Xindex * Yindex) / Xindex;
           X = index - Z * Xindex * Yindex - Y * Xindex;
-          startX = X;
-          startY = Y;
-          startZ = Z;
-          preD = -1;
-          max_radiusXY = 0.0;
-          max_radiusYZ = 0.0;
-          max_radiusXZ = 0.0;
-          if (((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) && !(geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) {//xy plane
-            for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-              if ((Y + 2 < Yindex) &&
-                  (isD[Z * Yindex * Xindex + (Y + 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y + 1) * Xindex + X] == 2 && preD != S)) {//north
-                Y = Y + 2;
-                preD = N;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X + 1)] == 1 && preD != SW) {//northeast
-                X = X + 1;
-                Y = Y + 1;
-                preD = NE;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X + 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X + 1)] == 2 && preD != W) {//east
-                X = X + 2;
-                preD = E;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X + 1)] == 1 && preD != NW) {//southeast
-                X = X + 1;
-                Y = Y - 1;
-                preD = SE;
-              } else if ((Y - 2 >= 0) &&
-                  (isD[Z * Yindex * Xindex + (Y - 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y - 1) * Xindex + X] == 2 && preD != N)) {//south
-                Y = Y - 2;
-                preD = S;
-              } else if (isD[Z * Yindex * Xindex + (Y - 1) * Xindex + (X - 1)] == 1 && preD != NE) {//southwest
-                X = X - 1;
-                Y = Y - 1;
-                preD = SW;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X - 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X - 1)] == 2 && preD != E) {//west
-                X = X - 2;
-                preD = W;
-              } else if (isD[Z * Yindex * Xindex + (Y + 1) * Xindex + (X - 1)] == 1 && preD != SE) {//northwest
-                X = X - 1;
-                Y = Y + 1;
-                preD = NW;
-              }
-              max_radiusXY = max(max_radiusXY, sqrt(pow(((X - startX) / 2) * hX, 2) + pow(((Y - startY) / 2) * hY, 2)) / 2.0);
-              if (X == startX && Y == startY) {
-                break;
-              }
-            }
-          }
-          X = startX;
-          Y = startY;
-          Z = startZ;
-          preD = -1;
-          if (((geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) && !(geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm)) {//yz plane
-            for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-              if ((Z + 2 < Zindex) &&
-                  (isD[(Z + 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z + 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != S)) {//north
-                Z = Z + 2;
-                preD = N;
-              } else if (isD[(Z + 1) * Yindex * Xindex + (Y + 1) * Xindex + X] == 1 && preD != SW) {//northeast
-                Y = Y + 1;
-                Z = Z + 1;
-                preD = NE;
-              } else if (isD[Z * Yindex * Xindex + (Y + 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y + 1) * Xindex + X] == 2 && preD != W) {//east
-                Y = Y + 2;
-                preD = E;
-              } else if (isD[(Z - 1) * Yindex * Xindex + (Y + 1) * Xindex + X] == 1 && preD != NW) {//southeast
-                Y = Y + 1;
-                Z = Z - 1;
-                preD = SE;
-              } else if ((Z - 2 >= 0) &&
-                  (isD[(Z - 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z - 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != N)) {//south
-                Z = Z - 2;
-                preD = S;
-              } else if (isD[(Z - 1) * Yindex * Xindex + (Y - 1) * Xindex + X] == 1 && preD != NE) {//southwest
-                Y = Y - 1;
-                Z = Z - 1;
-                preD = SW;
-              } else if (isD[Z * Yindex * Xindex + (Y - 2) * Xindex + X] == 1 && isD[Z * Yindex * Xindex + (Y - 1) * Xindex + X] == 2 && preD != E) {//west
-                Y = Y - 2;
-                preD = W;
-              } else if (isD[(Z + 1) * Yindex * Xindex + (Y - 1) * Xindex + X] == 1 && preD != SE) {//northwest
-                Y = Y - 1;
-                Z = Z + 1;
-                preD = NW;
-              }
-              max_radiusYZ = max(max_radiusYZ, sqrt(pow(((Y - startY) / 2) * hY, 2) + pow(((Z - startZ) / 2) * hZ, 2)) / 2.0);
-              if (Y == startY && Z == startZ) {
-                break;
-              }
-            }
-          }
-          X = startX;
-          Y = startY;
-          Z = startZ;
-          preD = -1;
-          if (((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) && !(geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) {//xz plane
-            for (k = 0; k < geoInfo->domainIndex.size(); k++) {
-              if ((Z + 2 < Zindex) &&
-                  (isD[(Z + 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z + 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != S)) {//north
-                Z = Z + 2;
-                preD = N;
-              } else if (isD[(Z + 1) * Yindex * Xindex + Y * Xindex + (X + 1)] == 1 && preD != SW) {//northeast
-                X = X + 1;
-                Z = Z + 1;
-                preD = NE;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X + 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X + 1)] == 2 && preD != W) {//east
-                X = X + 2;
-                preD = E;
-              } else if (isD[(Z - 1) * Yindex * Xindex + Y * Xindex + (X + 1)] == 1 && preD != NW) {//southeast
-                X = X + 1;
-                Z = Z - 1;
-                preD = SE;
-              } else if ((Z - 2 >= 0) &&
-                  (isD[(Z - 2) * Yindex * Xindex + Y * Xindex + X] == 1 && isD[(Z - 1) * Yindex * Xindex + Y * Xindex + X] == 2 && preD != N)) {//south
-                Z = Z - 2;
-                preD = S;
-              } else if (isD[(Z - 1) * Yindex * Xindex + Y * Xindex + (X - 1)] == 1 && preD != NE) {//southwest
-                X = X - 1;
-                Z = Z - 1;
-                preD = SW;
-              } else if (isD[Z * Yindex * Xindex + Y * Xindex + (X - 2)] == 1 && isD[Z * Yindex * Xindex + Y * Xindex + (X - 1)] == 2 && preD != E) {//west
-                X = X - 2;
-                preD = W;
-              } else if (isD[(Z + 1) * Yindex * Xindex + Y * Xindex + (X - 1)] == 1 && preD != SE) {//northwest
-                X = X - 1;
-                Z = Z + 1;
-                preD = NW;
-              }
-              max_radiusXZ = max(max_radiusXZ, sqrt(pow(((X - startX) / 2) * hX, 2) + pow(((Z - startZ) / 2) * hZ, 2)) / 2.0);
-              if (X == startX && Z == startZ) {
-                break;
-              }
-            }
-          }
-          X = startX;
-          Y = startY;
-          Z = startZ;
+          //calc max|r_i - r_j|
+          max_radiusXY = (((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) && !(geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) ? getMaxRadius(contourXY, j) : 0.0;//xy plane
+          max_radiusYZ = (((geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) && !(geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm)) ? getMaxRadius(contourYZ, j) : 0.0;//yz plane
+          max_radiusXZ = (((geoInfo->bType[index].isBofXp && geoInfo->bType[index].isBofXm) || (geoInfo->bType[index].isBofZp && geoInfo->bType[index].isBofZm)) && !(geoInfo->bType[index].isBofYp && geoInfo->bType[index].isBofYm)) ? getMaxRadius(contourXZ, j) : 0.0;//xz plane
         }
 
         /* calc local radius of curvature */
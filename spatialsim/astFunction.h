@@ -11,7 +11,9 @@ void rearrangeAST(ASTNode *ast);
 
 void countAST(ASTNode *ast, unsigned int &numOfASTNode);
 
-void parseAST(ASTNode *ast, reversePolishInfo *rpInfo, std::vector<variableInfo*> &varInfoList, int index_max);
+bytecodeInfo* compileAST(ASTNode *ast, std::vector<variableInfo*> &varInfoList, bool useDelta);
+
+ASTNode* differentiateAST(const ASTNode *ast, const char *id);
 
 void parseDependence(const ASTNode *ast, std::vector<variableInfo*> &dependence, std::vector<variableInfo*> &varInfoList);
 
@@ -4,18 +4,34 @@
 #include "mystruct.h"
 #include <vector>
 
-void reversePolishInitial(std::vector<unsigned int> &indexList, reversePolishInfo *rpInfo, double *value, unsigned int numOfASTNodes, int Xindex, int Yindex, int Zindex, bool isAllArea);
+//number of points evaluated together by the bytecode lanes
+#define BC_LANES 8
 
-void reversePolishRK(reactionInfo *rInfo, GeometryInfo *geoInfo, int Xindex, int Yindex, int Zindex, double dt, unsigned int m, unsigned int numOfReactants, bool isReaction);
+double calcBytecodeOp(int op, double a, double b);
 
-void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, double dt);
+void loadBytecodeRegisters(bytecodeInfo *bc, std::vector<double> &reg);
+
+double executeBytecode(const bytecodeInfo *bc, double *reg);
+
+//register r of lane l is reg[r * BC_LANES + l]
+void loadBytecodeLanes(bytecodeInfo *bc, std::vector<double> &reg);
+
+void executeBytecodeLanes(const bytecodeInfo *bc, double *reg);
+
+void reversePolishInitial(std::vector<unsigned int> &indexList, bytecodeInfo *bc, double *value, int Xindex, int Yindex, int Zindex, bool isAllArea);
+
+void reversePolishRK(reactionInfo *rInfo, GeometryInfo *geoInfo, int Xindex, int Yindex, int Zindex, double stageDt, unsigned int m, unsigned int numOfReactants, bool isReaction);
+
+void calcDiffusion(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, double stageDt);
 
 void cipCSLR(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, double dt, int Xindex, int Yindex, int Zindex, unsigned int dimension);
 
-void calcBoundary(variableInfo *sInfo, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, unsigned int dimension);
+void calcBoundary(variableInfo *sInfo, const BoundaryKind_t *bcKind, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int m, unsigned int dimension);
+
+void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVector *nuVec, int Xindex, int Yindex, int Zindex, double stageDt, unsigned int m, double deltaX, double deltaY, double deltaZ, unsigned int dimension, unsigned int numOfReactants);
 
-void calcMemTransport(reactionInfo *rInfo, GeometryInfo *geoInfo, normalUnitVector *nuVec, int Xindex, int Yindex, int Zindex, double dt, unsigned int m, double deltaX, double deltaY, double deltaZ, unsigned int dimension, unsigned int numOfReactants);
+void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yindex, int Zindex, unsigned int m, double stageDt, unsigned int dimension);
 
-void calcMemDiffusion(variableInfo *sInfo, voronoiInfo *vorI, int Xindex, int Yindex, int Zindex, unsigned int m, double dt, unsigned int dimension);
+void subcycleDiffusion(variableInfo *sInfo, const BoundaryKind_t *bcKind, voronoiInfo *vorI, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, double dt, unsigned int numOfSteps, unsigned int dimension);
 
 #endif
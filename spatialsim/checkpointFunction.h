@@ -0,0 +1,16 @@
+#ifndef CHECKPOINTFUNCTION_H_
+#define CHECKPOINTFUNCTION_H_
+
+#include "mystruct.h"
+#include <string>
+#include <vector>
+
+void setCheckpointSignal();
+
+bool isTerminationRequested();
+
+void writeCheckpoint(std::string path, std::vector<variableInfo*> &varInfoList, unsigned int numOfVolIndexes, const checkpointState &state);
+
+void readCheckpoint(std::string path, std::vector<variableInfo*> &varInfoList, unsigned int numOfVolIndexes, checkpointState &state);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef CODEGENFUNCTION_H_
+#define CODEGENFUNCTION_H_
+
+#include "mystruct.h"
+#include <string>
+
+unsigned long long hashString(const std::string &str);
+
+//$SPATIALSIM_CACHE, ~/.cache/spatialsim or /tmp/spatialsim-<uid>, created with mode 0700
+//empty if the directory is not owned by the user or others can write to it
+std::string getCacheDir();
+
+//a regular file of the user that nobody else can write to
+bool isPrivateFile(const std::string &path);
+
+void* setNativeKernels(executionPlan *plan);
+
+#endif
@@ -12,4 +12,8 @@ void freeRInfo(std::vector<reactionInfo*> &geoInfoList);
 
 void freeAvolInfo(std::vector<GeometryInfo*> &geoInfoList);
 
+void freeExecutionPlan(executionPlan *plan);
+
+void freeNativeKernels(void *handle);
+
 #endif
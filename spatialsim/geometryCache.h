@@ -0,0 +1,37 @@
+#ifndef GEOMETRYCACHE_H_
+#define GEOMETRYCACHE_H_
+
+#include "mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include <vector>
+
+LIBSBML_CPP_NAMESPACE_USE
+
+//geometry_<hash>.bin in the cache directory, the hash is taken over the geometry section,
+//the compartment mappings and Xdiv, Ydiv, Zdiv
+//
+//  magic | numOfVolIndexes, numOfGeometries, hasNormal
+//  per GeometryInfo (geoInfoList order): compartmentId, hasGrid, isDomain, isBoundary, bType,
+//  domainIndex, pseudoMemIndex, boundaryIndex
+//  nuVec, vorI (numOfVolIndexes each, only if hasNormal)
+//
+//bType is the one before setBoundaryType, which depends on the boundary conditions of the model
+#define GEOMETRY_CACHE_MAGIC "SPSGEOM1"
+
+typedef struct _geometryCache geometryCache;
+
+//0 when the cache directory cannot be used
+geometryCache* openGeometryCache(Model *model, int Xdiv, int Ydiv, int Zdiv, unsigned int numOfVolIndexes);
+
+//false for a null cache, so the caller can pass the result of an unused cache
+bool isGeometryCached(geometryCache *cache);
+
+void restoreGeometry(geometryCache *cache, std::vector<GeometryInfo*> &geoInfoList);
+
+void restoreNormalAndVoronoi(geometryCache *cache, normalUnitVector *&nuVec, voronoiInfo *&vorI);
+
+void saveGeometryCache(geometryCache *cache, std::vector<GeometryInfo*> &geoInfoList, normalUnitVector *nuVec, voronoiInfo *vorI);
+
+void closeGeometryCache(geometryCache *cache);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef IMPLICITFUNCTION_H_
+#define IMPLICITFUNCTION_H_
+
+#include "mystruct.h"
+
+bool isImplicitDiffusionSupported(variableInfo *sInfo, int solver);
+
+implicitDiffusionInfo* setImplicitDiffusionInfo(variableInfo *sInfo, const BoundaryKind_t *bcKind, double deltaX, double deltaY, double deltaZ, int Xindex, int Yindex, int Zindex, unsigned int dimension, int solver);
+
+void calcImplicitDiffusion(implicitDiffusionInfo *idInfo, double dt);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef MULTIGRIDFUNCTION_H_
+#define MULTIGRIDFUNCTION_H_
+
+#include "mystruct.h"
+
+void setMultigridLevels(implicitDiffusionInfo *idInfo, int Xindex, int Yindex);
+
+void updateMultigridOperator(implicitDiffusionInfo *idInfo, double h);
+
+double applyMultigrid(implicitDiffusionInfo *idInfo, const double *r, double *z);
+
+#endif
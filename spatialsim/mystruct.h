@@ -19,13 +19,55 @@ typedef enum _preDirection {
 	N = 0, NE, E, SE, S, SW, W, NW
 }preDirection;
 
-typedef struct _reversePolishInfo {
-	double **varList;
-	double **deltaList;
-	double **constList;
-	int *opfuncList;
-	unsigned int listNum;
-}reversePolishInfo;
+typedef enum _diffusionSolver {
+	DIFFUSION_EXPLICIT = 0, DIFFUSION_CN, DIFFUSION_ADI, DIFFUSION_MG
+}diffusionSolver;
+
+typedef enum _operatorMask {
+	OP_ADVECTION = 1,
+	OP_DIFFUSION = 2,
+	OP_REACTION = 4
+}operatorMask;
+
+typedef enum _reactionSolver {
+	REACTION_EXPLICIT = 0, REACTION_ROS2
+}reactionSolver;
+
+typedef enum _bytecodeOp {
+	BC_PLUS = 0, BC_MINUS, BC_TIMES, BC_DIVIDE, BC_POWER, BC_ROOT, BC_SQRT, BC_ABS,
+	BC_EXP, BC_LN, BC_LOG10, BC_LOG, BC_CEILING, BC_FLOOR, BC_FACTORIAL,
+	BC_SIN, BC_COS, BC_TAN, BC_SEC, BC_CSC, BC_COT,
+	BC_SINH, BC_COSH, BC_TANH, BC_SECH, BC_CSCH, BC_COTH,
+	BC_ARCSIN, BC_ARCCOS, BC_ARCTAN, BC_ARCSEC, BC_ARCCSC, BC_ARCCOT,
+	BC_ARCSINH, BC_ARCCOSH, BC_ARCTANH, BC_ARCSECH, BC_ARCCSCH, BC_ARCCOTH,
+	BC_AND, BC_OR, BC_XOR, BC_NOT,
+	BC_EQ, BC_GEQ, BC_GT, BC_LEQ, BC_LT, BC_NEQ
+}bytecodeOp;
+
+typedef struct _bytecode {
+	int op;
+	unsigned int dst;
+	unsigned int src1;
+	unsigned int src2;
+}bytecode;
+
+struct _variableInfo;
+typedef void (*nativeKernel)(double *reg, int numOfLanes);
+
+//registers: [constPool | paramList | varList | temporaries]
+typedef struct _bytecodeInfo {
+	std::vector<bytecode> code;
+	std::vector<double> constPool;
+	std::vector<double*> paramList;
+	std::vector<double*> varList;
+	std::vector<double*> deltaList;
+	std::vector<struct _variableInfo*> varInfoList;
+	unsigned int paramBase;
+	unsigned int varBase;
+	unsigned int numOfRegisters;
+	unsigned int result;
+	nativeKernel nativeFunc;//compiled kernel, 0 when interpreted
+}bytecodeInfo;
 
 typedef struct _boundaryType {
 	bool isBofXp;
@@ -42,6 +84,14 @@ typedef struct _adjacentMemElement {
 	int index_z;
 }adjacentMemElement;
 
+//bits of GeometryInfo::stencilMask, the neighbor 2 or 4 points away on the axis is inside the grid and the domain
+//(isDomain == 1), and the point is not on the outermost layer of the grid
+enum {
+	STENCIL_XP2 = 1 << 0, STENCIL_XM2 = 1 << 1, STENCIL_YP2 = 1 << 2, STENCIL_YM2 = 1 << 3, STENCIL_ZP2 = 1 << 4, STENCIL_ZM2 = 1 << 5,
+	STENCIL_XP4 = 1 << 6, STENCIL_XM4 = 1 << 7, STENCIL_YP4 = 1 << 8, STENCIL_YM4 = 1 << 9, STENCIL_ZP4 = 1 << 10, STENCIL_ZM4 = 1 << 11,
+	STENCIL_INTERIOR = 1 << 12
+};
+
 typedef struct _GeometryInfo {
 	const char *compartmentId;
 	const char *domainTypeId;
@@ -56,10 +106,11 @@ typedef struct _GeometryInfo {
 	bool implicit;
 	int *isDomain;
 	int *isBoundary;
-	reversePolishInfo *rpInfo;
+	bytecodeInfo *bcInfo;
   std::vector<unsigned int> domainIndex;
 	std::vector<unsigned int> pseudoMemIndex;
 	std::vector<unsigned int> boundaryIndex;
+	std::vector<unsigned short> stencilMask;//stencil bits of each point of domainIndex
 }GeometryInfo;
 
 typedef struct _variableInfo {
@@ -73,7 +124,7 @@ typedef struct _variableInfo {
 	bool isUniform;
 	bool hasAssignmentRule;
 	//boundaryType bType;
-	reversePolishInfo *rpInfo;
+	bytecodeInfo *bcInfo;
 	GeometryInfo *geoi;
 	_variableInfo **diffCInfo;
 	_variableInfo **adCInfo;
@@ -85,7 +136,7 @@ typedef struct _variableInfo {
 typedef struct _reactionInfo {
 	const char* id;
 	double *value;
-	reversePolishInfo *rpInfo;
+	bytecodeInfo *bcInfo;
 	bool isMemTransport;
   Reaction *reaction;
   std::vector<_variableInfo*> spRefList;
@@ -136,6 +187,113 @@ typedef struct _planeAdjacent {
 	normalUnitVector XZcontour[2];
 }planeAdjacent;
 
+//galerkin coarsening of the masked operator A = diag - offDiag by 2x2x2 aggregation
+typedef struct _multigridLevel {
+	std::vector<int> coord;//3 per unknown, cell coordinates on this level
+	std::vector<int> parent;//unknown of the next coarser level, -1 for dirichlet points
+	std::vector<int> child;//8 per unknown, unknowns of the next finer level
+	std::vector<int> neighbor;//6 per unknown (Xp, Xm, Yp, Ym, Zp, Zm)
+	std::vector<int> colorList[2];//red-black ordering of the smoother
+	std::vector<double> diag;
+	std::vector<double> offDiag;//6 per unknown
+	std::vector<double> x, b, r;
+}multigridLevel;
+
+//cn: (S - dt/2 * L) u = (S + dt/2 * L) u*, S is the row scaling which makes the operator symmetric
+//adi: douglas splitting of L = Lx + Ly + Lz into tridiagonal solves along the lines
+typedef struct _implicitDiffusionInfo {
+	variableInfo *sInfo;
+	int solver;
+	std::vector<unsigned int> pointList;//grid index of each unknown
+	std::vector<int> neighbor;//6 per unknown (Xp, Xm, Yp, Ym, Zp, Zm), -1 if there is no flux across the face
+	std::vector<char> isFixed;//dirichlet boundary
+	std::vector<double> scale;
+	std::vector<double> weight;//3 per unknown, scale * D / delta^2
+	std::vector<double> diag;
+	std::vector<double> u, x, r, z, p, q;//u* and the conjugate gradient vectors of the correction x
+	std::vector<int> lineList[3];//first unknown of each x, y and z line
+	std::vector<multigridLevel> mgLevelList;//multigrid preconditioner of CG, empty unless -M mg
+	bool isScaled;//non-uniform D is symmetrized with scale = 1 / D
+	double deltaX;
+	double deltaY;
+	double deltaZ;
+	double tolerance;
+	unsigned int maxIter;
+}implicitDiffusionInfo;
+
+typedef struct _speciesPlan {
+	variableInfo *sInfo;
+	bool isVariable;
+	bool hasVolDiffusion;
+	bool hasMemDiffusion;
+	bool hasAdvection;
+	bool hasBoundary;
+	BoundaryKind_t bcKind[6];
+	implicitDiffusionInfo *idInfo;//0 when the diffusion is explicit
+	unsigned int numOfDiffSteps;//multirate sub-steps of diffusion per step
+	unsigned int numOfAdSteps;//multirate sub-steps of advection per step
+	int pseudoMemTable;//position in pseudoMemTableList, -1 for volume species
+}speciesPlan;
+
+typedef struct _reactionPlan {
+	reactionInfo *rInfo;
+	GeometryInfo *geoi;
+	std::vector<GeometryInfo*> memGeoList;
+	unsigned int numOfReactants;
+	bool isImplicit;//integrated by calcRosenbrock instead of the runge-kutta stages
+}reactionPlan;
+
+//the reactions and rate rules of one geometry form a small system at each point, solved with the jacobian
+//derived from the kinetic laws: stiff reactions by ros2 and fast reactions by a rapid equilibrium projection
+typedef struct _reactionSystemInfo {
+	GeometryInfo *geoi;
+	std::vector<variableInfo*> spList;//unknowns of each point
+	std::vector<bytecodeInfo*> rateList;//kinetic laws and rate rules
+	std::vector<unsigned int> stoichBegin;//terms of rate r are [stoichBegin[r], stoichBegin[r + 1])
+	std::vector<unsigned int> stoichSpecies;
+	std::vector<double> stoichCoef;
+	std::vector<bytecodeInfo*> jacList;//d rate r / d spList[q] at r * spList.size() + q, 0 if it does not depend on the species
+	std::vector<std::vector<int> > rateVarMap;//unknown read by each variable register of the rate, -1 for the other variables
+	std::vector<std::vector<int> > jacVarMap;
+}reactionSystemInfo;
+
+//a pseudo membrane point takes the smaller value of the two membrane points nbrA and nbrB
+typedef struct _pseudoMemEntry {
+	int index;
+	int nbrA;
+	int nbrB;
+}pseudoMemEntry;
+
+typedef struct _assignmentPlan {
+	variableInfo *info;
+	std::vector<unsigned int> *indexList;
+	bool isAllArea;
+}assignmentPlan;
+
+typedef struct _executionPlan {
+	std::vector<speciesPlan> speciesList;
+	std::vector<reactionPlan> reactionList;
+	std::vector<reactionPlan> rateRuleList;
+	std::vector<assignmentPlan> assignmentList;
+	std::vector<reactionSystemInfo*> systemList;//empty unless -R
+	std::vector<reactionSystemInfo*> fastSystemList;//fast reactions
+	std::vector<std::vector<pseudoMemEntry> > pseudoMemTableList;//one per membrane geometry
+}executionPlan;
+
+//position of the time loop at the beginning of a step, the rest of the state is in the variableInfo
+typedef struct _checkpointState {
+	int t;
+	int count;
+	int file_num;
+	int percent;
+	double sim_time;
+	double dt;
+	double h;//next step of -A
+	double nextOutTime;
+	unsigned int acceptedSteps;
+	unsigned int rejectedSteps;
+}checkpointState;
+
 typedef struct _optionList{
   int Xdiv;
   int Ydiv;
@@ -152,6 +310,18 @@ typedef struct _optionList{
   int docFlag;
   char *document;
   char *outpath;
+  int threads;
+  int nativeFlag;
+  int diffSolver;
+  double tolerance;
+  int splitFlag;
+  int subSteps[3];//advection, diffusion, reaction
+  int multirateFlag;
+  int reactionSolver;
+  int ringFrames;//frames kept in TimeCourseData.ring, 0: no ring file
+  int checkpointInterval;//seconds between checkpoints, 0: only on SIGTERM, -1: no checkpoint
+  int restartFlag;
+  int geometryCacheFlag;
 }optionList;
 
 #endif /* MYSTRUCT_H_ */
@@ -14,6 +14,20 @@ void make3DHDF(std::string fname, ListOfSpecies* los, std::string outpath);
 
 void outputValueData(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xdiv, int Ydiv, int Zdiv, int dimension, int file_num, std::string fname, std::string outpath);
 
+//TimeCourseData.h5 stays open and is written by a background thread
+//each species is appended to "<species id>/value" (time, X, Y, Z), the output times to "time"
+typedef struct _hdfWriter hdfWriter;
+
+//numOfFrames: outputs already in the file when the simulation is restarted, 0 for a new file
+hdfWriter* openHDFWriter(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xdiv, int Ydiv, int Zdiv, int dimension, std::string fname, std::string outpath, int numOfFrames);
+
+void pushValueData(hdfWriter *writer, double sim_time);
+
+//waits until every pushed output is in the file
+void flushHDFWriter(hdfWriter *writer);
+
+void closeHDFWriter(hdfWriter *writer);
+
 void output3D_uint8(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xdiv, int Ydiv, int Zdiv, int file_num, std::string fname, double range_max, std::string outpath);
 
 #endif
@@ -8,6 +8,14 @@
 
 LIBSBML_CPP_NAMESPACE_USE
 
+//outputImg and outputImg_slice hand the species images to these threads (0: number of cores) until finishImageWorkers
+void startImageWorkers(unsigned int numOfThreads);
+
+//waits until the queued images are written
+void flushImageWorkers();
+
+void finishImageWorkers();
+
 void outputImg(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_edge, int Xdiv, int Ydiv, double minX, double maxX, double minY, double maxY, double t, double range_min, double range_max, std::string fname, int file_num, std::string outpath, int num_digits);
 
 void outputImg_slice(Model *model, std::vector<variableInfo*> &varInfoList, int* geo_edge, int Xdiv, int Ydiv, int Zdiv, double min0, double max0, double min1, double max1, double t, double range_min, double range_max, std::string fname, int file_num, int slice, char slicedim, std::string outpath, int num_digits);
@@ -46,6 +54,15 @@ void setDetail(cv::Mat image, int* indent, int* areaSize, double t, double minX,
 
 void setDetail_slice(cv::Mat image, int* indent, int* areaSize, double t, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, int Zdiv, std::string fname, std::string s_id, int magnification, int slice, char slicedim, int num_digits);
 
+//setDetail without the time label, the part shared by all output steps
+void setFrameDetail(cv::Mat image, int* indent, int* areaSize, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, std::string fname, std::string s_id, int magnification);
+
+void setFrameDetail_slice(cv::Mat image, int* indent, int* areaSize, double minX, double maxX, double minY, double maxY, int Xdiv, int Ydiv, int Zdiv, std::string fname, std::string s_id, int magnification, int slice, char slicedim);
+
+void addFrameTime(cv::Mat image, int* indent, int* areaSize, double t, int num_digits);
+
+void calcFontSize(int* areaSize, float& fontsize, int& thickness);
+
 void initializeImage(cv::Mat image, int* indent, int* areaSize, float& fontsize, int& thickness, int& lticks, int& sticks, cv::Point& left_top, cv::Point& right_top, cv::Point& left_bottom, cv::Point& right_bottom);
 
 void addTicks(cv::Mat image, float fontsize, int thickness, int XresultImg, int YresultImg, int lticks, int sticks, cv::Point left_bottom);
@@ -0,0 +1,56 @@
+#ifndef OUTPUTRAW_H_
+#define OUTPUTRAW_H_
+
+#include "mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+LIBSBML_CPP_NAMESPACE_USE
+
+//TimeCourseData.ring: a pre-sized file mapped by the simulator and by any number of readers
+//
+//  ringFileHeader | ringSpeciesEntry x numOfSpecies | (padding up to headerSize)
+//  frame slot 0 | frame slot 1 | ... | frame slot numOfFrames - 1 (frameSize bytes each)
+//
+//a frame slot is ringFrameHeader followed by the species arrays (little-endian double,
+//Xindex * Yindex * Zindex values each, the same order as variableInfo::value).
+//frame n is written to slot n % numOfFrames. The writer sets seq to 2n + 1 while it copies
+//and to 2n + 2 when the frame is complete, then publishes writeCount = n + 1; a reader takes
+//a slot whose seq is even and unchanged after reading it.
+#define RING_MAGIC "SPSRING1"
+#define RING_ID_LENGTH 64
+
+typedef struct _ringFileHeader {
+	char magic[8];//RING_MAGIC, written last
+	uint32_t version;
+	uint32_t headerSize;//offset of frame slot 0
+	uint32_t dimension;
+	uint32_t numOfSpecies;
+	uint32_t Xindex, Yindex, Zindex;
+	uint32_t numOfFrames;
+	uint64_t frameSize;
+	uint64_t writeCount;//frames written so far
+}ringFileHeader;
+
+typedef struct _ringSpeciesEntry {
+	char id[RING_ID_LENGTH];
+	uint32_t inVol;
+	uint32_t reserved;
+}ringSpeciesEntry;
+
+typedef struct _ringFrameHeader {
+	uint64_t seq;
+	double sim_time;
+}ringFrameHeader;
+
+typedef struct _ringWriter ringWriter;
+
+ringWriter* openRingWriter(std::vector<variableInfo*> &varInfoList, ListOfSpecies* los, int Xindex, int Yindex, int Zindex, int dimension, unsigned int numOfFrames, std::string fname, std::string outpath);
+
+void pushRingFrame(ringWriter *writer, double sim_time);
+
+void closeRingWriter(ringWriter *writer);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef ROSENBROCKFUNCTION_H_
+#define ROSENBROCKFUNCTION_H_
+
+#include "mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include <vector>
+
+LIBSBML_CPP_NAMESPACE_USE
+
+void setReactionSystems(Model *model, executionPlan *plan, std::vector<variableInfo*> &varInfoList);
+
+void calcRosenbrock(reactionSystemInfo *rsInfo, double dt);
+
+void setFastReactionSystems(executionPlan *plan, std::vector<reactionInfo*> &fast_rInfoList, std::vector<variableInfo*> &varInfoList);
+
+void calcRapidEquilibrium(reactionSystemInfo *rsInfo);
+
+#endif
@@ -17,6 +17,12 @@ void setReactionInfo(Model *model, std::vector<variableInfo*> &varInfoList, std:
 
 void setRateRuleInfo(Model *model, std::vector<variableInfo*> &varInfoList, std::vector<reactionInfo*> &rInfoList, unsigned int numOfVolIndexes);
 
+executionPlan* setExecutionPlan(Model *model, std::vector<variableInfo*> &varInfoList, std::vector<GeometryInfo*> &geoInfoList, std::vector<reactionInfo*> &rInfoList, std::vector<variableInfo*> &orderedARule, GeometryInfo *allAreaInfo);
+
+void setPseudoMemTables(executionPlan *plan, int Xindex, int Yindex, int Zindex, unsigned int dimension);
+
+void setStencilMasks(std::vector<GeometryInfo*> &geoInfoList, int Xindex, int Yindex, int Zindex, unsigned int dimension);
+
 normalUnitVector* setNormalAngle(std::vector<GeometryInfo*> &geoInfoList, double Xsize, double Ysize, double Zsize, int dimension, int Xindex, int Yindex, int Zindex, unsigned int numOfVolIndexes);
 
 void stepSearch(int l, int preD, int step_count, int step_k, int X, int Y, int Z, int Xindex, int Yindex, int Zindex, int *horComponent, int *verComponent, int *isD, std::string plane);
@@ -13,18 +13,25 @@
 #include "spatialsim/searchFunction.h"
 #include "spatialsim/astFunction.h"
 #include "spatialsim/calcPDE.h"
+#include "spatialsim/codegenFunction.h"
+#include "spatialsim/implicitFunction.h"
+#include "spatialsim/rosenbrockFunction.h"
 #include "spatialsim/setInfoFunction.h"
 #include "spatialsim/boundaryFunction.h"
 #include "spatialsim/checkStability.h"
 #include "spatialsim/checkFunc.h"
+#include "spatialsim/checkpointFunction.h"
+#include "spatialsim/geometryCache.h"
 #include "spatialsim/options.h"
 #include "spatialsim/outputHDF.h"
 #include "spatialsim/outputImage.h"
+#include "spatialsim/outputRaw.h"
 #include "sbml/SBMLTypes.h"
 #include "sbml/packages/spatial/common/SpatialExtensionTypes.h"
 #include "sbml/packages/spatial/extension/SpatialModelPlugin.h"
 #include "H5Cpp.h"
 #include <float.h>
+#include <ctime>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <iostream>
@@ -33,6 +40,9 @@
 #include <zlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 LIBSBML_CPP_NAMESPACE_USE
 using namespace H5;
@@ -82,7 +92,6 @@ void simulate(optionList options)
 	double *sim_time = new double(0.0);
 	double deltaX = 0.0, deltaY = 0.0, deltaZ = 0.0;
 	double Xsize = 0.0, Ysize = 0.0, Zsize = 0.0;
-	unsigned int numOfASTNodes = 0;
 	char *xaxis = 0, *yaxis = 0, *zaxis = 0;
 
 	cout << "validating model..." << endl;
@@ -94,7 +103,6 @@ void simulate(optionList options)
 	Model *model = doc->getModel();
 	ASTNode *ast = 0;
 	Species *s = 0;
-	SpeciesReference *sr = 0;
 	ListOfSpecies *los = model->getListOfSpecies();
 	ListOfCompartments *loc = model->getListOfCompartments();
 	SpatialCompartmentPlugin *cPlugin = 0;
@@ -182,6 +190,10 @@ void simulate(optionList options)
 	cout << "simulation time = " << end_time << endl;
 	cout << "dt = " << dt << endl;
 	cout << "output results every " << out_step << " step" << endl;
+#ifdef _OPENMP
+	omp_set_num_threads(options.threads);
+	cout << "threads = " << options.threads << endl;
+#endif
 	cout << "color bar range min: " << range_min << endl;
 	cout << "color bar range max: ";
   if (range_max == -DBL_MAX) {
@@ -231,6 +243,8 @@ void simulate(optionList options)
 	}
 
 	cout << "defining geometry... " << endl;
+	//with -G the grid arrays, normal unit vectors and voronoi info are restored instead of computed
+	geometryCache *gCache = (options.geometryCacheFlag) ? openGeometryCache(model, Xdiv, Ydiv, Zdiv, numOfVolIndexes) : 0;
   GeometryInfo* allAreaInfo = new GeometryInfo;
   allAreaInfo->isDomain = new int[numOfVolIndexes];
   int aaIndex;
@@ -280,31 +294,22 @@ void simulate(optionList options)
 				geoInfo->isVol = true;
 				ast = const_cast<ASTNode*>(analyticVol->getMath());
 				rearrangeAST(ast);
-				numOfASTNodes = 0;
-				countAST(ast, numOfASTNodes);
-				geoInfo->rpInfo = new reversePolishInfo();
-				geoInfo->rpInfo->varList = new double*[numOfASTNodes];
-				fill_n(geoInfo->rpInfo->varList, numOfASTNodes, reinterpret_cast<double*>(0));
-				geoInfo->rpInfo->constList = new double*[numOfASTNodes];
-				fill_n(geoInfo->rpInfo->constList, numOfASTNodes, reinterpret_cast<double*>(0));
-				geoInfo->rpInfo->opfuncList = new int[numOfASTNodes];
-				fill_n(geoInfo->rpInfo->opfuncList, numOfASTNodes, 0);
-				geoInfo->rpInfo->listNum = numOfASTNodes;
 				geoInfo->isDomain = new int[numOfVolIndexes];
 				fill_n(geoInfo->isDomain, numOfVolIndexes, 0);
 				geoInfo->isBoundary = new int[numOfVolIndexes];
 				fill_n(geoInfo->isBoundary, numOfVolIndexes, 0);
 				geoInfo->adjacent0 = 0;
 				geoInfo->adjacent1 = 0;
-				parseAST(ast, geoInfo->rpInfo, varInfoList, numOfASTNodes);
+				geoInfo->bcInfo = compileAST(ast, varInfoList, false);
+				geoInfoList.push_back(geoInfo);
+				if (isGeometryCached(gCache)) continue;
 				//judge if the coordinate point is inside the analytic volume
 				fill_n(tmp_isDomain, numOfVolIndexes, 0);
-				reversePolishInitial(volumeIndexList, geoInfo->rpInfo, tmp_isDomain, numOfASTNodes, Xindex, Yindex, Zindex, false);
+				reversePolishInitial(volumeIndexList, geoInfo->bcInfo, tmp_isDomain, Xindex, Yindex, Zindex, false);
 				for (k = 0; k < numOfVolIndexes; k++) {
 					index = k;
 					geoInfo->isDomain[k] = (int)tmp_isDomain[k];
 				}
-				geoInfoList.push_back(geoInfo);
 			}
 
 		} else if (geometry->getGeometryDefinition(i)->isSampledFieldGeometry()) {
@@ -323,18 +328,6 @@ void simulate(optionList options)
 							}
 						}
 
-						int *uncompr;
-						int length;
-						if(samField->getCompression() == SPATIAL_COMPRESSIONKIND_UNCOMPRESSED) {
-							length = samField->getUncompressedLength();
-							samField->getUncompressedData(uncompr, length);
-						} else if(samField->getCompression() == SPATIAL_COMPRESSIONKIND_DEFLATED) {
-							length = samField->getUncompressedLength();
-							samField->getUncompressedData(uncompr, length);
-						} else {
-							cerr << "base64 not supported" << endl;
-							exit(1);
-						}
 						GeometryInfo *geoInfo = new GeometryInfo;
 						InitializeAVolInfo(geoInfo);
 						geoInfo->compartmentId = c->getId().c_str();
@@ -355,6 +348,19 @@ void simulate(optionList options)
 						geoInfo->isBoundary = new int[numOfVolIndexes];
 						fill_n(geoInfo->isBoundary, numOfVolIndexes, 0);
 						geoInfoList.push_back(geoInfo);
+						if (isGeometryCached(gCache)) continue;
+						int *uncompr;
+						int length;
+						if(samField->getCompression() == SPATIAL_COMPRESSIONKIND_UNCOMPRESSED) {
+							length = samField->getUncompressedLength();
+							samField->getUncompressedData(uncompr, length);
+						} else if(samField->getCompression() == SPATIAL_COMPRESSIONKIND_DEFLATED) {
+							length = samField->getUncompressedLength();
+							samField->getUncompressedData(uncompr, length);
+						} else {
+							cerr << "base64 not supported" << endl;
+							exit(1);
+						}
 						for (Z = 0; Z < Zindex; Z += 2) {
 							for (Y = 0; Y < Yindex; Y += 2) {
 								for (X = 0; X < Xindex; X += 2) {
@@ -432,7 +438,7 @@ void simulate(optionList options)
 	delete[] tmp_isDomain;
   //merge external and internal analytic volumes and get boundary points of the geometry
 	for (i = 0; i < geometry->getNumGeometryDefinitions(); i++) {
-		if (geometry->getGeometryDefinition(i)->isAnalyticGeometry()) {
+		if (geometry->getGeometryDefinition(i)->isAnalyticGeometry() && !isGeometryCached(gCache)) {
 			AnalyticGeometry *analyticGeo = static_cast<AnalyticGeometry*>(geometry->getGeometryDefinition(i));
 			for (j = 0; j < analyticGeo->getNumAnalyticVolumes(); j++) {
 				AnalyticVolume *analyticVolEx = analyticGeo->getAnalyticVolume(j);
@@ -594,6 +600,7 @@ void simulate(optionList options)
 				geoInfo->bType[j].isBofZp = false;
 				geoInfo->bType[j].isBofZm = false;
 			}
+			if (isGeometryCached(gCache)) continue;
 			switch (dimension) {
 			case 1:
 				for (X = 0; X < Xindex; X++) {
@@ -836,6 +843,7 @@ void simulate(optionList options)
 			}
 		}
 	}
+	if (isGeometryCached(gCache)) restoreGeometry(gCache, geoInfoList);
 	cout << "finished" << endl << endl;
 	//make directories to output result (txt and img)
 	if(stat(string(outpath + "/result/" + fname + "/img").c_str(), &st) != 0) {
@@ -845,9 +853,11 @@ void simulate(optionList options)
     system(string("mkdir " + outpath + "/result/" + fname + "/HDF5").c_str());
   }
 
-  makeHDF(fname, los, outpath);//added by mashimo
-  if (dimension == 3)
-    make3DHDF(fname, los, outpath);
+  if (!options.restartFlag) {//a restart continues the files of the interrupted run
+    makeHDF(fname, los, outpath);//added by mashimo
+    if (dimension == 3)
+      make3DHDF(fname, los, outpath);
+  }
 
 	for (i = 0; i < numOfSpecies; i++) {
 		s = los->get(i);
@@ -902,17 +912,6 @@ void simulate(optionList options)
 		}
 		if (ast != 0) {
 			rearrangeAST(ast);
-			numOfASTNodes = 0;
-			countAST(ast, numOfASTNodes);
-			info->rpInfo = new reversePolishInfo();
-			info->rpInfo->varList = new double*[numOfASTNodes];
-			fill_n(info->rpInfo->varList, numOfASTNodes, reinterpret_cast<double*>(0));
-			info->rpInfo->deltaList = 0;
-			info->rpInfo->constList = new double*[numOfASTNodes];
-			fill_n(info->rpInfo->constList, numOfASTNodes, reinterpret_cast<double*>(0));
-			info->rpInfo->opfuncList = new int[numOfASTNodes];
-			fill_n(info->rpInfo->opfuncList, numOfASTNodes, 0);
-			info->rpInfo->listNum = numOfASTNodes;
 			info->isResolved = false;
 			parseDependence(ast, info->dependence, varInfoList);
 			notOrderedInfo.push_back(info);
@@ -930,14 +929,14 @@ void simulate(optionList options)
 				} else if (model->getRule(info->id) != 0 && model->getRule(info->id)->isAssignment()) {//assignment rule
 					ast = const_cast<ASTNode*>((static_cast<AssignmentRule*>(model->getRule(info->id)))->getMath());
 				}
-				parseAST(ast, info->rpInfo, varInfoList, info->rpInfo->listNum);
+				info->bcInfo = compileAST(ast, varInfoList, false);
 				char *formula = SBML_formulaToString(ast);
 				cout << info->id << ": " << formula << endl;
 				delete formula;
 				bool isAllArea = (info->sp != 0) ? false : true;
 				if (info->sp != 0){
           info->geoi = searchAvolInfoByCompartment(geoInfoList, info->sp->getCompartment().c_str());
-				reversePolishInitial(info->geoi->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, isAllArea);
+				reversePolishInitial(info->geoi->domainIndex, info->bcInfo, info->value, Xindex, Yindex, Zindex, isAllArea);
         } else if (info -> sp == 0){
          ListOfParameters* lop = model->getListOfParameters();
           for (j = 0; j < numOfParameters; ++j) {
@@ -958,11 +957,11 @@ void simulate(optionList options)
                 }
                 string comId = searchInfoById(varInfoList, spId.c_str())->sp->getCompartment();
                 info->geoi = searchAvolInfoByCompartment(geoInfoList, comId.c_str());
-                reversePolishInitial(info->geoi->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, false);
+                reversePolishInitial(info->geoi->domainIndex, info->bcInfo, info->value, Xindex, Yindex, Zindex, false);
               }
               else {//Normal Parameter
                 cout << "-> normal parameter" << endl;
-                reversePolishInitial(allAreaInfo->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, true);
+                reversePolishInitial(allAreaInfo->domainIndex, info->bcInfo, info->value, Xindex, Yindex, Zindex, true);
               }
               break;
             }
@@ -985,43 +984,95 @@ void simulate(optionList options)
 	//calc normal unit vector of membrane (for mem diffusion and mem transport)
 	normalUnitVector *nuVec = 0;
 	voronoiInfo *vorI = 0;
-	if (dimension >= 2) {
+	if (dimension >= 2 && isGeometryCached(gCache)) {
+		restoreNormalAndVoronoi(gCache, nuVec, vorI);
+	} else if (dimension >= 2) {
 		//calc normalUnitVector at membrane
 		nuVec = setNormalAngle(geoInfoList, Xsize, Ysize, Zsize, dimension, Xindex, Yindex, Zindex, numOfVolIndexes);
 		//calc voronoi at membrane
 		vorI = setVoronoiInfo(nuVec, xInfo, yInfo, zInfo, geoInfoList, Xsize, Ysize, Zsize, dimension, Xindex, Yindex, Zindex, numOfVolIndexes);
 	}
+	//saved before setBoundaryType, which marks bType from the boundary conditions of the model
+	if (gCache != 0 && !isGeometryCached(gCache)) saveGeometryCache(gCache, geoInfoList, nuVec, vorI);
+	closeGeometryCache(gCache);
 	//set boundary type
 	setBoundaryType(model, varInfoList, geoInfoList, Xindex, Yindex, Zindex, dimension);
 
 	//numerical stability analysis of diffusion and advection
-	double min_dt = dt;
+	//an adaptive step is bounded by the stability limit instead of being checked against it
+	bool isAdaptive = (options.tolerance > 0.0);
+	double stab_dt = (isAdaptive) ? end_time : dt;
+	double min_dt = stab_dt;
+	//with -S, diffusion and advection are checked against their own sub-steps
+	double diffSteps = (options.splitFlag) ? 2.0 * options.subSteps[1] : 1.0;
+	double adSteps = (options.splitFlag) ? 2.0 * options.subSteps[0] : 1.0;
+	//with -m, species beyond the limit are sub-cycled instead
+	vector<unsigned int> diffStepList(numOfSpecies, 1), adStepList(numOfSpecies, 1);
 	cout << endl << "checking numerical stability of diffusion and advection... " << endl;
 	for (i = 0; i < numOfSpecies; i++) {
 		variableInfo *sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
-		//volume diffusion
-		if (sInfo->diffCInfo != 0 && sInfo->geoi->isVol) {
-			min_dt = min(min_dt, checkDiffusionStab(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, dt));
+		double diff_dt = stab_dt, ad_dt = stab_dt;
+		//volume diffusion (implicit diffusion is unconditionally stable)
+		if (sInfo->diffCInfo != 0 && sInfo->geoi->isVol && !(options.diffSolver != DIFFUSION_EXPLICIT && isImplicitDiffusionSupported(sInfo, options.diffSolver))) {
+			diff_dt = min(diff_dt, checkDiffusionStab(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, stab_dt / diffSteps) * diffSteps);
 		}
 		//membane diffusion
 		if (sInfo->diffCInfo != 0 && !sInfo->geoi->isVol) {
-			min_dt = min(min_dt, checkMemDiffusionStab(sInfo, vorI, Xindex, Yindex, dt, dimension));
+			diff_dt = min(diff_dt, checkMemDiffusionStab(sInfo, vorI, Xindex, Yindex, stab_dt / diffSteps, dimension) * diffSteps);
 		}
 		//advection
 		if (sInfo->adCInfo != 0) {
-			min_dt = min(min_dt, checkAdvectionStab(sInfo, deltaX, deltaY, deltaZ, dt, Xindex, Yindex, dimension));
+			ad_dt = min(ad_dt, checkAdvectionStab(sInfo, deltaX, deltaY, deltaZ, stab_dt / adSteps, Xindex, Yindex, dimension) * adSteps);
+		}
+		if (options.multirateFlag) {
+			if (diff_dt < dt) diffStepList[i] = static_cast<unsigned int>(floor(dt / diff_dt)) + 1;
+			if (ad_dt < dt) adStepList[i] = static_cast<unsigned int>(floor(dt / ad_dt)) + 1;
+			if (diffStepList[i] > 1 || adStepList[i] > 1) {
+				cout << "multirate: " << sInfo->id << " diffusion " << diffStepList[i] << ", advection " << adStepList[i] << " sub-steps" << endl;
+			}
+		} else {
+			min_dt = min(min_dt, min(diff_dt, ad_dt));
 		}
 	}
 	cout << "finished" << endl;
-	if (dt > min_dt) {
+	if (!isAdaptive && dt > min_dt) {
 		cout << "dt must be less than " << min_dt << endl;
 		return;
 	}
+	if (isAdaptive) {
+		cout << "adaptive time step: tolerance = " << options.tolerance << ", max dt = " << min_dt << endl;
+	}
 
 	//reaction information
 	setReactionInfo(model, varInfoList, rInfoList, fast_rInfoList, numOfVolIndexes);
 	//rate rule information
 	setRateRuleInfo(model, varInfoList, rInfoList, numOfVolIndexes);
+	//resolve species, boundary conditions, reaction geometries and rules once for the time loop
+	executionPlan *plan = setExecutionPlan(model, varInfoList, geoInfoList, rInfoList, orderedARule, allAreaInfo);
+	setPseudoMemTables(plan, Xindex, Yindex, Zindex, dimension);
+	setStencilMasks(geoInfoList, Xindex, Yindex, Zindex, dimension);
+	void *nativeHandle = (options.nativeFlag) ? setNativeKernels(plan) : 0;
+	//implicit reactions
+	if (options.reactionSolver == REACTION_ROS2) setReactionSystems(model, plan, varInfoList);
+	//fast reactions are kept at equilibrium, starting from the initial values
+	setFastReactionSystems(plan, fast_rInfoList, varInfoList);
+	for (i = 0; i < plan->fastSystemList.size(); i++) calcRapidEquilibrium(plan->fastSystemList[i]);
+	for (i = 0; i < plan->speciesList.size(); i++) {
+		plan->speciesList[i].numOfDiffSteps = (plan->speciesList[i].isVariable) ? diffStepList[i] : 1;
+		plan->speciesList[i].numOfAdSteps = (plan->speciesList[i].isVariable) ? adStepList[i] : 1;
+	}
+	//implicit diffusion
+	if (options.diffSolver != DIFFUSION_EXPLICIT) {
+		for (i = 0; i < plan->speciesList.size(); i++) {
+			speciesPlan *sPlan = &(plan->speciesList[i]);
+			if (!sPlan->hasVolDiffusion || !sPlan->isVariable) continue;
+			if (isImplicitDiffusionSupported(sPlan->sInfo, options.diffSolver)) {
+				sPlan->idInfo = setImplicitDiffusionInfo(sPlan->sInfo, sPlan->bcKind, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, dimension, options.diffSolver);
+			} else {
+				cerr << "warning: diffusion coefficients of " << sPlan->sInfo->id << " are anisotropic and non-uniform, using explicit diffusion" << endl;
+			}
+		}
+	}
 	//output geometries
 	cout << endl << "outputting geometries into text file... " << endl;
 	int *geo_edge = new int[numOfVolIndexes];
@@ -1058,14 +1109,74 @@ void simulate(optionList options)
 	cout << "simulation starts" << endl;
 	clock_t diff_start, diff_end, boundary_start, boundary_end, out_start, out_end, re_start, re_end, ad_start, ad_end, assign_start, assign_end, update_start, update_end;
 	clock_t re_time = 0, diff_time = 0, output_time = 0, ad_time = 0, update_time = 0, mem_time = 0, boundary_time = 0, assign_time = 0;
+	//restart: the values of all variables and the position of the time loop
+	string checkpointPath = outpath + "/result/" + fname + "/checkpoint.bin";
+	checkpointState restartState = {0, 0, 0, 0, 0.0, dt, 0.0, 0.0, 0, 0};
+	if (options.restartFlag) {
+		readCheckpoint(checkpointPath, varInfoList, numOfVolIndexes, restartState);
+		if (!isAdaptive && restartState.dt != dt) {
+			cerr << "error: the checkpoint was taken with dt = " << restartState.dt << endl;
+			exit(1);
+		}
+		cout << "restarting from " << checkpointPath << " at t = " << restartState.sim_time << endl;
+	}
+	if (options.checkpointInterval >= 0) setCheckpointSignal();
+	time_t lastCheckpoint = time(NULL);
+	hdfWriter *hdfw = openHDFWriter(varInfoList, los, Xdiv, Ydiv, Zdiv, dimension, fname, outpath, restartState.file_num);
+	startImageWorkers(0);
+	ringWriter *ringw = (options.ringFrames > 0) ? openRingWriter(varInfoList, los, Xindex, Yindex, Zindex, dimension, options.ringFrames, fname, outpath) : 0;
 	clock_t sim_start = clock();
 	cout << endl;
   int num_digits = (log10(dt * out_step) < 0)? ceil(-1 * log10(dt * out_step)) : 0;
-	for (t = 0; t <= static_cast<int>(end_time / dt); t++) {
-		*sim_time = t * dt;
+	//adaptive time step: bogacki-shampine 3(2) in the four delta slots,
+	//the third slot is replaced by the update direction before the last stage, which evaluates
+	//the rates at the new values for the error estimate
+	double rk[4] = {0, 0.5, 0.5, 1.0};
+	if (isAdaptive) rk[2] = 0.75;
+	double h = dt, h_try = min(dt, min_dt), nextOutTime = 0.0, stepEnd = 0.0;
+	bool isClipped = false;
+	unsigned int acceptedSteps = 0, rejectedSteps = 0;
+	vector<vector<double> > savedState(plan->speciesList.size());
+	if (options.restartFlag) {
+		count = restartState.count;
+		file_num = restartState.file_num;
+		percent = restartState.percent;
+		*sim_time = restartState.sim_time;
+		h_try = restartState.h;
+		nextOutTime = restartState.nextOutTime;
+		acceptedSteps = restartState.acceptedSteps;
+		rejectedSteps = restartState.rejectedSteps;
+	}
+	//operator sub-steps as fractions of the step
+	vector<pair<int, double> > stepList;
+	if (options.splitFlag) {
+		//strang splitting: A(h/2) D(h/2) R(h) D(h/2) A(h/2), each operator in its own number of sub-steps
+		for (int s = 0; s < options.subSteps[0]; s++) stepList.push_back(make_pair(static_cast<int>(OP_ADVECTION), 0.5 / options.subSteps[0]));
+		for (int s = 0; s < options.subSteps[1]; s++) stepList.push_back(make_pair(static_cast<int>(OP_DIFFUSION), 0.5 / options.subSteps[1]));
+		for (int s = 0; s < options.subSteps[2]; s++) stepList.push_back(make_pair(static_cast<int>(OP_REACTION), 1.0 / options.subSteps[2]));
+		for (int s = 0; s < options.subSteps[1]; s++) stepList.push_back(make_pair(static_cast<int>(OP_DIFFUSION), 0.5 / options.subSteps[1]));
+		for (int s = 0; s < options.subSteps[0]; s++) stepList.push_back(make_pair(static_cast<int>(OP_ADVECTION), 0.5 / options.subSteps[0]));
+	} else {
+		stepList.push_back(make_pair(static_cast<int>(OP_ADVECTION), 1.0));
+		stepList.push_back(make_pair(OP_DIFFUSION | OP_REACTION, 1.0));
+	}
+	for (t = restartState.t; (isAdaptive) ? *sim_time <= end_time : t <= static_cast<int>(end_time / dt); t++) {
+		if (!isAdaptive) *sim_time = t * dt;
+		//checkpoint at the beginning of the step, the outputs pushed so far are written first
+		if (options.checkpointInterval >= 0 && (isTerminationRequested() || (options.checkpointInterval > 0 && difftime(time(NULL), lastCheckpoint) >= options.checkpointInterval))) {
+			checkpointState state = {t, count, file_num, percent, *sim_time, dt, h_try, nextOutTime, acceptedSteps, rejectedSteps};
+			flushHDFWriter(hdfw);
+			flushImageWorkers();
+			writeCheckpoint(checkpointPath, varInfoList, numOfVolIndexes, state);
+			lastCheckpoint = time(NULL);
+			if (isTerminationRequested()) {
+				cout << "checkpoint written at t = " << *sim_time << ", stopping" << endl;
+				break;
+			}
+		}
 		//output
 		out_start = clock();
-		if (count % out_step == 0) {
+		if ((isAdaptive) ? *sim_time >= nextOutTime : count % out_step == 0) {
 			if (dimension == 2) {
         outputImg(model, varInfoList, geo_edge, Xdiv, Ydiv, xInfo->value[0], xInfo->value[0] + Xsize, yInfo->value[0], yInfo->value[0] + Ysize, *sim_time, range_min, range_max, fname, file_num, outpath, num_digits);
        }
@@ -1084,201 +1195,250 @@ void simulate(optionList options)
         //else output3D_uint8(varInfoList, los, Xindex, Yindex, Zindex, file_num, fname, range_max);
         else outputGrayImage(model, varInfoList, geo_edge, Xdiv, Ydiv, Zdiv, *sim_time, range_min, range_max, fname, file_num, outpath);
       }
-      outputValueData(varInfoList, los, Xdiv, Ydiv, Zdiv, dimension, file_num, fname, outpath);
+      pushValueData(hdfw, *sim_time);
+      if (ringw != 0) pushRingFrame(ringw, *sim_time);
 			file_num++;
+			nextOutTime = file_num * dt * out_step;
 		}
 		out_end = clock();
 		output_time += out_end - out_start;
 		count++;
+		if (isAdaptive) {
+			if (*sim_time >= end_time) break;
+			//output times and the end time are hit exactly
+			stepEnd = min(nextOutTime, end_time);
+			isClipped = (h_try >= stepEnd - *sim_time);
+			h = (isClipped) ? stepEnd - *sim_time : h_try;
+			//values and the boundary flux carried in the first delta slot are restored when the step is rejected
+			for (i = 0; i < plan->speciesList.size(); i++) {
+				variableInfo *sInfo = plan->speciesList[i].sInfo;
+				if (!plan->speciesList[i].isVariable) continue;
+				savedState[i].assign(sInfo->value, sInfo->value + numOfVolIndexes);
+				savedState[i].insert(savedState[i].end(), sInfo->delta, sInfo->delta + numOfVolIndexes);
+			}
+		}
 
 		//calculation
-		//advection
-		ad_start = clock();
-		for (i = 0; i < numOfSpecies; i++) {
-			variableInfo *sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
+		//operator sub-steps of this step, a single advection and runge-kutta step unless -S is given
+		bool isRejected = false;
+		for (unsigned int sub = 0; sub < stepList.size() && !isRejected; sub++) {
+			int opMask = stepList[sub].first;
+			double hs = h * stepList[sub].second;
 			//advection
-			if (sInfo->adCInfo != 0) {
-				cipCSLR(sInfo, deltaX, deltaY, deltaZ, dt, Xindex, Yindex, Zindex, dimension);
-			}//end of advection
-		}
-		ad_end = clock();
-		ad_time += ad_end - ad_start;
-
-		//runge-kutta
-		for (unsigned int m = 0; m < 4; m++) {
-			//diffusion
-			for (i = 0; i < numOfSpecies; i++) {
-				variableInfo *sInfo = searchInfoById(varInfoList, los->get(i)->getId().c_str());
-				diff_start = clock();
-				//volume diffusion
-				if (sInfo->diffCInfo != 0 && sInfo->geoi->isVol) {
-					calcDiffusion(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, dt);
-				}
-				//membane diffusion
-				if (sInfo->diffCInfo != 0 && !sInfo->geoi->isVol) {
-					calcMemDiffusion(sInfo, vorI, Xindex, Yindex, Zindex, m, dt, dimension);
+			if (opMask & OP_ADVECTION) {
+				ad_start = clock();
+				for (i = 0; i < plan->speciesList.size(); i++) {
+					speciesPlan *sPlan = &(plan->speciesList[i]);
+					//advection
+					if (sPlan->hasAdvection) {
+						for (k = 0; k < sPlan->numOfAdSteps; k++) {
+							cipCSLR(sPlan->sInfo, deltaX, deltaY, deltaZ, hs / sPlan->numOfAdSteps, Xindex, Yindex, Zindex, dimension);
+						}
+					}//end of advection
 				}
-				diff_end = clock();
-				diff_time += diff_end - diff_start;
-				boundary_start = clock();
-				//boundary condition
-				if (sInfo->boundaryInfo != 0 && sInfo->geoi->isVol) {
-					calcBoundary(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, dimension);
+				ad_end = clock();
+				ad_time += ad_end - ad_start;
+				continue;
+			}
+			//the boundary flux carried over from the last update belongs to diffusion
+			if (!(opMask & OP_DIFFUSION)) {
+				for (i = 0; i < plan->speciesList.size(); i++) {
+					speciesPlan *sPlan = &(plan->speciesList[i]);
+					if (sPlan->hasBoundary && sPlan->isVariable) fill_n(sPlan->sInfo->delta, numOfVolIndexes, 0.0);
 				}
-				boundary_end = clock();
-				boundary_time += (boundary_end - boundary_start);
 			}
-			//reaction
-			re_start = clock();
-			//slow reaction
-			for (i = 0; i < rInfoList.size(); i++) {
-				//Reaction *r = model->getReaction(i);
-				Reaction *r = rInfoList[i]->reaction;
-				if (!rInfoList[i]->isMemTransport) {//normal reaction
-					sr = r->getReactant(0);
-					reversePolishRK(rInfoList[i], searchInfoById(varInfoList, sr->getSpecies().c_str())->geoi, Xindex, Yindex, Zindex, dt, m, r->getNumReactants(), true);
-				} else {//membrane transport
-					GeometryInfo *reactantGeo = searchInfoById(varInfoList, r->getReactant(0)->getSpecies().c_str())->geoi;
-					GeometryInfo *productGeo = searchInfoById(varInfoList, r->getProduct(0)->getSpecies().c_str())->geoi;
-					for (j = 0; j < geoInfoList.size(); j++) {
-						if (!geoInfoList[j]->isVol) {
-							if ((geoInfoList[j]->adjacentGeo1 == reactantGeo && geoInfoList[j]->adjacentGeo2 == productGeo)
-							    || (geoInfoList[j]->adjacentGeo1 == productGeo && geoInfoList[j]->adjacentGeo2 == reactantGeo)) {//mem transport
-								calcMemTransport(rInfoList[i], geoInfoList[j], nuVec, Xindex, Yindex, Zindex, dt, m, deltaX, deltaY, deltaZ, dimension, r->getNumReactants());
-								break;
-							}
+
+			//runge-kutta
+			for (unsigned int m = 0; m < 4; m++) {
+				if (isAdaptive && m == 3) {
+					//delta[2] = 2/9 k1 + 1/3 k2 + 4/9 k3, so that the last stage is evaluated at the 3rd order solution
+					for (i = 0; i < plan->speciesList.size(); i++) {
+						if (!plan->speciesList[i].isVariable) continue;
+						double *d = plan->speciesList[i].sInfo->delta;
+#pragma omp parallel for schedule(static)
+						for (int n = 0; n < static_cast<int>(numOfVolIndexes); n++) {
+							d[2 * numOfVolIndexes + n] = (2.0 * d[n] + 3.0 * d[numOfVolIndexes + n] + 4.0 * d[2 * numOfVolIndexes + n]) / 9.0;
 						}
 					}
-					if (reactantGeo->isVol ^ productGeo->isVol) {
-						if (!reactantGeo->isVol) {
-							calcMemTransport(rInfoList[i], reactantGeo, nuVec, Xindex, Yindex, Zindex, dt, m, deltaX, deltaY, deltaZ, dimension, r->getNumReactants());
-						}
-						if (!productGeo->isVol) {
-							calcMemTransport(rInfoList[i], productGeo, nuVec, Xindex, Yindex, Zindex, dt, m, deltaX, deltaY, deltaZ, dimension, r->getNumReactants());
+				}
+				//diffusion
+				for (i = 0; i < plan->speciesList.size() && (opMask & OP_DIFFUSION); i++) {
+					speciesPlan *sPlan = &(plan->speciesList[i]);
+					variableInfo *sInfo = sPlan->sInfo;
+					//multirate species are sub-cycled after the update
+					if (sPlan->numOfDiffSteps > 1) continue;
+					diff_start = clock();
+					//volume diffusion (implicit diffusion is solved after the update)
+					if (sPlan->hasVolDiffusion && sPlan->idInfo == 0) {
+						calcDiffusion(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, rk[m] * hs);
+					}
+					//membane diffusion
+					if (sPlan->hasMemDiffusion) {
+						calcMemDiffusion(sInfo, vorI, Xindex, Yindex, Zindex, m, rk[m] * hs, dimension);
+					}
+					diff_end = clock();
+					diff_time += diff_end - diff_start;
+					boundary_start = clock();
+					//boundary condition
+					if (sPlan->hasBoundary && sInfo->geoi->isVol) {
+						calcBoundary(sInfo, sPlan->bcKind, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, m, dimension);
+					}
+					boundary_end = clock();
+					boundary_time += (boundary_end - boundary_start);
+				}
+				//reaction
+				re_start = clock();
+				//slow reaction
+				for (i = 0; i < plan->reactionList.size() && (opMask & OP_REACTION); i++) {
+					reactionPlan *rPlan = &(plan->reactionList[i]);
+					if (rPlan->isImplicit) continue;
+					if (!rPlan->rInfo->isMemTransport) {//normal reaction
+						reversePolishRK(rPlan->rInfo, rPlan->geoi, Xindex, Yindex, Zindex, rk[m] * hs, m, rPlan->numOfReactants, true);
+					} else {//membrane transport
+						for (j = 0; j < rPlan->memGeoList.size(); j++) {
+							calcMemTransport(rPlan->rInfo, rPlan->memGeoList[j], nuVec, Xindex, Yindex, Zindex, rk[m] * hs, m, deltaX, deltaY, deltaZ, dimension, rPlan->numOfReactants);
 						}
 					}
 				}
-			}
-			re_end = clock();
-			re_time += (re_end - re_start);
-			//rate rule
-			for (i = 0; i < numOfRules; i++) {
-				if (model->getRule(i)->isRate()) {
-					RateRule *rrule = static_cast<RateRule*>(model->getRule(i));
-					variableInfo *sInfo = searchInfoById(varInfoList, rrule->getVariable().c_str());
-					reversePolishRK(rInfoList[i], sInfo->geoi, Xindex, Yindex, Zindex, dt, m, 1, false);
+				re_end = clock();
+				re_time += (re_end - re_start);
+				//rate rule
+				for (i = 0; i < plan->rateRuleList.size() && (opMask & OP_REACTION); i++) {
+					reactionPlan *rPlan = &(plan->rateRuleList[i]);
+					if (rPlan->isImplicit) continue;
+					reversePolishRK(rPlan->rInfo, rPlan->geoi, Xindex, Yindex, Zindex, rk[m] * hs, m, 1, false);
 				}
-			}
-		}//end of runge-kutta
-		 //update values (advection, diffusion, slow reaction)
-		update_start = clock();
-		for (i = 0; i < numOfSpecies; i++) {
-			s = los->get(i);
-			variableInfo *sInfo = searchInfoById(varInfoList, s->getId().c_str());
-			if (!s->isSetConstant() || !s->getConstant()) {
-				for (j = 0; j < sInfo->geoi->domainIndex.size(); j++) {
-					index = sInfo->geoi->domainIndex[j];
-					Z = index / (Xindex * Yindex);
-					Y = (index - Z * Xindex * Yindex) / Xindex;
-					X = index - Z * Xindex * Yindex - Y * Xindex;
-					//int divIndex = (Z / 2) * Ydiv * Xdiv + (Y / 2) * Xdiv + (X / 2);
-					//update values for the next time
-					sInfo->value[index] += dt * (sInfo->delta[index] + 2.0 * sInfo->delta[numOfVolIndexes + index] + 2.0 * sInfo->delta[2 * numOfVolIndexes + index] + sInfo->delta[3 * numOfVolIndexes + index]) / 6.0;
-					for (k = 0; k < 4; k++) sInfo->delta[k * numOfVolIndexes + index] = 0.0;
+			}//end of runge-kutta
+			//step size control
+			if (isAdaptive) {
+				//error of the 2nd order solution: h * (2 * delta[2] - k1 - k4) / 8, scaled by atol = rtol = tolerance
+				double errNorm = 0.0;
+				for (i = 0; i < plan->speciesList.size(); i++) {
+					speciesPlan *sPlan = &(plan->speciesList[i]);
+					if (!sPlan->isVariable) continue;
+					double *val = sPlan->sInfo->value, *d = sPlan->sInfo->delta;
+					int numOfDomainIndexes = static_cast<int>(sPlan->sInfo->geoi->domainIndex.size());
+#pragma omp parallel for schedule(static) reduction(max:errNorm)
+					for (int n = 0; n < numOfDomainIndexes; n++) {
+						int idx = sPlan->sInfo->geoi->domainIndex[n];
+						double next = val[idx] + hs * d[2 * numOfVolIndexes + idx];
+						double err = hs * (2.0 * d[2 * numOfVolIndexes + idx] - d[idx] - d[3 * numOfVolIndexes + idx]) / 8.0;
+						errNorm = max(errNorm, fabs(err) / (options.tolerance * (1.0 + max(fabs(val[idx]), fabs(next)))));
+					}
+				}
+				double factor = (errNorm > 0.0) ? max(0.2, min(5.0, 0.9 * pow(errNorm, -1.0 / 3.0))) : 5.0;
+				if (errNorm > 1.0 && h > 1.0e-12 * end_time) {
+					//rejected
+					for (i = 0; i < plan->speciesList.size(); i++) {
+						variableInfo *sInfo = plan->speciesList[i].sInfo;
+						if (!plan->speciesList[i].isVariable) continue;
+						copy(savedState[i].begin(), savedState[i].begin() + numOfVolIndexes, sInfo->value);
+						copy(savedState[i].begin() + numOfVolIndexes, savedState[i].end(), sInfo->delta);
+						fill_n(sInfo->delta + numOfVolIndexes, 3 * numOfVolIndexes, 0.0);
+					}
+					h_try = hs * factor;
+					rejectedSteps++;
+					isRejected = true;
+					break;
 				}
-				//boundary condition
-				if (sInfo->boundaryInfo != 0) {
-					calcBoundary(sInfo, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, 0, dimension);
+				//a step shortened to hit an output or the end time does not limit the next one
+				h_try = (isClipped) ? max(h_try, min(min_dt, hs * factor)) : min(min_dt, hs * factor);
+				acceptedSteps++;
+			}
+			 //update values (advection, diffusion, slow reaction)
+			update_start = clock();
+			for (i = 0; i < plan->speciesList.size(); i++) {
+				speciesPlan *sPlan = &(plan->speciesList[i]);
+				variableInfo *sInfo = sPlan->sInfo;
+				if (sPlan->isVariable) {
+					//multirate diffusion
+					if (sPlan->numOfDiffSteps > 1 && (opMask & OP_DIFFUSION)) {
+						diff_start = clock();
+						subcycleDiffusion(sInfo, sPlan->bcKind, vorI, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, hs, sPlan->numOfDiffSteps, dimension);
+						diff_end = clock();
+						diff_time += diff_end - diff_start;
+						continue;
+					}
+					const unsigned int *domainIndex = (sInfo->geoi->domainIndex.empty()) ? 0 : &(sInfo->geoi->domainIndex[0]);
+					double *value = sInfo->value, *d = sInfo->delta;
+					//each point only touches its own value and delta
+#pragma omp parallel for schedule(static)
+					for (int n = 0; n < static_cast<int>(sInfo->geoi->domainIndex.size()); n++) {
+						unsigned int idx = domainIndex[n];
+						//update values for the next time
+						if (isAdaptive) value[idx] += hs * d[2 * numOfVolIndexes + idx];
+						else value[idx] += hs * (d[idx] + 2.0 * d[numOfVolIndexes + idx] + 2.0 * d[2 * numOfVolIndexes + idx] + d[3 * numOfVolIndexes + idx]) / 6.0;
+						for (int q = 0; q < 4; q++) d[q * numOfVolIndexes + idx] = 0.0;
+					}
+					//boundary condition
+					if (sPlan->hasBoundary) {
+						calcBoundary(sInfo, sPlan->bcKind, deltaX, deltaY, deltaZ, Xindex, Yindex, Zindex, 0, dimension);
+					}
+					//implicit diffusion
+					if (sPlan->idInfo != 0 && (opMask & OP_DIFFUSION)) {
+						diff_start = clock();
+						calcImplicitDiffusion(sPlan->idInfo, hs);
+						diff_end = clock();
+						diff_time += diff_end - diff_start;
+					}
 				}
 			}
+			update_end = clock();
+			update_time += update_end - update_start;
+			//implicit reactions, after the explicit terms of the (sub-)step
+			if ((opMask & OP_REACTION) && !plan->systemList.empty()) {
+				re_start = clock();
+				for (i = 0; i < plan->systemList.size(); i++) calcRosenbrock(plan->systemList[i], hs);
+				re_end = clock();
+				re_time += re_end - re_start;
+			}
 		}
-		update_end = clock();
-		update_time += update_end - update_start;
+		if (isRejected) continue;
 
 		//fast reaction
-		//              for (i = 0; i < fast_rInfoList.size(); i++) {
-		//                      Reaction *r = fast_rInfoList[i]->reaction;
-		//              }
+		re_start = clock();
+		for (i = 0; i < plan->fastSystemList.size(); i++) calcRapidEquilibrium(plan->fastSystemList[i]);
+		re_end = clock();
+		re_time += re_end - re_start;
 		//assignment rule
 		assign_start = clock();
-		for (i = 0; i < orderedARule.size(); i++) {
-			variableInfo *info = orderedARule[i];
-			bool isAllArea = (info->sp != 0) ? false : true;
-			if (info->sp != 0) {
-				info->geoi = searchAvolInfoByCompartment(geoInfoList, info->sp->getCompartment().c_str());
-			reversePolishInitial(info->geoi->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, isAllArea);
-		} else {//parameter mashimo
-        if ((static_cast<SpatialParameterPlugin*>(info->para->getPlugin("spatial")))->isSpatialParameter()) {
-          //reversePolishInitial(info->geoi->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, isAllArea);
-          reversePolishInitial(info->geoi->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, false);
-        } else {
-          reversePolishInitial(allAreaInfo->domainIndex, info->rpInfo, info->value, info->rpInfo->listNum, Xindex, Yindex, Zindex, isAllArea);
-        }
-      }
-    }
+		for (i = 0; i < plan->assignmentList.size(); i++) {
+			assignmentPlan *aPlan = &(plan->assignmentList[i]);
+			reversePolishInitial(*(aPlan->indexList), aPlan->info->bcInfo, aPlan->info->value, Xindex, Yindex, Zindex, aPlan->isAllArea);
+		}
 		assign_end = clock();
 		assign_time += assign_end - assign_start;
 		//pseudo membrane
 		clock_t mem_start = clock();
-		for (i = 0; i < numOfSpecies; i++) {
-			s = los->get(i);
-			variableInfo *sInfo = searchInfoById(varInfoList, s->getId().c_str());
-			if (!sInfo->geoi->isVol) {
-				for (j = 0; j < sInfo->geoi->pseudoMemIndex.size(); j++) {
-					index = sInfo->geoi->pseudoMemIndex[j];
-					Z = index / (Xindex * Yindex);
-					Y = (index - Z * Xindex * Yindex) / Xindex;
-					X = index - Z * Xindex * Yindex - Y * Xindex;
-					Xplus1 = Z * Yindex * Xindex + Y * Xindex + (X + 1);
-					Xminus1 = Z * Yindex * Xindex + Y * Xindex + (X - 1);
-					Yplus1 = Z * Yindex * Xindex + (Y + 1) * Xindex + X;
-					Yminus1 = Z * Yindex * Xindex + (Y - 1) * Xindex + X;
-					Zplus1 = (Z + 1) * Yindex * Xindex + Y * Xindex + X;
-					Zminus1 = (Z - 1) * Yindex * Xindex + Y * Xindex + X;
-					if (sInfo->geoi->isDomain[Xplus1] == 1 && sInfo->geoi->isDomain[Xminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xplus1], sInfo->value[Xminus1]);
-					} else if (sInfo->geoi->isDomain[Yplus1] == 1 && sInfo->geoi->isDomain[Yminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Yplus1], sInfo->value[Yminus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Zplus1] == 1 && sInfo->geoi->isDomain[Zminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Zplus1], sInfo->value[Zminus1]);
-					} else if (sInfo->geoi->isDomain[Xplus1] == 1 && sInfo->geoi->isDomain[Yplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xplus1], sInfo->value[Yplus1]);
-					} else if (sInfo->geoi->isDomain[Xplus1] == 1 && sInfo->geoi->isDomain[Yminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xplus1], sInfo->value[Yminus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Xplus1] == 1 && sInfo->geoi->isDomain[Zplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xplus1], sInfo->value[Zplus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Xplus1] == 1 && sInfo->geoi->isDomain[Zminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xplus1], sInfo->value[Zminus1]);
-					} else if (sInfo->geoi->isDomain[Xminus1] == 1 && sInfo->geoi->isDomain[Yplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xminus1], sInfo->value[Yplus1]);
-					} else if (sInfo->geoi->isDomain[Xminus1] == 1 && sInfo->geoi->isDomain[Yminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xminus1], sInfo->value[Yminus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Xminus1] == 1 && sInfo->geoi->isDomain[Zplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xminus1], sInfo->value[Zplus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Xminus1] == 1 && sInfo->geoi->isDomain[Zminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Xminus1], sInfo->value[Zminus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Yplus1] == 1 && sInfo->geoi->isDomain[Zplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Yplus1], sInfo->value[Zplus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Yplus1] == 1 && sInfo->geoi->isDomain[Zminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Yplus1], sInfo->value[Zminus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Yminus1] == 1 && sInfo->geoi->isDomain[Zplus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Yminus1], sInfo->value[Zplus1]);
-					} else if (dimension == 3 && sInfo->geoi->isDomain[Yminus1] == 1 && sInfo->geoi->isDomain[Zminus1] == 1) {
-						sInfo->value[index] = min(sInfo->value[Yminus1], sInfo->value[Zminus1]);
-					}
-				}
+		for (i = 0; i < plan->speciesList.size(); i++) {
+			if (plan->speciesList[i].pseudoMemTable < 0) continue;
+			const vector<pseudoMemEntry> &table = plan->pseudoMemTableList[plan->speciesList[i].pseudoMemTable];
+			const pseudoMemEntry *entry = (table.empty()) ? 0 : &table[0];
+			double *value = plan->speciesList[i].sInfo->value;
+			int numOfEntries = static_cast<int>(table.size());
+			//pseudo membrane points only read membrane points
+#pragma omp parallel for schedule(static)
+			for (int e = 0; e < numOfEntries; e++) {
+				value[entry[e].index] = min(value[entry[e].nbrA], value[entry[e].nbrB]);
 			}
 		}
 		clock_t mem_end = clock();
 		mem_time += mem_end - mem_start;
 
-		if (t == (static_cast<int>(end_time / dt) / 10) * percent) {
+		if (isAdaptive) *sim_time = (isClipped) ? stepEnd : *sim_time + h;
+		if ((isAdaptive) ? *sim_time >= end_time / 10 * percent : t == (static_cast<int>(end_time / dt) / 10) * percent) {
 			cout << percent * 10 << "% finished" << endl;
 			percent++;
 		}
 	}
+	closeHDFWriter(hdfw);
+	finishImageWorkers();
+	if (ringw != 0) closeRingWriter(ringw);
 	clock_t sim_end = clock();
 	cout << endl;
+	if (isAdaptive) {
+		cout << "accepted steps: " << acceptedSteps << ", rejected steps: " << rejectedSteps << endl;
+	}
   cout << "simulation_time: "<< ((sim_end - sim_start) / static_cast<double>(CLOCKS_PER_SEC)) << endl;
   cout << "reaction_time: "<< (re_time / static_cast<double>(CLOCKS_PER_SEC)) << endl;
   cout << "diffusion_time: "<< (diff_time / static_cast<double>(CLOCKS_PER_SEC)) << endl;
@@ -1293,6 +1453,8 @@ void simulate(optionList options)
 //delete freeConstList[i];
 //freeConstList[i] = 0;
 //}
+	freeExecutionPlan(plan);
+	freeNativeKernels(nativeHandle);
     freeVarInfo(varInfoList);
 	freeAvolInfo(geoInfoList);
 	freeRInfo(rInfoList);
@@ -0,0 +1,195 @@
+/*
+   compiles kinetic law shaped formulas with compileAST and compares the bytecode with
+   a direct evaluation of the formula tree, and the power of the bytecode lanes with pow
+   build and run with "make test"
+ */
+#include "spatialsim/astFunction.h"
+#include "spatialsim/calcPDE.h"
+#include "spatialsim/initializeFunction.h"
+#include "spatialsim/mystruct.h"
+#include "sbml/SBMLTypes.h"
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+LIBSBML_CPP_NAMESPACE_USE
+
+static double evaluateTree(const ASTNode *ast, vector<variableInfo*> &varInfoList)
+{
+	unsigned int i, n = ast->getNumChildren();
+	if (ast->isInteger()) return static_cast<double>(ast->getInteger());
+	if (ast->isReal()) return ast->getReal();
+	if (ast->isName()) {
+		for (i = 0; i < varInfoList.size(); i++) {
+			if (strcmp(varInfoList[i]->id, ast->getName()) == 0) return varInfoList[i]->value[0];
+		}
+		cerr << "unknown symbol " << ast->getName() << endl;
+		exit(1);
+	}
+	vector<double> c(n);
+	if (ast->getType() == AST_FUNCTION_PIECEWISE) {//pieces are taken in order, 0 without otherwise
+		for (i = 0; i + 1 < n; i += 2) {
+			if (evaluateTree(ast->getChild(i + 1), varInfoList) != 0.0) return evaluateTree(ast->getChild(i), varInfoList);
+		}
+		return (n % 2 != 0) ? evaluateTree(ast->getChild(n - 1), varInfoList) : 0.0;
+	}
+	for (i = 0; i < n; i++) c[i] = evaluateTree(ast->getChild(i), varInfoList);
+	double result = 0.0;
+	switch (ast->getType()) {
+	case AST_PLUS:
+		for (i = 0; i < n; i++) result += c[i];
+		return result;
+	case AST_MINUS:
+		return (n == 1) ? -c[0] : c[0] - c[1];
+	case AST_TIMES:
+		result = 1.0;
+		for (i = 0; i < n; i++) result *= c[i];
+		return result;
+	case AST_DIVIDE:
+		return c[0] / c[1];
+	case AST_POWER:
+	case AST_FUNCTION_POWER:
+		return pow(c[0], c[1]);
+	case AST_FUNCTION_EXP:
+		return exp(c[0]);
+	case AST_FUNCTION_LN:
+		return log(c[0]);
+	case AST_RELATIONAL_GT:
+		return (c[0] > c[1]) ? 1.0 : 0.0;
+	case AST_RELATIONAL_LT:
+		return (c[0] < c[1]) ? 1.0 : 0.0;
+	default:
+		cerr << "unsupported node in the test: " << SBML_formulaToString(ast) << endl;
+		exit(1);
+	}
+}
+
+static variableInfo* newTestVariable(const char *id, double value, bool isUniform)
+{
+	variableInfo *info = new variableInfo;
+	InitializeVarInfo(info);
+	info->id = id;
+	info->value = new double[1];
+	info->value[0] = value;
+	info->isUniform = isUniform;
+	return info;
+}
+
+//ast is rearranged and compiled like a kinetic law, true if the bytecode agrees with the tree
+static bool checkFormula(ASTNode *ast, string formula, vector<variableInfo*> &varInfoList)
+{
+	unsigned int v;
+	double expected = evaluateTree(ast, varInfoList);
+	rearrangeAST(ast);
+	bytecodeInfo *bc = compileAST(ast, varInfoList, false);
+	vector<double> reg;
+	loadBytecodeRegisters(bc, reg);
+	for (v = 0; v < bc->varList.size(); v++) reg[bc->varBase + v] = bc->varList[v][0];
+	double result = executeBytecode(bc, &reg[0]);
+	delete bc;
+	bool isPassed = fabs(result - expected) <= 1e-12 * max(1.0, fabs(expected));
+	cout << (isPassed ? "ok     " : "FAILED ") << formula << " = " << result << " (expected " << expected << ")" << endl;
+	return isPassed;
+}
+
+static double getUlps(double x, double expected)
+{
+	if (x == expected) return 0.0;
+	return fabs(x - expected) / (nextafter(fabs(expected), HUGE_VAL) - fabs(expected));
+}
+
+//S^P on the lanes, each lane with its own base and exponent. integer exponents are multiplied
+//out and have to agree with pow within maxIntUlps, the others within 2 * (1 + |P * log(S)|) ulp
+static int checkPowerLanes(const double *baseList, const double *exponentList, unsigned int numOfCases, double maxIntUlps)
+{
+	unsigned int i, v, l;
+	int numOfFailures = 0;
+	vector<variableInfo*> varInfoList;
+	varInfoList.push_back(newTestVariable("S", 1.0, false));
+	varInfoList.push_back(newTestVariable("P", 1.0, false));
+	ASTNode *ast = SBML_parseFormula("S ^ P");
+	bytecodeInfo *bc = compileAST(ast, varInfoList, false);
+	vector<double> reg;
+	loadBytecodeLanes(bc, reg);
+	for (i = 0; i < numOfCases; i += BC_LANES) {
+		for (l = 0; l < BC_LANES; l++) {
+			unsigned int k = min(i + l, numOfCases - 1);
+			for (v = 0; v < bc->varList.size(); v++) {
+				reg[(bc->varBase + v) * BC_LANES + l] = (bc->varList[v] == varInfoList[0]->value) ? baseList[k] : exponentList[k];
+			}
+		}
+		executeBytecodeLanes(bc, &reg[0]);
+		for (l = 0; l < BC_LANES && i + l < numOfCases; l++) {
+			double base = baseList[i + l], exponent = exponentList[i + l];
+			double result = reg[bc->result * BC_LANES + l], expected = pow(base, exponent);
+			bool isInteger = (exponent == floor(exponent));
+			double maxUlps = (isInteger) ? maxIntUlps : 2.0 * (1.0 + fabs(exponent * log(base)));
+			bool isPassed = (result != result && expected != expected) || getUlps(result, expected) <= maxUlps;
+			if (!isPassed || isInteger) {
+				cout << (isPassed ? "ok     " : "FAILED ") << base << " ^ " << exponent << " = " << setprecision(17) << result << " (pow " << expected << ")" << setprecision(6) << endl;
+			}
+			if (!isPassed) numOfFailures++;
+		}
+	}
+	delete bc;
+	delete ast;
+	return numOfFailures;
+}
+
+int main()
+{
+	vector<variableInfo*> varInfoList;
+	varInfoList.push_back(newTestVariable("Vmax", 2.0, true));
+	varInfoList.push_back(newTestVariable("Km", 5.0, true));
+	varInfoList.push_back(newTestVariable("S", 3.0, false));
+	varInfoList.push_back(newTestVariable("P", 0.5, false));
+	//identity folds (0 + x, 1 * x, x - 0, x / 1) whose kept operand is the temporary of a nested expression,
+	//including the leading 0 that rearrangeAST adds to a piecewise without otherwise
+	const char *formulaList[] = {
+		"(1 * (Vmax * S)) / (Km + S)",
+		"(0 + Vmax * S) - (Km * S)",
+		"(Vmax * S - 0) * (Km + S)",
+		"(Vmax * S / 1) + Km * (S + P)",
+		"(S * (Vmax * 1)) / (Km + P)",
+		"exp(1 * (S * P)) - S * Vmax",
+		"piecewise(Vmax * S, S > 1) - Km * S",
+		"piecewise(Vmax * S, S < 1) - Km * S",
+		"piecewise(Vmax * S, S > 1, Km * P, S < 1) / (Km + S * P)",
+		"piecewise(Vmax * S, S < 1, Km * P) * (Km - S)",
+		"Vmax * S / (Km + S) - (0 + P * (1 * (S * Km))) / (1 + P)",
+		0
+	};
+	int numOfFailures = 0;
+	for (unsigned int i = 0; formulaList[i] != 0; i++) {
+		ASTNode *ast = SBML_parseFormula(formulaList[i]);
+		if (!checkFormula(ast, formulaList[i], varInfoList)) numOfFailures++;
+		delete ast;
+	}
+	//unary plus is not written by the formula parser, rearrangeAST turns it into "x * 1.0"
+	ASTNode *ast = new ASTNode(AST_DIVIDE);
+	ASTNode *uplus = new ASTNode(AST_PLUS);
+	uplus->addChild(SBML_parseFormula("Vmax * S"));
+	ast->addChild(uplus);
+	ast->addChild(SBML_parseFormula("Km + S"));
+	if (!checkFormula(ast, "+(Vmax * S) / (Km + S)", varInfoList)) numOfFailures++;
+	delete ast;
+	//x^2, cubes and hill coefficients with exact results have to be exact like the scalar path
+	const double exactBaseList[] = {3.0, 10.0, 2.0, -2.0, 0.5, 7.0, 1.5, 0.0, -3.0, 10.0, 4.0};
+	const double exactExponentList[] = {2.0, 3.0, -2.0, 3.0, 4.0, 0.0, 2.0, 2.0, 4.0, -1.0, 0.5};
+	numOfFailures += checkPowerLanes(exactBaseList, exactExponentList, sizeof(exactBaseList) / sizeof(double), 0.0);
+	const double baseList[] = {2.7, 0.31, 1.7e-3, 123.4, 5.0, 0.9, 2.7, 0.31, 1.7e-3, 123.4, 5.0, 0.9, 1e-300, 1e300, -2.5, 0.0};
+	const double exponentList[] = {3.0, 4.0, 2.0, -3.0, 16.0, 11.0, 2.5, -1.3, 0.7, 1.0 / 3.0, -2.2, 40.5, 0.5, 0.9, 0.5, -1.5};
+	numOfFailures += checkPowerLanes(baseList, exponentList, sizeof(baseList) / sizeof(double), 4.0);
+	if (numOfFailures != 0) {
+		cerr << numOfFailures << " formulas failed" << endl;
+		return 1;
+	}
+	cout << "all formulas passed" << endl;
+	return 0;
+}